@@ -0,0 +1,460 @@
+#include "bench.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__linux__)
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define kvm_implementation
+#include "kvm.h"
+#define map_implementation
+#include "map.h"
+
+static const char* usage =
+    "usage: bench [options] > result.json\n"
+    "  --n=1000000       entries put before the timed operations\n"
+    "  --ops=1000000     timed operations\n"
+    "  --key=8           key bytes: 4 or 8\n"
+    "  --val=8           value bytes: 4, 8 or 16\n"
+    "  --load=75         max load percent (10..95)\n"
+    "  --hit=90          percent of operations on present keys\n"
+    "  --write=10        percent of operations that are puts\n"
+    "  --dist=uniform    uniform, zipf or sequential\n"
+    "  --zipf=0.99       Zipf exponent\n"
+    "  --seed=1\n"
+    "  --impl=kvm,map,unordered_map,sorted\n"
+    "  --perf            cycles, instructions, LLC, dTLB and branch misses\n"
+    "                    per operation (Linux perf_event_open)\n"
+    "  --help, -h        print this message\n";
+
+static const char* dists[] = { "uniform", "zipf", "sequential" };
+
+uint64_t bench_nanoseconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000uLL + (uint64_t)ts.tv_nsec;
+}
+
+// --perf counters are opened once, each on its own so that a counter
+// the CPU or hypervisor lacks does not disable the others. Kernel and
+// hypervisor events are excluded which perf_event_paranoid <= 2 allows.
+// Multiplexed counters are scaled by time enabled over time running.
+
+static const char* counter_names[bench_counters] = {
+    "cycles", "instructions", "llc_misses", "dtlb_misses", "branch_misses"
+};
+
+static int counter_fds[bench_counters];
+
+static bool bench_perf_open(void) {
+    static int opened; // 0 not yet, 1 at least one counter, -1 none
+    if (opened != 0) { return opened > 0; }
+    opened = -1;
+#if defined(__linux__)
+    const struct { uint32_t type; uint64_t config; } events[] = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                              (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    };
+    for (int i = 0; i < bench_counters; i++) {
+        struct perf_event_attr a;
+        memset(&a, 0, sizeof(a));
+        a.size = sizeof(a);
+        a.type = events[i].type;
+        a.config = events[i].config;
+        a.disabled = 1;
+        a.exclude_kernel = 1;
+        a.exclude_hv = 1;
+        a.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                        PERF_FORMAT_TOTAL_TIME_RUNNING;
+        counter_fds[i] = (int)syscall(SYS_perf_event_open, &a, 0, -1, -1, 0);
+        if (counter_fds[i] >= 0) {
+            opened = 1;
+        } else {
+            fprintf(stderr, "notice: %s counter unavailable: %s\n",
+                    counter_names[i], strerror(errno));
+        }
+    }
+    if (opened < 0) {
+        fprintf(stderr, "notice: no hardware counters (containers and VMs "
+                "often hide them, see /proc/sys/kernel/perf_event_paranoid)"
+                ", reporting time only\n");
+    }
+#else
+    for (int i = 0; i < bench_counters; i++) { counter_fds[i] = -1; }
+    fprintf(stderr, "notice: --perf needs Linux perf_event_open(), "
+            "reporting time only\n");
+#endif
+    return opened > 0;
+}
+
+void bench_perf_start(const struct bench_config* c) {
+    if (!c->perf || !bench_perf_open()) { return; }
+#if defined(__linux__)
+    for (int i = 0; i < bench_counters; i++) {
+        if (counter_fds[i] >= 0) {
+            ioctl(counter_fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counter_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+void bench_perf_stop(const struct bench_config* c, struct bench_result* r) {
+    for (int i = 0; i < bench_counters; i++) { r->counters[i] = -1; }
+    if (!c->perf || !bench_perf_open()) { return; }
+#if defined(__linux__)
+    for (int i = 0; i < bench_counters; i++) {
+        if (counter_fds[i] >= 0) {
+            ioctl(counter_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    for (int i = 0; i < bench_counters; i++) {
+        uint64_t v[3] = {0}; // value, time enabled, time running
+        if (counter_fds[i] >= 0 &&
+            read(counter_fds[i], v, sizeof(v)) == (ssize_t)sizeof(v) &&
+            v[2] > 0) {
+            const double scaled = (double)v[0] * (double)v[1] / (double)v[2];
+            r->counters[i] = scaled / (double)c->ops;
+        }
+    }
+#endif
+}
+
+static uint64_t random64(uint64_t* state) {
+    // SplitMix64
+    uint64_t z = (*state += 0x9E3779B97F4A7C15uLL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9uLL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBuLL;
+    return z ^ (z >> 31);
+}
+
+static uint64_t bench_key(const struct bench_config* c, uint64_t i) {
+    // distinct keys for distinct i: bijective mixers of 32 and 64 bits
+    if (c->dist == bench_sequential) { return i + 1; }
+    if (c->kb == 4) {
+        uint32_t x = (uint32_t)i;
+        x ^= x >> 16; x *= 0x85EBCA6Bu;
+        x ^= x >> 13; x *= 0xC2B2AE35u;
+        x ^= x >> 16;
+        return x;
+    }
+    i ^= i >> 33; i *= 0xFF51AFD7ED558CCDuLL;
+    i ^= i >> 33; i *= 0xC4CEB9FE1A85EC53uLL;
+    i ^= i >> 33;
+    return i;
+}
+
+struct bench_zipf { // YCSB style generator of ranks [0, n)
+    double n;
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+};
+
+static void bench_zipf_init(struct bench_zipf* z, size_t n, double theta) {
+    double zetan = 0;
+    for (size_t i = 1; i <= n; i++) { zetan += 1.0 / pow((double)i, theta); }
+    const double zeta2 = 1.0 + 1.0 / pow(2.0, theta);
+    z->n = (double)n;
+    z->theta = theta;
+    z->alpha = 1.0 / (1.0 - theta);
+    z->zetan = zetan;
+    z->eta = (1.0 - pow(2.0 / (double)n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+}
+
+static size_t bench_zipf_next(const struct bench_zipf* z, uint64_t* seed) {
+    const double u = (double)(random64(seed) >> 11) * 0x1.0p-53;
+    const double uz = u * z->zetan;
+    if (uz < 1.0) { return 0; }
+    if (uz < 1.0 + pow(0.5, z->theta)) { return 1; }
+    const size_t r = (size_t)(z->n * pow(z->eta * u - z->eta + 1.0, z->alpha));
+    return r < (size_t)z->n ? r : (size_t)z->n - 1;
+}
+
+static bool bench_workload(const struct bench_config* c,
+                           struct bench_workload* w) {
+    // present keys are bench_key(0..n-1), get misses come from
+    // [n, 2n) and put misses insert fresh keys from 2n upward
+    uint64_t* keys = malloc(c->n * sizeof(uint64_t));
+    uint64_t* key  = malloc(c->ops * sizeof(uint64_t));
+    uint8_t*  write = malloc(c->ops);
+    if (!keys || !key || !write) {
+        free(keys); free(key); free(write);
+        return false;
+    }
+    for (size_t i = 0; i < c->n; i++) { keys[i] = bench_key(c, i); }
+    struct bench_zipf z = {0};
+    if (c->dist == bench_zipf) { bench_zipf_init(&z, c->n, c->zipf); }
+    uint64_t seed = c->seed;
+    uint64_t fresh = 2 * c->n;
+    size_t next = 0; // sequential position
+    for (size_t i = 0; i < c->ops; i++) {
+        write[i] = random64(&seed) % 100 < c->write;
+        const bool hit = random64(&seed) % 100 < c->hit;
+        size_t j = 0;
+        if (c->dist == bench_zipf) {
+            j = bench_zipf_next(&z, &seed);
+        } else if (c->dist == bench_sequential) {
+            j = next;
+            next = next + 1 < c->n ? next + 1 : 0;
+        } else {
+            j = (size_t)(random64(&seed) % c->n);
+        }
+        if (hit) {
+            key[i] = keys[j];
+        } else if (write[i]) {
+            key[i] = bench_key(c, fresh++);
+        } else {
+            key[i] = bench_key(c, c->n + j);
+        }
+    }
+    w->keys = keys;
+    w->key = key;
+    w->write = write;
+    return true;
+}
+
+// kvm() and map() allocate through a counting allocator:
+
+static size_t allocated;
+
+static void* bench_alloc(void* context, size_t bytes) {
+    (void)context;
+    allocated += bytes;
+    return malloc(bytes);
+}
+
+static void* bench_zalloc(void* context, size_t bytes) {
+    (void)context;
+    allocated += bytes;
+    return calloc(1, bytes);
+}
+
+static void bench_free(void* context, void* p, size_t bytes) {
+    (void)context;
+    allocated -= bytes;
+    free(p);
+}
+
+static struct kvm_allocator kvm_counting = {
+    bench_alloc, bench_zalloc, bench_free, 0
+};
+
+static struct map_allocator map_counting = {
+    bench_alloc, bench_zalloc, bench_free, 0
+};
+
+typedef unsigned __int128 uint128_t;
+
+// The same loop for kvm() and map() of every key and value type:
+
+#define bench_runner(name, container, prefix, allocator, tk, tv)          \
+static void name(const struct bench_config* c,                            \
+                 const struct bench_workload* w, struct bench_result* r) { \
+    container(tk, tv) m;                                                  \
+    allocated = 0;                                                        \
+    prefix ## _alloc_with(&m, 16, allocator);                             \
+    prefix ## _load_factors(&m, c->load, 150, c->load / 4);               \
+    uint64_t t = bench_nanoseconds();                                     \
+    for (size_t i = 0; i < c->n; i++) {                                   \
+        prefix ## _put(&m, (tk)w->keys[i], (tv)i);                        \
+    }                                                                     \
+    r->build = (double)(bench_nanoseconds() - t) / (double)c->n;          \
+    size_t hits = 0;                                                      \
+    bench_perf_start(c);                                                  \
+    t = bench_nanoseconds();                                              \
+    for (size_t i = 0; i < c->ops; i++) {                                 \
+        const tk key = (tk)w->key[i];                                     \
+        if (w->write[i]) {                                                \
+            prefix ## _put(&m, key, (tv)i);                               \
+        } else {                                                          \
+            hits += prefix ## _get(&m, key) != 0;                         \
+        }                                                                 \
+    }                                                                     \
+    r->op = (double)(bench_nanoseconds() - t) / (double)c->ops;           \
+    bench_perf_stop(c, r);                                                \
+    r->hits = hits;                                                       \
+    r->n = m.n;                                                           \
+    r->bytes = (double)allocated / (double)m.n;                           \
+    prefix ## _free(&m);                                                  \
+}
+
+#define bench_runners(container, prefix, allocator)                       \
+    bench_runner(prefix ## _4_4,  container, prefix, allocator,           \
+                 uint32_t, uint32_t)                                      \
+    bench_runner(prefix ## _4_8,  container, prefix, allocator,           \
+                 uint32_t, uint64_t)                                      \
+    bench_runner(prefix ## _4_16, container, prefix, allocator,           \
+                 uint32_t, uint128_t)                                     \
+    bench_runner(prefix ## _8_4,  container, prefix, allocator,           \
+                 uint64_t, uint32_t)                                      \
+    bench_runner(prefix ## _8_8,  container, prefix, allocator,           \
+                 uint64_t, uint64_t)                                      \
+    bench_runner(prefix ## _8_16, container, prefix, allocator,           \
+                 uint64_t, uint128_t)                                     \
+    static bool bench_ ## prefix(const struct bench_config* c,            \
+            const struct bench_workload* w, struct bench_result* r) {     \
+        if (c->kb == 4 && c->vb == 4)  { prefix ## _4_4(c, w, r);  }      \
+        if (c->kb == 4 && c->vb == 8)  { prefix ## _4_8(c, w, r);  }      \
+        if (c->kb == 4 && c->vb == 16) { prefix ## _4_16(c, w, r); }      \
+        if (c->kb == 8 && c->vb == 4)  { prefix ## _8_4(c, w, r);  }      \
+        if (c->kb == 8 && c->vb == 8)  { prefix ## _8_8(c, w, r);  }      \
+        if (c->kb == 8 && c->vb == 16) { prefix ## _8_16(c, w, r); }      \
+        return true;                                                      \
+    }
+
+bench_runners(kvm, kvm, &kvm_counting)
+bench_runners(map, map, &map_counting)
+
+static const struct {
+    const char* name;
+    bool (*run)(const struct bench_config* c, const struct bench_workload* w,
+                struct bench_result* r);
+} impls[] = {
+    { "kvm",           bench_kvm           },
+    { "map",           bench_map           },
+    { "unordered_map", bench_std_unordered },
+    { "sorted",        bench_std_sorted    },
+};
+
+static bool bench_option(const char* arg, const char* name, const char** v) {
+    const size_t n = strlen(name);
+    if (strncmp(arg, name, n) == 0 && arg[n] == '=') {
+        *v = arg + n + 1;
+        return true;
+    }
+    return false;
+}
+
+static bool bench_selected(const char* list, const char* name) {
+    // name is an element of comma separated list
+    const size_t n = strlen(name);
+    const char* s = list;
+    while ((s = strstr(s, name)) != 0) {
+        const bool starts = s == list || s[-1] == ',';
+        const bool ends = s[n] == 0 || s[n] == ',';
+        if (starts && ends) { return true; }
+        s += n;
+    }
+    return false;
+}
+
+int main(int argc, const char* argv[]) {
+    kvm_fatalist = true;
+    map_fatalist = true;
+    struct bench_config c = {
+        .n = 1000 * 1000, .ops = 1000 * 1000, .kb = 8, .vb = 8,
+        .load = 75, .hit = 90, .write = 10, .dist = bench_uniform,
+        .zipf = 0.99, .seed = 1
+    };
+    const char* selected = "kvm,map,unordered_map,sorted";
+    for (int i = 1; i < argc; i++) {
+        const char* v = 0;
+        bool ok = true;
+        if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            printf("%s", usage);
+            return 0;
+        } else if (strcmp(argv[i], "--perf") == 0) {
+            c.perf = true;
+        } else if (bench_option(argv[i], "--n", &v)) {
+            c.n = strtoull(v, 0, 10);
+        } else if (bench_option(argv[i], "--ops", &v)) {
+            c.ops = strtoull(v, 0, 10);
+        } else if (bench_option(argv[i], "--key", &v)) {
+            c.kb = strtoull(v, 0, 10);
+            ok = c.kb == 4 || c.kb == 8;
+        } else if (bench_option(argv[i], "--val", &v)) {
+            c.vb = strtoull(v, 0, 10);
+            ok = c.vb == 4 || c.vb == 8 || c.vb == 16;
+        } else if (bench_option(argv[i], "--load", &v)) {
+            c.load = strtoull(v, 0, 10);
+            ok = 10 <= c.load && c.load <= 95;
+        } else if (bench_option(argv[i], "--hit", &v)) {
+            c.hit = strtoull(v, 0, 10);
+            ok = c.hit <= 100;
+        } else if (bench_option(argv[i], "--write", &v)) {
+            c.write = strtoull(v, 0, 10);
+            ok = c.write <= 100;
+        } else if (bench_option(argv[i], "--dist", &v)) {
+            c.dist = -1;
+            for (int d = 0; d < (int)(sizeof(dists) / sizeof(dists[0])); d++) {
+                if (strcmp(v, dists[d]) == 0) { c.dist = d; }
+            }
+            ok = c.dist >= 0;
+        } else if (bench_option(argv[i], "--zipf", &v)) {
+            c.zipf = strtod(v, 0);
+            ok = 0 < c.zipf && c.zipf < 1;
+        } else if (bench_option(argv[i], "--seed", &v)) {
+            c.seed = strtoull(v, 0, 10);
+        } else if (bench_option(argv[i], "--impl", &v)) {
+            selected = v;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            fprintf(stderr, "invalid option: %s\n%s", argv[i], usage);
+            return 1;
+        }
+    }
+    if (c.n == 0 || c.ops == 0 || (c.kb == 4 && c.n >= UINT32_MAX / 3)) {
+        fprintf(stderr, "invalid --n or --ops\n%s", usage);
+        return 1;
+    }
+    struct bench_workload w;
+    if (!bench_workload(&c, &w)) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    printf("{\n  \"config\": {\"n\": %zu, \"ops\": %zu, \"key\": %zu, "
+           "\"val\": %zu, \"load\": %zu, \"hit\": %zu, \"write\": %zu, "
+           "\"dist\": \"%s\", \"zipf\": %.3f, \"seed\": %llu, "
+           "\"perf\": %s},\n"
+           "  \"results\": [",
+           c.n, c.ops, c.kb, c.vb, c.load, c.hit, c.write, dists[c.dist],
+           c.zipf, (unsigned long long)c.seed, c.perf ? "true" : "false");
+    const char* separator = "";
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+        if (!bench_selected(selected, impls[i].name)) { continue; }
+        struct bench_result r = {0};
+        if (!impls[i].run(&c, &w, &r)) { continue; }
+        printf("%s\n    {\"impl\": \"%s\", \"build_ns\": %.2f, "
+               "\"op_ns\": %.2f, \"bytes_per_entry\": %.2f, "
+               "\"hits\": %zu, \"entries\": %zu",
+               separator, impls[i].name, r.build, r.op, r.bytes,
+               r.hits, r.n);
+        if (c.perf) { // per operation, null where unavailable
+            printf(",\n     \"perf\": {");
+            for (int j = 0; j < bench_counters; j++) {
+                printf("%s\"%s\": ", j > 0 ? ", " : "", counter_names[j]);
+                if (r.counters[j] < 0) {
+                    printf("null");
+                } else {
+                    printf("%.3f", r.counters[j]);
+                }
+            }
+            printf("}");
+        }
+        printf("}");
+        fflush(stdout);
+        separator = ",";
+    }
+    printf("\n  ]\n}\n");
+    free((void*)w.keys);
+    free((void*)w.key);
+    free((void*)w.write);
+    return 0;
+}
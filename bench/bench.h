@@ -0,0 +1,80 @@
+#ifndef bench_h_included
+#define bench_h_included
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+enum bench_dist {
+    bench_uniform    = 0, // random present keys
+    bench_zipf       = 1, // skewed: few keys take most accesses
+    bench_sequential = 2  // dense keys 1..n accessed in order
+};
+
+// hardware counters of --perf, reported per timed operation:
+
+enum bench_counter {
+    bench_cycles        = 0,
+    bench_instructions  = 1,
+    bench_llc_misses    = 2,
+    bench_dtlb_misses   = 3,
+    bench_branch_misses = 4,
+    bench_counters      = 5
+};
+
+struct bench_config {
+    size_t   n;     // entries put before the timed operations
+    size_t   ops;   // timed operations
+    size_t   kb;    // key bytes: 4 or 8
+    size_t   vb;    // value bytes: 4, 8 or 16
+    size_t   load;  // max load percent of kvm() and map()
+    size_t   hit;   // percent of operations on present keys
+    size_t   write; // percent of operations that are puts
+    int      dist;  // enum bench_dist
+    double   zipf;  // Zipf exponent (theta)
+    uint64_t seed;
+    bool     perf;  // count hardware events of the timed operations
+};
+
+struct bench_workload {
+    const uint64_t* keys;  // n keys put before the timed operations
+    const uint64_t* key;   // key of each operation
+    const uint8_t*  write; // 1 put, 0 get for each operation
+};
+
+struct bench_result {
+    double build; // nanoseconds per put of the n keys
+    double op;    // nanoseconds per timed operation
+    double bytes; // bytes allocated per entry after the operations
+    size_t hits;  // gets that found their key
+    size_t n;     // entries after the operations
+    double counters[bench_counters]; // per timed operation, < 0 unavailable
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint64_t bench_nanoseconds(void);
+
+// bracket the timed operations of every runner, no-ops without --perf:
+
+void bench_perf_start(const struct bench_config* c);
+
+void bench_perf_stop(const struct bench_config* c, struct bench_result* r);
+
+// std::unordered_map and sorted std::vector baselines (bench_std.cpp):
+
+bool bench_std_unordered(const struct bench_config* c,
+                         const struct bench_workload* w,
+                         struct bench_result* r);
+
+bool bench_std_sorted(const struct bench_config* c,
+                      const struct bench_workload* w,
+                      struct bench_result* r);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // bench_h_included
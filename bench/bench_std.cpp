@@ -0,0 +1,129 @@
+#include "bench.h"
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+// counts bytes held by the container (not malloc() overhead)
+
+static size_t allocated;
+
+template <class T> struct counting {
+    typedef T value_type;
+    counting() = default;
+    template <class U> counting(const counting<U>&) {}
+    T* allocate(size_t n) {
+        allocated += n * sizeof(T);
+        return std::allocator<T>().allocate(n);
+    }
+    void deallocate(T* p, size_t n) {
+        allocated -= n * sizeof(T);
+        std::allocator<T>().deallocate(p, n);
+    }
+    template <class U> bool operator==(const counting<U>&) const { return true; }
+    template <class U> bool operator!=(const counting<U>&) const { return false; }
+};
+
+template <class K, class V>
+static void run_unordered(const bench_config* c, const bench_workload* w,
+                          bench_result* r) {
+    allocated = 0;
+    {
+        std::unordered_map<K, V, std::hash<K>, std::equal_to<K>,
+                           counting<std::pair<const K, V>>> m;
+        m.max_load_factor(c->load / 100.0f);
+        uint64_t t = bench_nanoseconds();
+        for (size_t i = 0; i < c->n; i++) { m[(K)w->keys[i]] = (V)i; }
+        r->build = (double)(bench_nanoseconds() - t) / (double)c->n;
+        size_t hits = 0;
+        bench_perf_start(c);
+        t = bench_nanoseconds();
+        for (size_t i = 0; i < c->ops; i++) {
+            const K key = (K)w->key[i];
+            if (w->write[i]) {
+                m[key] = (V)i;
+            } else {
+                hits += m.find(key) != m.end();
+            }
+        }
+        r->op = (double)(bench_nanoseconds() - t) / (double)c->ops;
+        bench_perf_stop(c, r);
+        r->hits = hits;
+        r->n = m.size();
+        r->bytes = (double)allocated / (double)m.size();
+    }
+}
+
+template <class K, class V>
+static void run_sorted(const bench_config* c, const bench_workload* w,
+                       bench_result* r) {
+    // binary search over a sorted array, inserts shift the tail
+    allocated = 0;
+    {
+        std::vector<std::pair<K, V>, counting<std::pair<K, V>>> a;
+        const auto less = [](const std::pair<K, V>& e, K k) {
+            return e.first < k;
+        };
+        const auto put = [&](K key, V val) {
+            auto i = std::lower_bound(a.begin(), a.end(), key, less);
+            if (i != a.end() && i->first == key) {
+                i->second = val;
+            } else {
+                a.insert(i, std::pair<K, V>(key, val));
+            }
+        };
+        uint64_t t = bench_nanoseconds();
+        a.reserve(c->n); // bulk load: append and sort once
+        for (size_t i = 0; i < c->n; i++) {
+            a.push_back(std::pair<K, V>((K)w->keys[i], (V)i));
+        }
+        std::sort(a.begin(), a.end(), [](const std::pair<K, V>& x,
+                                         const std::pair<K, V>& y) {
+            return x.first < y.first;
+        });
+        r->build = (double)(bench_nanoseconds() - t) / (double)c->n;
+        size_t hits = 0;
+        bench_perf_start(c);
+        t = bench_nanoseconds();
+        for (size_t i = 0; i < c->ops; i++) {
+            const K key = (K)w->key[i];
+            if (w->write[i]) {
+                put(key, (V)i);
+            } else {
+                auto j = std::lower_bound(a.begin(), a.end(), key, less);
+                hits += j != a.end() && j->first == key;
+            }
+        }
+        r->op = (double)(bench_nanoseconds() - t) / (double)c->ops;
+        bench_perf_stop(c, r);
+        r->hits = hits;
+        r->n = a.size();
+        r->bytes = (double)allocated / (double)a.size();
+    }
+}
+
+typedef unsigned __int128 uint128_t;
+
+#define dispatch(run) do {                                              \
+    if (c->kb == 4 && c->vb == 4)  { run<uint32_t, uint32_t>(c, w, r);  } \
+    if (c->kb == 4 && c->vb == 8)  { run<uint32_t, uint64_t>(c, w, r);  } \
+    if (c->kb == 4 && c->vb == 16) { run<uint32_t, uint128_t>(c, w, r); } \
+    if (c->kb == 8 && c->vb == 4)  { run<uint64_t, uint32_t>(c, w, r);  } \
+    if (c->kb == 8 && c->vb == 8)  { run<uint64_t, uint64_t>(c, w, r);  } \
+    if (c->kb == 8 && c->vb == 16) { run<uint64_t, uint128_t>(c, w, r); } \
+} while (0)
+
+extern "C" {
+
+bool bench_std_unordered(const bench_config* c, const bench_workload* w,
+                         bench_result* r) {
+    dispatch(run_unordered);
+    return true;
+}
+
+bool bench_std_sorted(const bench_config* c, const bench_workload* w,
+                      bench_result* r) {
+    dispatch(run_sorted);
+    return true;
+}
+
+} // extern "C"
@@ -0,0 +1,155 @@
+﻿#define UNSTD_NO_RT_IMPLEMENTATION
+#include "rt/ustd.h"
+#include "cmap.h"
+
+static uint64_t seed = 1;
+
+static int test0(void) {
+    cmap(int, double, 16) m;
+    cmap_alloc(&m);
+    cmap_put(&m, 42, 3.1415);
+    double* p = cmap_get(&m, 42);
+    printf("m[42]: %f\n", *p);
+    bool deleted = cmap_delete(&m, 42);
+    printf("deleted: %d\n", deleted);
+    swear(!cmap_get(&m, 42));
+    // fixed map reuses holes when dense entries are full:
+    for (int i = 0; i < 16; i++) { swear(cmap_put(&m, i, i * 0.5)); }
+    swear(m.n == 16 && cmap_delete(&m, 7) && cmap_put(&m, 100, 1.0));
+    swear(m.n == 16 && *cmap_get(&m, 100) == 1.0 && !cmap_get(&m, 7));
+    cmap_free(&m);
+    return 0;
+}
+
+static int test1(void) {
+    const char* k[] = {"one", "two", "three", "four", "five"};
+    const char* v[] = {"1", "2", "3", "4", "5"};
+    cmap(const char*, const char*, map_heap, map_strdup) m;
+    cmap_alloc(&m, 4);
+    for (size_t i = 0; i < countof(k); i++) {
+        cmap_put(&m, k[i], v[i]);
+        swear(*cmap_get(&m, k[i]) != v[i]); // duplicated
+        swear(strcmp(*cmap_get(&m, k[i]), v[i]) == 0);
+    }
+    swear(cmap_delete(&m, "two"));
+    swear(cmap_delete(&m, "four"));
+    cmap_put(&m, "two", "2");
+    cmap_put(&m, "one", "I"); // replace keeps insertion position
+    const char* order[] = {"one", "three", "five", "two"};
+    size_t j = 0;
+    struct cmap_iterator iterator = cmap_iterator(&m);
+    while (cmap_has_next(&iterator)) {
+        const char* val = 0;
+        const char* key = *cmap_next_entry(&m, &iterator, &val);
+        printf("\"%s\": \"%s\"\n", key, val);
+        swear(strcmp(key, order[j++]) == 0);
+    }
+    swear(j == countof(order) && m.n == countof(order));
+    cmap_clear(&m);
+    cmap_put(&m, null, "Hello");
+    cmap_put(&m, "Hello", null);
+    swear(strcmp(*cmap_get(&m, null), "Hello") == 0);
+    swear(*cmap_get(&m, "Hello") == null);
+    cmap_free(&m);
+    return 0;
+}
+
+static int test2(void) {
+    enum { n = 256 };
+    static double a[n];
+    static double b[n];
+    for (size_t i = 0; i < n; i++) {
+        a[i] = rand64(&seed);
+        b[i] = nan("");
+    }
+    cmap(size_t, double) m;
+    cmap_alloc(&m, 4);
+    for (int k = 0; k < n * 64; k++) {
+        size_t i = (size_t)(rand64(&seed) * n);
+        if (rand64(&seed) < 0.5) {
+            cmap_put(&m, i, a[i]);
+            b[i] = a[i];
+        } else {
+            bool deleted = cmap_delete(&m, i);
+            swear(deleted == !isnan(b[i]));
+            b[i] = nan("");
+        }
+        size_t count = 0;
+        for (size_t j = 0; j < n; j++) {
+            double* q = cmap_get(&m, j);
+            swear(isnan(b[j]) ? q == null : *q == b[j]);
+            count += !isnan(b[j]);
+        }
+        swear(count == m.n);
+    }
+    cmap_free(&m);
+    return 0;
+}
+
+static void shuffle(size_t index[], size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        swap(index[i], index[(size_t)(rand64(&seed) * n)]);
+    }
+}
+
+static int test3(void) {
+    enum { n = 2 * 1024 * 1024 };
+    static size_t index[n];
+    static uint64_t k[n];
+    static uint64_t v[n];
+    static cmap(uint64_t, uint64_t) m; // heap allocated growing map
+    cmap_alloc(&m, 16);
+    printf("cmap_heap(uint64_t, uint64_t)\n");
+    for (size_t i = 0; i < n; i++) {
+        index[i] = i;
+        k[i] = random64(&seed);
+        v[i] = random64(&seed);
+    }
+    shuffle(index, n);
+    uint64_t t = nanoseconds();
+    for (size_t i = 0; i < n; i++) {
+        cmap_put(&m, k[index[i]], v[index[i]]);
+    }
+    t = nanoseconds() - t;
+    printf("cmap_put    : %.3f" "\xCE\xBC" "s\n", (t * 1e-3) / (double)n);
+    const size_t bytes = m.a * (sizeof(k[0]) + sizeof(v[0]) + sizeof(m.ph[0])) +
+                         (m.a + 63) / 64 * 8 + _cmap_slots(m.a) * 4;
+    printf("cmap bytes per entry: %.1f\n", bytes / (double)n);
+    shuffle(index, n);
+    t = nanoseconds();
+    for (size_t i = 0; i < n; i++) {
+        uint64_t* r = cmap_get(&m, k[index[i]]);
+        swear(*r == v[index[i]]);
+    }
+    t = nanoseconds() - t;
+    printf("cmap_get    : %.3f" "\xCE\xBC" "s\n", (t * 1e-3) / (double)n);
+    t = nanoseconds();
+    uint64_t sum = 0;
+    struct cmap_iterator iterator = cmap_iterator(&m);
+    while (cmap_has_next(&iterator)) {
+        uint64_t val = 0;
+        sum += *cmap_next_entry(&m, &iterator, &val) + val;
+    }
+    t = nanoseconds() - t;
+    printf("cmap_next   : %.3f" "\xCE\xBC" "s\n", (t * 1e-3) / (double)n);
+    swear(sum != 0);
+    shuffle(index, n);
+    t = nanoseconds();
+    for (size_t i = 0; i < n; i++) {
+        bool deleted = cmap_delete(&m, k[index[i]]);
+        swear(deleted);
+    }
+    t = nanoseconds() - t;
+    printf("cmap_delete : %.3f" "\xCE\xBC" "s\n", (t * 1e-3) / (double)n);
+    cmap_free(&m);
+    printf("time in " "\xCE\xBC" "s microseconds\n");
+    return 0;
+}
+
+int cmap_tests(void) {
+    cmap_fatalist = true;
+    return test0() || test1() || test2() || test3();
+}
+
+#define cmap_implementation
+#include "cmap.h" // implement cmap
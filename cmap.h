@@ -0,0 +1,618 @@
+#ifndef cmap_h_included
+#define cmap_h_included
+/*
+    # Usage:
+
+    cmap() is a compact insertion ordered map. It takes the same key, value
+    and tag arguments as map() but stores entries densely in insertion order
+    and keeps only 32-bit entry indices in the hash table (like CPython
+    compact dict). Iteration is a sequential scan of the entries,
+    grow copies the dense entries and rebuilds the small index only.
+
+    Keys are compared as integers or as zero terminated strings for
+    const char* keys. Hashes are the same as map_hash_key().
+
+    Memory per entry: sizeof(tk) + sizeof(tv) + 8 bytes of cached hash
+    + 1 bit of liveness + 4 bytes of index per 3/4 of a slot.
+
+    cmap_fatalist = true; // errors will raise SIGABRT before returning false
+
+    cmap(const char*, const char*, map_heap, map_strdup) m;
+    cmap_alloc(&m, 4); // initial capacity of 4 entries on the heap
+    cmap_put(&m, "hello", "world");
+    cmap_put(&m, "good bye", "universe");
+    const char* *v = cmap_get(&m, "hello");
+    cmap_delete(&m, "hello");
+    struct cmap_iterator iterator = cmap_iterator(&m);
+    while (cmap_has_next(&iterator)) {
+        const char* val = 0;
+        const char* key = *cmap_next_entry(&m, &iterator, &val);
+        printf("\"%s\": \"%s\"\n", key, val);
+    }
+    cmap_free(&m);
+
+    cmap(int, double, 16) f; // fixed size map of 16 entries
+    cmap_alloc(&f);
+
+    Deleted entries leave holes in the dense arrays. Holes are squeezed
+    out in place when the entries array is full (or on grow).
+    Deleting entries does not change iteration order of the rest.
+*/
+
+#include "map.h" // enum map_tag
+
+#if defined(_MSC_VER)
+#include <intrin.h> // _BitScanForward64
+#endif
+
+bool cmap_fatalist; // any of cmap errors are fatal
+
+struct cmap_iterator {
+    size_t   next; /* index of next live entry */
+    void*    m;    /* map */
+    uint64_t mc;   /* modification count */
+};
+
+// number of index slots for `n` entries keeps index load <= 75%
+#define _cmap_slots(n) ((n) + (n) / 3 + 1)
+
+#define cmap_struct(tk, tv, _n_, _tags_)                         \
+    struct {                                                     \
+        uint64_t  tag;                                           \
+        uint8_t*  pk;  /* dense keys in insertion order */       \
+        uint8_t*  pv;  /* dense values */                        \
+        uint64_t* ph;  /* dense cached hashes */                 \
+        uint64_t* lm;  /* live entries bitmap */                 \
+        uint32_t* ix;  /* sparse index: entry + 1 or 0 if empty */ \
+        size_t n;  /* number of live entries */                  \
+        size_t u;  /* number of used entries including holes */  \
+        size_t a;  /* allocated capacity in entries */           \
+        uint64_t mc;  /* modification count */                   \
+        union {                                                  \
+            uint64_t tags_aligned;                               \
+            uint8_t  tags[(_tags_) + 1];                         \
+        };                                                       \
+        /* fixed map: */                                         \
+        uint32_t index[_cmap_slots(_n_ + (_n_ == 0))];           \
+        uint64_t live[(_n_ + 63) / 64 + 1];                      \
+        uint64_t hash[(_n_ + (_n_ == 0))];                       \
+        tv v[(_n_ + (_n_ == 0))];                                \
+        tk k[(_n_ + (_n_ == 0))];                                \
+    }
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool _cmap_init(void* mv, size_t tag, size_t kb, size_t vb, size_t n,
+                void* k, void* v, void* h, void* live, void* index, size_t c);
+
+const void* _cmap_get(const void* mv, const size_t c,
+                      const size_t kb, const size_t vb,
+                      const void* pkey, const int kind);
+
+bool _cmap_put(void* mv, const size_t c, const size_t kb, const size_t vb,
+               const void* pkey, const void* pval, const int kind);
+
+bool _cmap_delete(void* mv, const size_t c, const size_t kb, const size_t vb,
+                  const void* pkey, const int kind);
+
+struct cmap_iterator cmap_iterator(void* mv);
+
+bool cmap_has_next(struct cmap_iterator* iterator);
+
+void* _cmap_next(struct cmap_iterator* iterator, size_t kb, size_t vb,
+                 void* pval);
+
+void _cmap_clear(void* mv, size_t c, size_t kb, size_t vb);
+
+void _cmap_free(void* mv, size_t c, size_t kb, size_t vb);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#define _cmap_2_arg(tk, tv)           cmap_struct(tk, tv, 0, 0)
+#define _cmap_3_arg(tk, tv, n)        cmap_struct(tk, tv, n, 0)
+#define _cmap_4_arg(tk, tv, n, tags)  cmap_struct(tk, tv, n, tags)
+#define _cmap_get_5th_arg(arg1, arg2, arg3, arg4, arg5, ...) arg5
+#define _cmap_chooser(...) _cmap_get_5th_arg(__VA_ARGS__, \
+                           _cmap_4_arg, _cmap_3_arg, _cmap_2_arg, )
+#define cmap(...) _cmap_chooser(__VA_ARGS__)(__VA_ARGS__)
+
+#define _cmap_tk(m) typeof((m)->k[0]) // type of key
+#define _cmap_tv(m) typeof((m)->v[0]) // type of val
+
+#define _cmap_ka(m, key) (&(_cmap_tk(m)){(key)}) // key address
+#define _cmap_va(m, val) (&(_cmap_tv(m)){(val)}) // val address
+
+#define _cmap_kb(m) sizeof((m)->k[0]) // number of bytes in key
+#define _cmap_vb(m) sizeof((m)->v[0]) // number of bytes in val
+
+#define _cmap_fixed_c(m) (sizeof((m)->k) / _cmap_kb(m))
+
+#define cmap_capacity(m) ((m)->a > 0 ? (m)->a : _cmap_fixed_c(m))
+
+// compile time key kind: 1 zero terminated strings, 0 integers
+#define _cmap_kind(m) _Generic(((m)->k[0]), const char*: 1, default: 0)
+
+#define cmap_init(m, n)                                                   \
+    _cmap_init(m, sizeof((m)->tags) - 1, _cmap_kb(m), _cmap_vb(m), n,     \
+               &(m)->k, &(m)->v, &(m)->hash, &(m)->live, &(m)->index,     \
+               _cmap_fixed_c(m))
+
+#define _cmap_init_1_arg(m)    cmap_init(m, 0)
+#define _cmap_init_2_arg(m, n) cmap_init(m, n)
+#define _cmap_get_3rd_arg(arg1, arg2, arg3, ...) arg3
+#define _cmap_init_chooser(...) _cmap_get_3rd_arg(__VA_ARGS__, \
+                                _cmap_init_2_arg, _cmap_init_1_arg, )
+#define cmap_alloc(...) _cmap_init_chooser(__VA_ARGS__)(__VA_ARGS__)
+
+#define cmap_clear(m) _cmap_clear(m, _cmap_fixed_c(m), _cmap_kb(m), _cmap_vb(m))
+#define cmap_free(m)  _cmap_free(m,  _cmap_fixed_c(m), _cmap_kb(m), _cmap_vb(m))
+
+#define cmap_put(m, key, val) _cmap_put(m, cmap_capacity(m), _cmap_kb(m), \
+    _cmap_vb(m), _cmap_ka(m, key), _cmap_va(m, val), _cmap_kind(m))
+
+#define cmap_get(m, key) (_cmap_tv(m)*)_cmap_get(m, cmap_capacity(m),     \
+    _cmap_kb(m), _cmap_vb(m), _cmap_ka(m, key), _cmap_kind(m))
+
+#define cmap_delete(m, key) _cmap_delete(m, cmap_capacity(m),             \
+    _cmap_kb(m), _cmap_vb(m), _cmap_ka(m, key), _cmap_kind(m))
+
+#define cmap_next(m, iterator) \
+        (_cmap_tk(m)*)_cmap_next(iterator, _cmap_kb(m), _cmap_vb(m), 0)
+
+#define cmap_next_entry(m, iterator, pv) \
+        (_cmap_tk(m)*)_cmap_next(iterator, _cmap_kb(m), _cmap_vb(m), pv)
+
+#endif // cmap_h_included
+
+#if defined(cmap_implementation) && !defined(cmap_implemented)
+
+#define cmap_implemented
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define _cmap_fatal_return_zero(...) do { \
+    if (cmap_fatalist) {                  \
+        fprintf(stderr, "" __VA_ARGS__);  \
+        raise(SIGABRT);                   \
+    }                                     \
+    return 0; /* false of (void*)0 */     \
+} while (0)
+
+#define _cmap_oom "out of memory\n"
+
+typedef cmap(void*, void*) cmap_t;
+
+enum { _cmap_kind_int = 0, _cmap_kind_str = 1 };
+
+#if defined(_MSC_VER)
+#define _cmap_inline __forceinline
+#else
+#define _cmap_inline inline __attribute__((always_inline))
+#endif
+
+static inline size_t _cmap_ctz64(uint64_t w) {
+    #if defined(_MSC_VER)
+        unsigned long i; _BitScanForward64(&i, w); return i;
+    #else
+        return (size_t)__builtin_ctzll(w);
+    #endif
+}
+
+#define _cmap_bm_incl(bm, i) do { bm[i / 64] |=  (1uLL << (i % 64)); } while (0)
+#define _cmap_bm_excl(bm, i) do { bm[i / 64] &= ~(1uLL << (i % 64)); } while (0)
+#define _cmap_is_live(m, i) (((m)->lm[(i) / 64] & (1uLL << ((i) % 64))) != 0)
+
+static inline uint64_t _cmap_key(const uint8_t* pkey, const size_t kb) {
+    // if compiler propagates constant values of kb to this point
+    // it can eliminate sequential ifs and expensive memcpy call
+    if (kb == 1) { return *pkey; }
+    if (kb == 2) { return *(uint16_t*)pkey; }
+    if (kb == 4) { return *(uint32_t*)pkey; }
+    if (kb == 8) { return *(uint64_t*)pkey; }
+    uint64_t key = 0; memcpy(&key, pkey, kb); return key;
+}
+
+static inline uint64_t _cmap_key_at(const uint8_t* k, const size_t kb,
+                                    const size_t i) {
+    return _cmap_key(k + i * kb, kb);
+}
+
+static inline void _cmap_set_at(uint8_t* d, const size_t i,
+                                const uint8_t* s, const size_t b) {
+    if (b == 1) { d[i] = *s; return; }
+    if (b == 2) { *(uint16_t*)(d + i * b) = *(uint16_t*)s; return; }
+    if (b == 4) { *(uint32_t*)(d + i * b) = *(uint32_t*)s; return; }
+    if (b == 8) { *(uint64_t*)(d + i * b) = *(uint64_t*)s; return; }
+    memcpy(d + i * b, s, b);
+}
+
+static inline uint64_t _cmap_hash_int(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0XFF51AFD7ED558CCDuLL;
+    key ^= key >> 33;
+    key *= 0XC4CEB9FE1A85EC53uLL;
+    key ^= key >> 33;
+    return key;
+}
+
+static inline uint64_t _cmap_hash_str(uint64_t key) {
+    const char* s =(const char*)(uintptr_t)key;
+    uint64_t h = 0xcbf29ce484222325uLL; // FNV-1a 64-bit offset basis
+    if (s) { // null keys are allowed
+        while (*s) {
+            h ^= (uint8_t)(*s++);
+            h *= 0x100000001b3uLL; // FNV-1a 64-bit prime
+        }
+    }
+    return h;
+}
+
+static _cmap_inline uint64_t _cmap_hash(const int kind, uint64_t key) {
+    return kind == _cmap_kind_str ? _cmap_hash_str(key) : _cmap_hash_int(key);
+}
+
+static _cmap_inline bool _cmap_equal(const int kind,
+                                     const uint64_t k0, const uint64_t k1) {
+    if (kind == _cmap_kind_str) {
+        return k0 == k1 || (k0 != 0 && k1 != 0 &&
+               strcmp((const char*)(uintptr_t)k0,
+                      (const char*)(uintptr_t)k1) == 0);
+    } else {
+        return k0 == k1;
+    }
+}
+
+#define _cmap_undup_key(m, i, kb) do {          \
+    if (m->tag & map_keydup) {                  \
+        void** pki = (void**)(m->pk + i * kb);  \
+        free(*pki); *pki = 0;                   \
+    }                                           \
+} while (0)
+
+#define _cmap_undup_val(m, i, vb) do {          \
+    if (m->tag & map_valdup) {                  \
+        void** pvi = (void**)(m->pv + i * vb);  \
+        free(*pvi); *pvi = 0;                   \
+    }                                           \
+} while (0)
+
+static void _cmap_set_pointers(cmap_t* m, void* pk, void* pv, void* ph,
+                               void* lm, void* ix) {
+    free(m->pk); m->pk = pk;
+    free(m->pv); m->pv = pv;
+    free(m->ph); m->ph = ph;
+    free(m->lm); m->lm = lm;
+    free(m->ix); m->ix = ix;
+}
+
+static bool _cmap_alloc(cmap_t* m, size_t kb, size_t vb, size_t n, size_t tag) {
+    if (n >= 4 && n < UINT32_MAX) {
+        m->pk = malloc(n * kb);
+        m->pv = malloc(n * vb);
+        m->ph = malloc(n * sizeof(uint64_t));
+        m->lm = calloc((n + 63) / 64, sizeof(uint64_t)); // zero init
+        m->ix = calloc(_cmap_slots(n), sizeof(uint32_t)); // zero init
+        if (!m->pk || !m->pv || !m->ph || !m->lm || !m->ix) {
+            free(m->pk); free(m->pv); free(m->ph); free(m->lm); free(m->ix);
+            _cmap_fatal_return_zero(_cmap_oom);
+        }
+        m->tag = tag;
+        m->a   = n;
+        m->n   = 0;
+        m->u   = 0;
+        m->mc  = 0;
+        return true;
+    } else { // invalid usage
+        _cmap_fatal_return_zero("invalid argument n: %zd minimum 4\n", n);
+    }
+}
+
+bool _cmap_init(void* mv, size_t tag, size_t kb, size_t vb, size_t n,
+                void* k, void* v, void* h, void* live, void* index, size_t c) {
+    cmap_t* m = mv;
+    if (c == 1) {
+        return _cmap_alloc(m, kb, vb, n, tag);
+    } else if (n != 0) {
+        _cmap_fatal_return_zero("invalid argument n: %zd\n", n);
+    } else {
+        memset(index, 0, _cmap_slots(c) * sizeof(uint32_t));
+        memset(live, 0, ((c + 63) / 64) * sizeof(uint64_t));
+        m->tag = tag;
+        m->a   = 0;
+        m->n   = 0;
+        m->u   = 0;
+        m->mc  = 0;
+        m->pk  = k;
+        m->pv  = v;
+        m->ph  = h;
+        m->lm  = live;
+        m->ix  = index;
+        return true;
+    }
+}
+
+static void _cmap_reindex(cmap_t* m, const size_t c) {
+    // rebuilds sparse index from cached hashes of all entries [0..u)
+    const size_t s = _cmap_slots(c);
+    memset(m->ix, 0, s * sizeof(uint32_t));
+    for (size_t e = 0; e < m->u; e++) {
+        size_t i = (size_t)(m->ph[e] % s);
+        while (m->ix[i] != 0) { i = (i + 1) % s; }
+        m->ix[i] = (uint32_t)(e + 1);
+    }
+}
+
+static size_t _cmap_squeeze(cmap_t* m, uint8_t* pk, uint8_t* pv, uint64_t* ph,
+                            const size_t kb, const size_t vb) {
+    // moves live entries to the front of (possibly new) dense arrays
+    // preserving insertion order, returns number of live entries
+    size_t w = 0;
+    for (size_t r = 0; r < m->u; r++) {
+        if (_cmap_is_live(m, r)) {
+            if (pk != m->pk || r != w) {
+                memcpy(pk + w * kb, m->pk + r * kb, kb);
+                memcpy(pv + w * vb, m->pv + r * vb, vb);
+                ph[w] = m->ph[r];
+            }
+            w++;
+        }
+    }
+    assert(w == m->n);
+    return w;
+}
+
+static void _cmap_compact(cmap_t* m, const size_t c,
+                          const size_t kb, const size_t vb) {
+    m->u = _cmap_squeeze(m, m->pk, m->pv, m->ph, kb, vb);
+    memset(m->lm, 0, ((c + 63) / 64) * sizeof(uint64_t));
+    for (size_t e = 0; e < m->u; e++) { _cmap_bm_incl(m->lm, e); }
+    _cmap_reindex(m, c);
+}
+
+static bool _cmap_grow(cmap_t* m, const size_t kb, const size_t vb) {
+    size_t a = m->a * 3 / 2;
+    if (a >= UINT32_MAX) {
+        _cmap_fatal_return_zero("overflow: %zd\n", m->a);
+    }
+    uint8_t*  pk = malloc(a * kb);
+    uint8_t*  pv = malloc(a * vb);
+    uint64_t* ph = malloc(a * sizeof(uint64_t));
+    uint64_t* lm = calloc((a + 63) / 64, sizeof(uint64_t)); // zero init
+    uint32_t* ix = malloc(_cmap_slots(a) * sizeof(uint32_t));
+    if (!pk || !pv || !ph || !lm || !ix) {
+        free(pk); free(pv); free(ph); free(lm); free(ix);
+        _cmap_fatal_return_zero(_cmap_oom);
+    } else {
+        m->u = _cmap_squeeze(m, pk, pv, ph, kb, vb);
+        for (size_t e = 0; e < m->u; e++) { _cmap_bm_incl(lm, e); }
+        _cmap_set_pointers(m, pk, pv, ph, lm, ix);
+        m->a = a;
+        _cmap_reindex(m, a);
+        return true;
+    }
+}
+
+static _cmap_inline size_t _cmap_find(const cmap_t* m, const size_t c,
+        const size_t kb, const uint64_t key, const uint64_t hash,
+        const int kind) {
+    // returns index slot with the key or an empty slot
+    const size_t s = _cmap_slots(c);
+    size_t i = (size_t)(hash % s);
+    for (;;) {
+        const uint32_t x = m->ix[i];
+        if (x == 0) { return i; }
+        const size_t e = x - 1;
+        if (kind == _cmap_kind_str) { // cached hash avoids most strcmp()
+            if (m->ph[e] == hash &&
+                _cmap_equal(kind, _cmap_key_at(m->pk, kb, e), key)) {
+                return i;
+            }
+        } else if (_cmap_key_at(m->pk, kb, e) == key) {
+            return i;
+        }
+        i = (i + 1) % s; // index is never full
+    }
+}
+
+const void* _cmap_get(const void* mv, const size_t c,
+                      const size_t kb, const size_t vb,
+                      const void* pkey, const int kind) {
+    const cmap_t* m = mv;
+    const uint64_t key = _cmap_key(pkey, kb);
+    size_t i;
+    if (kind == _cmap_kind_str) {
+        i = _cmap_find(m, c, kb, key, _cmap_hash_str(key), _cmap_kind_str);
+    } else {
+        i = _cmap_find(m, c, kb, key, _cmap_hash_int(key), _cmap_kind_int);
+    }
+    const uint32_t x = m->ix[i];
+    return x == 0 ? 0 : m->pv + (x - 1) * vb;
+}
+
+static _cmap_inline bool _cmap_insert(cmap_t* m, size_t c,
+        const size_t kb, const size_t vb,
+        const void* pkey, const void* pval, const int kind) {
+    uint64_t key = _cmap_key(pkey, kb);
+    const uint64_t hash = _cmap_hash(kind, key);
+    size_t i = _cmap_find(m, c, kb, key, hash, kind);
+    if (m->ix[i] == 0 && m->u == c) { // dense entries are full
+        if (m->n < m->u && (m->a == 0 || m->u - m->n >= c / 4)) {
+            _cmap_compact(m, c, kb, vb);
+        } else if (m->a == 0) {
+            _cmap_fatal_return_zero("map is full\n");
+        } else {
+            if (!_cmap_grow(m, kb, vb)) { return false; }
+            c = m->a;
+        }
+        i = _cmap_find(m, c, kb, key, hash, kind);
+    }
+    void* key_dup = 0;
+    if (m->tag & map_keydup) {
+        if (*(void**)pkey) {
+            key_dup = strdup(*(const char**)pkey);
+            if (!key_dup) { _cmap_fatal_return_zero(_cmap_oom); }
+        }
+        pkey = &key_dup;
+    }
+    void* val_dup = 0;
+    if (m->tag & map_valdup) {
+        if (*(void**)pval) {
+            val_dup = strdup(*(const char**)pval);
+            if (!val_dup) { free(key_dup); _cmap_fatal_return_zero(_cmap_oom); }
+        }
+        pval = &val_dup;
+    }
+    const uint32_t x = m->ix[i];
+    if (x != 0) {
+        const size_t e = x - 1;
+        _cmap_undup_key(m, e, kb);
+        _cmap_undup_val(m, e, vb);
+        _cmap_set_at(m->pk, e, pkey, kb);
+        _cmap_set_at(m->pv, e, pval, vb);
+        // m->mc is not incremented because key set is not changed
+    } else {
+        const size_t e = m->u++;
+        _cmap_set_at(m->pk, e, pkey, kb);
+        _cmap_set_at(m->pv, e, pval, vb);
+        m->ph[e] = hash;
+        _cmap_bm_incl(m->lm, e);
+        m->ix[i] = (uint32_t)(e + 1);
+        m->n++;
+        m->mc++;
+    }
+    return true;
+}
+
+bool _cmap_put(void* mv, const size_t c, const size_t kb, const size_t vb,
+               const void* pkey, const void* pval, const int kind) {
+    cmap_t* m = mv;
+    if (kind == _cmap_kind_str) {
+        return _cmap_insert(m, c, kb, vb, pkey, pval, _cmap_kind_str);
+    } else {
+        return _cmap_insert(m, c, kb, vb, pkey, pval, _cmap_kind_int);
+    }
+}
+
+static _cmap_inline bool _cmap_remove(cmap_t* m, const size_t c,
+        const size_t kb, const size_t vb, const void* pkey, const int kind) {
+    const uint64_t key = _cmap_key(pkey, kb);
+    size_t i = _cmap_find(m, c, kb, key, _cmap_hash(kind, key), kind);
+    if (m->ix[i] == 0) { return false; }
+    const size_t e = m->ix[i] - 1;
+    _cmap_undup_key(m, e, kb);
+    _cmap_undup_val(m, e, vb);
+    _cmap_bm_excl(m->lm, e);
+    if (e == m->u - 1) { m->u--; } // trailing hole is reused right away
+    // backward shift deletion in the sparse index only:
+    const size_t s = _cmap_slots(c);
+    m->ix[i] = 0;
+    size_t x = i;
+    for (;;) {
+        x = (x + 1) % s;
+        if (m->ix[x] == 0) { break; }
+        const size_t h = (size_t)(m->ph[m->ix[x] - 1] % s);
+        const bool can_move = i <= x ? x < h || h <= i :
+                                       x < h && h <= i;
+        if (can_move) {
+            m->ix[i] = m->ix[x];
+            m->ix[x] = 0;
+            i = x;
+        }
+    }
+    m->n--;
+    m->mc++;
+    return true;
+}
+
+bool _cmap_delete(void* mv, const size_t c, const size_t kb, const size_t vb,
+                  const void* pkey, const int kind) {
+    cmap_t* m = mv;
+    if (kind == _cmap_kind_str) {
+        return _cmap_remove(m, c, kb, vb, pkey, _cmap_kind_str);
+    } else {
+        return _cmap_remove(m, c, kb, vb, pkey, _cmap_kind_int);
+    }
+}
+
+static size_t _cmap_next_live(const cmap_t* m, size_t i) {
+    // skips holes a 64-bit word of the live bitmap at a time
+    while (i < m->u) {
+        const uint64_t w = m->lm[i / 64] >> (i % 64);
+        if (w != 0) {
+            i += _cmap_ctz64(w);
+            return i < m->u ? i : m->u;
+        }
+        i = (i / 64 + 1) * 64;
+    }
+    return m->u;
+}
+
+struct cmap_iterator cmap_iterator(void* mv) {
+    cmap_t* m = mv;
+    struct cmap_iterator iterator = {
+        .next = _cmap_next_live(m, 0), .m = mv, .mc = m->mc
+    };
+    return iterator;
+}
+
+bool cmap_has_next(struct cmap_iterator* iterator) {
+    cmap_t* m = iterator->m;
+    if (m->mc != iterator->mc) {
+        _cmap_fatal_return_zero("map modified during iteration\n");
+    }
+    return iterator->next < m->u;
+}
+
+void* _cmap_next(struct cmap_iterator* iterator, size_t kb, size_t vb,
+                 void* pval) {
+    cmap_t* m = iterator->m;
+    if (m->mc != iterator->mc) {
+        _cmap_fatal_return_zero("map modified during iteration\n");
+    } else if (iterator->next < m->u) {
+        const size_t e = iterator->next;
+        iterator->next = _cmap_next_live(m, e + 1);
+        if (pval) { memcpy(pval, m->pv + e * vb, vb); }
+        return m->pk + e * kb;
+    } else {
+        return 0;
+    }
+}
+
+void _cmap_clear(void* mv, size_t c, size_t kb, size_t vb) {
+    cmap_t* m = mv;
+    const size_t capacity = m->a > 0 ? m->a : c;
+    if (m->tag & (map_keydup | map_valdup)) {
+        for (size_t e = 0; e < m->u; e++) {
+            if (_cmap_is_live(m, e)) {
+                _cmap_undup_key(m, e, kb);
+                _cmap_undup_val(m, e, vb);
+            }
+        }
+    }
+    m->n = 0;
+    m->u = 0;
+    m->mc++;
+    memset(m->lm, 0, ((capacity + 63) / 64) * sizeof(uint64_t));
+    memset(m->ix, 0, _cmap_slots(capacity) * sizeof(uint32_t));
+}
+
+void _cmap_free(void* mv, size_t c, size_t kb, size_t vb) {
+    _cmap_clear(mv, c, kb, vb);
+    cmap_t* m = mv;
+    if (c == 1 && m->a != 0) {
+        _cmap_set_pointers(m, 0, 0, 0, 0, 0);
+        m->a = 0;
+    }
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // cmap_implementation
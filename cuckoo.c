@@ -0,0 +1,123 @@
+﻿#define UNSTD_NO_RT_IMPLEMENTATION
+#include "rt/ustd.h"
+#include "cuckoo.h"
+#include "kvm.h" // linear probing for comparison
+
+static uint64_t seed = 1;
+
+extern bool tests_large; // main.cpp --large
+
+static int test0(void) {
+    cuckoo(int, double) m;
+    cuckoo_alloc(&m, 0);
+    cuckoo_put(&m, 42, 3.1415);
+    cuckoo_put(&m, -7, 2.71);
+    double* p = cuckoo_get(&m, 42);
+    printf("m[42]: %f\n", *p);
+    swear(m.n == 2 && *cuckoo_get(&m, -7) == 2.71);
+    cuckoo_put(&m, 42, 1.41); // update in place
+    swear(m.n == 2 && *cuckoo_get(&m, 42) == 1.41);
+    swear(cuckoo_delete(&m, 42) && !cuckoo_delete(&m, 42));
+    swear(cuckoo_get(&m, 42) == null && m.n == 1);
+    cuckoo_clear(&m);
+    swear(m.n == 0 && cuckoo_get(&m, -7) == null);
+    cuckoo_free(&m);
+    return 0;
+}
+
+static int test1(void) {
+    // random puts and deletes against reference through grows,
+    // displacements and stash with 1 byte keys in a full table
+    enum { n = 4000 };
+    static int32_t ref[n]; // 0 absent
+    cuckoo(uint16_t, int32_t) m;
+    cuckoo_alloc(&m, 16);
+    for (int step = 0; step < 400 * 1000; step++) {
+        const uint16_t key = (uint16_t)(random64(&seed) % n);
+        if (random64(&seed) % 4 != 0) {
+            swear(cuckoo_put(&m, key, step + 1));
+            ref[key] = step + 1;
+        } else {
+            swear(cuckoo_delete(&m, key) == (ref[key] != 0));
+            ref[key] = 0;
+        }
+        if (step % 4000 == 0 || step == 400 * 1000 - 1) {
+            size_t count = 0;
+            for (int k = 0; k < n; k++) {
+                const int32_t* v = cuckoo_get(&m, (uint16_t)k);
+                swear(ref[k] != 0 ? v != null && *v == ref[k] : v == null);
+                count += ref[k] != 0;
+            }
+            swear(m.n == count);
+        }
+    }
+    cuckoo_free(&m);
+    cuckoo(uint8_t, uint8_t) b; // 256 keys: every way and the stash
+    cuckoo_alloc(&b, 0);
+    for (int k = 0; k < 256; k++) { swear(cuckoo_put(&b, (uint8_t)k, (uint8_t)~k)); }
+    for (int k = 0; k < 256; k++) { swear(*cuckoo_get(&b, (uint8_t)k) == (uint8_t)~k); }
+    swear(b.n == 256);
+    cuckoo_free(&b);
+    return 0;
+}
+
+static void test2_bench(size_t n) {
+    uint64_t* keys = malloc(n * 2 * sizeof(keys[0])); // hits and misses
+    swear(keys);
+    for (size_t i = 0; i < n * 2; i++) { keys[i] = random64(&seed); }
+    cuckoo(uint64_t, uint64_t) c;
+    kvm(uint64_t, uint64_t) h;
+    cuckoo_alloc(&c, 0);
+    kvm_alloc(&h, 4);
+    double us[2][3];
+    uint64_t t = nanoseconds();
+    for (size_t i = 0; i < n; i++) { cuckoo_put(&c, keys[i], i); }
+    us[0][0] = (nanoseconds() - t) * 1e-3 / n;
+    t = nanoseconds();
+    for (size_t i = 0; i < n; i++) { kvm_put(&h, keys[i], i); }
+    us[1][0] = (nanoseconds() - t) * 1e-3 / n;
+    uint64_t sum[2] = {0};
+    t = nanoseconds();
+    for (size_t i = 0; i < n; i++) { sum[0] += *cuckoo_get(&c, keys[i]); }
+    us[0][1] = (nanoseconds() - t) * 1e-3 / n;
+    t = nanoseconds();
+    for (size_t i = 0; i < n; i++) { sum[1] += *kvm_get(&h, keys[i]); }
+    us[1][1] = (nanoseconds() - t) * 1e-3 / n;
+    swear(sum[0] == sum[1]);
+    size_t found[2] = {0};
+    t = nanoseconds();
+    for (size_t i = n; i < n * 2; i++) { found[0] += cuckoo_get(&c, keys[i]) != null; }
+    us[0][2] = (nanoseconds() - t) * 1e-3 / n;
+    t = nanoseconds();
+    for (size_t i = n; i < n * 2; i++) { found[1] += kvm_get(&h, keys[i]) != null; }
+    us[1][2] = (nanoseconds() - t) * 1e-3 / n;
+    swear(found[0] == found[1]);
+    // bytes per entry: keys, values and occupancy bits
+    const double bc = cuckoo_capacity(&c) * (16 + 1.0 / 8) / n;
+    const double bk = h.a * (16 + 1.0 / 8) / n;
+    printf("%8zd entries put/get/miss cuckoo: %.3f %.3f %.3f "
+           "%.1f bytes %2.0f%% full\n", n, us[0][0], us[0][1], us[0][2],
+           bc, n * 100.0 / cuckoo_capacity(&c));
+    printf("%8zd entries put/get/miss kvm:    %.3f %.3f %.3f "
+           "%.1f bytes %2.0f%% full\n", n, us[1][0], us[1][1], us[1][2],
+           bk, n * 100.0 / h.a);
+    cuckoo_free(&c);
+    kvm_free(&h);
+    free(keys);
+}
+
+static int test2(void) {
+    // sizes right after and right before kvm grows
+    test2_bench(1024 * 1024);
+    test2_bench(1536 * 1024);
+    if (tests_large) { test2_bench(8 * 1024 * 1024); }
+    return 0;
+}
+
+int cuckoo_tests(void) {
+    cuckoo_fatalist = true;
+    return test0() || test1() || test2();
+}
+
+#define cuckoo_implementation
+#include "cuckoo.h" // implement cuckoo
@@ -0,0 +1,458 @@
+#ifndef cuckoo_h_included
+#define cuckoo_h_included
+/*
+    # Usage:
+
+    cuckoo() is a hash map of integer or pointer keys (1, 2, 4 or 8
+    bytes) to values of any type for tables that must stay small. It is
+    bucketized cuckoo hashing: each key lives in one of two buckets of
+    8 ways and a bucket's keys fill at most one 64-byte cache line, so a
+    lookup reads at most two buckets. Tables run above 90% occupancy
+    where kvm() grows at 75%.
+
+    cuckoo_fatalist = true; // errors will raise SIGABRT before returning false
+
+    cuckoo(uint64_t, double) m;
+    cuckoo_alloc(&m, 1024);  // expected number of entries, 0 is fine
+    cuckoo_put(&m, 42, 3.1415);
+    double* v = cuckoo_get(&m, 42); // null if absent
+    cuckoo_delete(&m, 42);
+    printf("map has %zd entries in %zd slots\n", m.n, cuckoo_capacity(&m));
+    cuckoo_free(&m);         // cuckoo_clear(&m) keeps the table
+
+    Value pointers returned by cuckoo_get() are valid until the next put
+    or delete: inserts move other entries between their two buckets.
+
+    Insert places the key in a free way of either bucket. When both are
+    full it searches breadth first (up to 256 buckets) for the shortest
+    chain of entries to move into their other buckets. A failed search
+    puts the entry into a stash of 8 entries checked by lookups only
+    while it is not empty. A full stash grows the table by 1.25x.
+*/
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool cuckoo_fatalist; // any of cuckoo errors are fatal
+
+enum {
+    cuckoo_ways  = 8, // entries per bucket
+    cuckoo_stash = 8  // entries that did not fit into the buckets
+};
+
+#define cuckoo_struct(tk, tv)                                        \
+    struct {                                                         \
+        uint8_t* pk;      /* buckets * ways + stash keys */          \
+        uint8_t* pv;      /* buckets * ways + stash values */        \
+        uint8_t* used;    /* occupied ways bitmask per bucket */     \
+        void*    memory;  /* single allocation holding all above */  \
+        size_t   buckets;                                            \
+        size_t   n;       /* number of entries */                    \
+        size_t   stashed; /* entries in the stash */                 \
+        tk* k; /* key type only, never allocated */                  \
+        tv* v; /* val type only, never allocated */                  \
+    }
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool _cuckoo_alloc(void* mv, size_t kb, size_t vb, size_t n);
+
+bool _cuckoo_put(void* mv, const size_t kb, const size_t vb,
+                 const void* pkey, const void* pval);
+
+const void* _cuckoo_get(const void* mv, const size_t kb, const size_t vb,
+                        const void* pkey);
+
+bool _cuckoo_delete(void* mv, const size_t kb, const size_t vb,
+                    const void* pkey);
+
+void _cuckoo_clear(void* mv);
+
+void _cuckoo_free(void* mv);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#define cuckoo(tk, tv) cuckoo_struct(tk, tv)
+
+#define _cuckoo_tk(m) typeof((m)->k[0]) // type of key
+#define _cuckoo_tv(m) typeof((m)->v[0]) // type of val
+
+#define _cuckoo_ka(m, key) (&(_cuckoo_tk(m)){(key)}) // key address
+#define _cuckoo_va(m, val) (&(_cuckoo_tv(m)){(val)}) // val address
+
+#define _cuckoo_kb(m) sizeof((m)->k[0]) // number of bytes in key
+#define _cuckoo_vb(m) sizeof((m)->v[0]) // number of bytes in val
+
+#define cuckoo_alloc(m, n) _cuckoo_alloc(m, _cuckoo_kb(m), _cuckoo_vb(m), n)
+
+#define cuckoo_put(m, key, val) _cuckoo_put(m, _cuckoo_kb(m),         \
+    _cuckoo_vb(m), _cuckoo_ka(m, key), _cuckoo_va(m, val))
+
+#define cuckoo_get(m, key) (_cuckoo_tv(m)*)_cuckoo_get(m, _cuckoo_kb(m), \
+    _cuckoo_vb(m), _cuckoo_ka(m, key))
+
+#define cuckoo_delete(m, key) _cuckoo_delete(m, _cuckoo_kb(m),        \
+    _cuckoo_vb(m), _cuckoo_ka(m, key))
+
+#define cuckoo_capacity(m) ((m)->buckets * cuckoo_ways)
+
+#define cuckoo_clear(m) _cuckoo_clear(m)
+#define cuckoo_free(m)  _cuckoo_free(m)
+
+#endif // cuckoo_h_included
+
+#if defined(cuckoo_implementation) && !defined(cuckoo_implemented)
+
+#define cuckoo_implemented
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define _cuckoo_fatal_return_zero(...) do { \
+    if (cuckoo_fatalist) {                  \
+        fprintf(stderr, "" __VA_ARGS__);    \
+        raise(SIGABRT);                     \
+    }                                       \
+    return 0; /* false of (void*)0 */       \
+} while (0)
+
+#if defined(__GNUC__) || defined(__clang__)
+#define _cuckoo_prefetch(p) __builtin_prefetch(p)
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#define _cuckoo_prefetch(p) _mm_prefetch((const char*)(p), _MM_HINT_T0)
+#else
+#define _cuckoo_prefetch(p) ((void)(p))
+#endif
+
+typedef cuckoo(void*, void*) cuckoo_t;
+
+enum {
+    _cuckoo_line = 64,  // bytes in a cache line
+    _cuckoo_bfs  = 256  // buckets visited by the displacement search
+};
+
+static const size_t _cuckoo_none = (size_t)-1;
+
+static inline uint64_t _cuckoo_hash64(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0XFF51AFD7ED558CCDuLL;
+    key ^= key >> 33;
+    key *= 0XC4CEB9FE1A85EC53uLL;
+    key ^= key >> 33;
+    return key;
+}
+
+static inline uint64_t _cuckoo_key(const uint8_t* pkey, const size_t kb) {
+    if (kb == 1) { return *pkey; }
+    if (kb == 2) { return *(uint16_t*)pkey; }
+    if (kb == 4) { return *(uint32_t*)pkey; }
+    return *(uint64_t*)pkey;
+}
+
+static inline uint64_t _cuckoo_key_at(const cuckoo_t* m, const size_t kb,
+                                      const size_t i) {
+    return _cuckoo_key(m->pk + i * kb, kb);
+}
+
+static inline void _cuckoo_copy(uint8_t* d, const uint8_t* s, const size_t b) {
+    if (b == 1) { *d = *s; return; }
+    if (b == 2) { *(uint16_t*)d = *(uint16_t*)s; return; }
+    if (b == 4) { *(uint32_t*)d = *(uint32_t*)s; return; }
+    if (b == 8) { *(uint64_t*)d = *(uint64_t*)s; return; }
+    memcpy(d, s, b);
+}
+
+static inline void _cuckoo_move(cuckoo_t* m, const size_t kb, const size_t vb,
+                                const size_t to, const size_t from) {
+    _cuckoo_copy(m->pk + to * kb, m->pk + from * kb, kb);
+    _cuckoo_copy(m->pv + to * vb, m->pv + from * vb, vb);
+}
+
+// Both buckets come from one hash: low and high 32 bits each scaled to
+// [0, buckets) by multiply and shift instead of two divisions.
+
+static inline size_t _cuckoo_first(const uint64_t hash, const size_t buckets) {
+    return (size_t)(((hash & 0xFFFFFFFFu) * buckets) >> 32);
+}
+
+static inline size_t _cuckoo_second(const uint64_t hash, const size_t buckets) {
+    return (size_t)(((hash >> 32) * buckets) >> 32);
+}
+
+static inline size_t _cuckoo_other(const cuckoo_t* m, const uint64_t key,
+                                   const size_t b) {
+    const uint64_t hash = _cuckoo_hash64(key);
+    const size_t b1 = _cuckoo_first(hash, m->buckets);
+    return b1 != b ? b1 : _cuckoo_second(hash, m->buckets);
+}
+
+static inline size_t _cuckoo_find(const cuckoo_t* m, const size_t kb,
+                                  const size_t b, const uint64_t key) {
+    const unsigned used = m->used[b];
+    const size_t i = b * cuckoo_ways;
+    for (size_t w = 0; w < cuckoo_ways; w++) {
+        if ((used >> w) & 1 && _cuckoo_key_at(m, kb, i + w) == key) {
+            return i + w;
+        }
+    }
+    return _cuckoo_none;
+}
+
+static inline size_t _cuckoo_free_way(const cuckoo_t* m, const size_t b) {
+    const unsigned used = m->used[b];
+    for (size_t w = 0; w < cuckoo_ways; w++) {
+        if (!((used >> w) & 1)) { return w; }
+    }
+    return _cuckoo_none;
+}
+
+static size_t _cuckoo_lookup(const cuckoo_t* m, const size_t kb,
+                             const uint64_t key) {
+    // index of the key in buckets or stash or _cuckoo_none
+    if (m->n == 0) { return _cuckoo_none; }
+    const uint64_t hash = _cuckoo_hash64(key);
+    const size_t b1 = _cuckoo_first(hash, m->buckets);
+    const size_t b2 = _cuckoo_second(hash, m->buckets);
+    _cuckoo_prefetch(m->pk + b2 * cuckoo_ways * kb); // both reads overlap
+    size_t i = _cuckoo_find(m, kb, b1, key);
+    if (i == _cuckoo_none) { i = _cuckoo_find(m, kb, b2, key); }
+    if (i == _cuckoo_none && m->stashed > 0) {
+        const size_t s = m->buckets * cuckoo_ways;
+        for (size_t j = s; j < s + m->stashed; j++) {
+            if (_cuckoo_key_at(m, kb, j) == key) { return j; }
+        }
+    }
+    return i;
+}
+
+static bool _cuckoo_on_path(const size_t* bucket, const int32_t* parent,
+                            int32_t node, const size_t b) {
+    while (node >= 0) {
+        if (bucket[node] == b) { return true; }
+        node = parent[node];
+    }
+    return false;
+}
+
+static size_t _cuckoo_displace(cuckoo_t* m, const size_t kb, const size_t vb,
+                               const uint64_t hash) {
+    // breadth first search for the shortest chain of entries that can
+    // move into their other buckets; returns the slot freed for the key
+    size_t  bucket[_cuckoo_bfs];
+    int32_t parent[_cuckoo_bfs];
+    uint8_t way[_cuckoo_bfs]; // way in parent bucket moving into bucket
+    int32_t tail = 0;
+    bucket[tail] = _cuckoo_first(hash, m->buckets);
+    parent[tail++] = -1;
+    if (_cuckoo_second(hash, m->buckets) != bucket[0]) {
+        bucket[tail] = _cuckoo_second(hash, m->buckets);
+        parent[tail++] = -1;
+    }
+    for (int32_t head = 0; head < tail; head++) {
+        const size_t b = bucket[head];
+        for (size_t w = 0; w < cuckoo_ways && tail < _cuckoo_bfs; w++) {
+            const size_t a = _cuckoo_other(m, _cuckoo_key_at(m, kb,
+                                           b * cuckoo_ways + w), b);
+            if (a == b || _cuckoo_on_path(bucket, parent, head, a)) {
+                continue; // a chain must not move an entry twice
+            }
+            const size_t f = _cuckoo_free_way(m, a);
+            if (f != _cuckoo_none) { // move entries from the end of chain
+                size_t to = a * cuckoo_ways + f;
+                m->used[a] |= (uint8_t)(1u << f);
+                size_t from = b * cuckoo_ways + w;
+                int32_t node = head;
+                for (;;) {
+                    _cuckoo_move(m, kb, vb, to, from);
+                    to = from;
+                    if (parent[node] < 0) { return to; }
+                    from = bucket[parent[node]] * cuckoo_ways + way[node];
+                    node = parent[node];
+                }
+            }
+            bucket[tail] = a;
+            parent[tail] = head;
+            way[tail++] = (uint8_t)w;
+        }
+    }
+    return _cuckoo_none;
+}
+
+static size_t _cuckoo_slot(cuckoo_t* m, const size_t kb, const size_t vb,
+                           const uint64_t key) {
+    // free slot for a new key or _cuckoo_none if the table must grow
+    const uint64_t hash = _cuckoo_hash64(key);
+    const size_t b1 = _cuckoo_first(hash, m->buckets);
+    const size_t b2 = _cuckoo_second(hash, m->buckets);
+    const size_t f1 = _cuckoo_free_way(m, b1);
+    const size_t f2 = _cuckoo_free_way(m, b2);
+    // first bucket first: most lookups end after one bucket read
+    if (f1 != _cuckoo_none) {
+        m->used[b1] |= (uint8_t)(1u << f1);
+        return b1 * cuckoo_ways + f1;
+    } else if (f2 != _cuckoo_none) {
+        m->used[b2] |= (uint8_t)(1u << f2);
+        return b2 * cuckoo_ways + f2;
+    }
+    const size_t i = _cuckoo_displace(m, kb, vb, hash);
+    if (i != _cuckoo_none) { return i; }
+    if (m->stashed < cuckoo_stash) {
+        return m->buckets * cuckoo_ways + m->stashed++;
+    }
+    return _cuckoo_none;
+}
+
+static bool _cuckoo_table(cuckoo_t* m, const size_t kb, const size_t vb,
+                          const size_t buckets) {
+    // keys and values start at cache line boundaries so that a bucket
+    // of 8 keys of 1, 2, 4 or 8 bytes never straddles two lines
+    const size_t slots = buckets * cuckoo_ways + cuckoo_stash;
+    const size_t mask = ~(size_t)(_cuckoo_line - 1);
+    const size_t kbytes = (slots * kb + _cuckoo_line - 1) & mask;
+    const size_t vbytes = (slots * vb + _cuckoo_line - 1) & mask;
+    uint8_t* memory = (uint8_t*)malloc(_cuckoo_line + kbytes + vbytes +
+                                       buckets);
+    if (!memory) { return false; }
+    uint8_t* p = memory + (_cuckoo_line - (uintptr_t)memory % _cuckoo_line);
+    m->memory  = memory;
+    m->pk      = p;
+    m->pv      = p + kbytes;
+    m->used    = p + kbytes + vbytes;
+    m->buckets = buckets;
+    m->n       = 0;
+    m->stashed = 0;
+    memset(m->used, 0, buckets);
+    return true;
+}
+
+static bool _cuckoo_grow(cuckoo_t* m, const size_t kb, const size_t vb) {
+    cuckoo_t old = *m;
+    size_t buckets = old.buckets + old.buckets / 4 + 1;
+    for (;;) {
+        if (buckets > UINT32_MAX) {
+            *m = old;
+            _cuckoo_fatal_return_zero("too many entries\n");
+        }
+        if (!_cuckoo_table(m, kb, vb, buckets)) {
+            *m = old;
+            _cuckoo_fatal_return_zero("out of memory\n");
+        }
+        bool ok = true;
+        const size_t c = old.buckets * cuckoo_ways;
+        for (size_t i = 0; i < c + old.stashed && ok; i++) {
+            if (i < c && !((old.used[i / cuckoo_ways] >>
+                            (i % cuckoo_ways)) & 1)) {
+                continue;
+            }
+            const size_t j = _cuckoo_slot(m, kb, vb,
+                                          _cuckoo_key_at(&old, kb, i));
+            ok = j != _cuckoo_none;
+            if (ok) {
+                _cuckoo_copy(m->pk + j * kb, old.pk + i * kb, kb);
+                _cuckoo_copy(m->pv + j * vb, old.pv + i * vb, vb);
+                m->n++;
+            }
+        }
+        if (ok) { break; }
+        free(m->memory); // unlucky hashes: try a larger table
+        buckets += buckets / 4 + 1;
+    }
+    free(old.memory);
+    return true;
+}
+
+bool _cuckoo_alloc(void* mv, size_t kb, size_t vb, size_t n) {
+    cuckoo_t* m = (cuckoo_t*)mv;
+    memset(m, 0, sizeof(*m));
+    if (kb != 1 && kb != 2 && kb != 4 && kb != 8) {
+        _cuckoo_fatal_return_zero("invalid key size: %zd\n", kb);
+    }
+    if (vb == 0) {
+        _cuckoo_fatal_return_zero("invalid value size: %zd\n", vb);
+    }
+    // room for n entries at 90% occupancy:
+    const size_t buckets = n / 8 + n / 64 + 1;
+    if (buckets > UINT32_MAX) {
+        _cuckoo_fatal_return_zero("too many entries\n");
+    }
+    if (!_cuckoo_table(m, kb, vb, buckets)) {
+        _cuckoo_fatal_return_zero("out of memory\n");
+    }
+    return true;
+}
+
+bool _cuckoo_put(void* mv, const size_t kb, const size_t vb,
+                 const void* pkey, const void* pval) {
+    cuckoo_t* m = (cuckoo_t*)mv;
+    if (!m->memory) { _cuckoo_fatal_return_zero("map is not allocated\n"); }
+    const uint64_t key = _cuckoo_key((const uint8_t*)pkey, kb);
+    size_t i = _cuckoo_lookup(m, kb, key);
+    if (i == _cuckoo_none) {
+        i = _cuckoo_slot(m, kb, vb, key);
+        if (i == _cuckoo_none) {
+            if (!_cuckoo_grow(m, kb, vb)) { return false; }
+            i = _cuckoo_slot(m, kb, vb, key);
+            if (i == _cuckoo_none) { // grown table always has room
+                _cuckoo_fatal_return_zero("cannot place key\n");
+            }
+        }
+        _cuckoo_copy(m->pk + i * kb, (const uint8_t*)pkey, kb);
+        m->n++;
+    }
+    _cuckoo_copy(m->pv + i * vb, (const uint8_t*)pval, vb);
+    return true;
+}
+
+const void* _cuckoo_get(const void* mv, const size_t kb, const size_t vb,
+                        const void* pkey) {
+    const cuckoo_t* m = (const cuckoo_t*)mv;
+    const uint64_t key = _cuckoo_key((const uint8_t*)pkey, kb);
+    const size_t i = _cuckoo_lookup(m, kb, key);
+    return i == _cuckoo_none ? 0 : m->pv + i * vb;
+}
+
+bool _cuckoo_delete(void* mv, const size_t kb, const size_t vb,
+                    const void* pkey) {
+    cuckoo_t* m = (cuckoo_t*)mv;
+    const uint64_t key = _cuckoo_key((const uint8_t*)pkey, kb);
+    const size_t i = _cuckoo_lookup(m, kb, key);
+    if (i == _cuckoo_none) { return false; }
+    const size_t c = m->buckets * cuckoo_ways;
+    if (i < c) {
+        m->used[i / cuckoo_ways] &= (uint8_t)~(1u << (i % cuckoo_ways));
+    } else { // last stash entry fills the hole
+        m->stashed--;
+        if (i != c + m->stashed) { _cuckoo_move(m, kb, vb, i, c + m->stashed); }
+    }
+    m->n--;
+    return true;
+}
+
+void _cuckoo_clear(void* mv) {
+    cuckoo_t* m = (cuckoo_t*)mv;
+    if (m->used) { memset(m->used, 0, m->buckets); }
+    m->n = 0;
+    m->stashed = 0;
+}
+
+void _cuckoo_free(void* mv) {
+    cuckoo_t* m = (cuckoo_t*)mv;
+    free(m->memory);
+    memset(m, 0, sizeof(*m));
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // cuckoo_implementation
@@ -75,6 +75,50 @@ int32_t rt_exit(int exit_code);
 
 uint64_t rt_nanoseconds(void);
 
+// rt_ticks() is a monotonic counter for timing single operations
+// (TSC on x86-64, CNTVCT on ARM64, QueryPerformanceCounter on Windows,
+// otherwise CLOCK_MONOTONIC_RAW). It is not serializing and not
+// related to wall clock time. rt_tick_ns() nanoseconds per tick is
+// calibrated against the monotonic clock on the first call (~10ms).
+
+uint64_t rt_ticks(void);
+
+double rt_tick_ns(void);
+
+// HDR style log-linear histogram: values below 128 are counted exactly,
+// larger values in 64 sub-buckets per power of two (error < 1.6%).
+// Values are unit agnostic (usually rt_ticks() deltas).
+
+enum { rt_histogram_half = 64,
+       rt_histogram_buckets = (64 - 5) * rt_histogram_half };
+
+typedef struct rt_histogram_s {
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    double   sum;
+    uint64_t counts[rt_histogram_buckets];
+} rt_histogram_t;
+
+void rt_histogram_init(rt_histogram_t* h);
+
+void rt_histogram_record(rt_histogram_t* h, uint64_t value);
+
+void rt_histogram_merge(rt_histogram_t* d, const rt_histogram_t* s);
+
+// percentile in [0..100], e.g. 99.9 returns the highest value equivalent
+// to the recorded value at or below which 99.9% of recorded values fall
+
+uint64_t rt_histogram_percentile(const rt_histogram_t* h, double percentile);
+
+double rt_histogram_mean(const rt_histogram_t* h);
+
+// prints count, mean, p50, p99, p99.9 and max of values multiplied
+// by scale (e.g. rt_tick_ns() for ticks to nanoseconds)
+
+void rt_histogram_println(const char* label, const rt_histogram_t* h,
+                          double scale);
+
 uint64_t rt_random64(uint64_t* state);
 
 double rt_rand64(uint64_t *state); // [0.0..1.0) exclusive to 1.0
@@ -117,6 +161,15 @@ int32_t rt_printf_implementation(const char* file, int32_t line,
 
 #ifdef rt_implementation
 
+#ifdef _MSC_VER
+#include <intrin.h> // __rdtsc _BitScanReverse64
+#elif defined(__x86_64__)
+#include <x86intrin.h> // __rdtsc
+#endif
+#ifndef _WIN32
+#include <pthread.h> // pthread_once() of rt_tick_ns()
+#endif
+
 typedef struct rt_debug_output_s {
     char  buffer[8 * 1024];
     char* rd; // read pointer
@@ -272,6 +325,143 @@ uint64_t rt_nanoseconds(void) {
     return (ts.tv_sec * 1000000000uLL + ts.tv_nsec);
 }
 
+static uint64_t rt_monotonic_ns(void) {
+    #ifdef _WINDOWS_
+        LARGE_INTEGER c, f;
+        QueryPerformanceCounter(&c);
+        QueryPerformanceFrequency(&f);
+        return (uint64_t)((double)c.QuadPart * 1e9 / (double)f.QuadPart);
+    #else
+        struct timespec ts;
+        #ifdef CLOCK_MONOTONIC_RAW // immune to NTP slewing
+            clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+        #else
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+        #endif
+        return ts.tv_sec * 1000000000uLL + ts.tv_nsec;
+    #endif
+}
+
+uint64_t rt_ticks(void) {
+    #if defined(__x86_64__) || defined(_M_X64)
+        return __rdtsc(); // invariant TSC on all x86-64 CPUs since ~2008
+    #elif defined(__aarch64__) && !defined(_MSC_VER)
+        uint64_t t;
+        __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(t));
+        return t;
+    #elif defined(_WINDOWS_)
+        LARGE_INTEGER c;
+        QueryPerformanceCounter(&c);
+        return (uint64_t)c.QuadPart;
+    #else
+        return rt_monotonic_ns();
+    #endif
+}
+
+static double rt_tick_ns_calibrated;
+
+static void rt_tick_ns_calibrate(void) { // spins for 10ms
+    const uint64_t t = rt_monotonic_ns();
+    const uint64_t c = rt_ticks();
+    uint64_t e = t;
+    while (e - t < 10 * 1000 * 1000) { e = rt_monotonic_ns(); }
+    const uint64_t ticks = rt_ticks() - c;
+    rt_tick_ns_calibrated = ticks > 0 ? (double)(e - t) / (double)ticks : 1.0;
+}
+
+#ifdef _WINDOWS_
+static BOOL CALLBACK rt_tick_ns_once(PINIT_ONCE once, void* p, void** c) {
+    (void)once; (void)p; (void)c;
+    rt_tick_ns_calibrate();
+    return TRUE;
+}
+#endif
+
+double rt_tick_ns(void) { // first callers wait for a single calibration
+    #ifdef _WINDOWS_
+        static INIT_ONCE once = INIT_ONCE_STATIC_INIT;
+        InitOnceExecuteOnce(&once, rt_tick_ns_once, null, null);
+    #else
+        static pthread_once_t once = PTHREAD_ONCE_INIT;
+        pthread_once(&once, rt_tick_ns_calibrate);
+    #endif
+    return rt_tick_ns_calibrated;
+}
+
+static size_t rt_histogram_index(uint64_t v) {
+    enum { half = rt_histogram_half };
+    if (v < 2 * half) { return (size_t)v; }
+    #ifdef _MSC_VER
+        unsigned long msb; _BitScanReverse64(&msb, v);
+    #else
+        const int msb = 63 - __builtin_clzll(v);
+    #endif
+    const int shift = (int)msb - 6; // 6 == log2(half)
+    return (size_t)(shift * half + (v >> shift));
+}
+
+static uint64_t rt_histogram_highest(size_t i) { // highest value of bucket
+    enum { half = rt_histogram_half };
+    if (i < 2 * half) { return i; }
+    const int shift = (int)(i / half) - 1;
+    const uint64_t top = i % half + half;
+    return ((top + 1) << shift) - 1;
+}
+
+void rt_histogram_init(rt_histogram_t* h) {
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+}
+
+void rt_histogram_record(rt_histogram_t* h, uint64_t value) {
+    h->counts[rt_histogram_index(value)]++;
+    h->count++;
+    h->sum += (double)value;
+    if (value < h->min) { h->min = value; }
+    if (value > h->max) { h->max = value; }
+}
+
+void rt_histogram_merge(rt_histogram_t* d, const rt_histogram_t* s) {
+    for (size_t i = 0; i < rt_histogram_buckets; i++) {
+        d->counts[i] += s->counts[i];
+    }
+    d->count += s->count;
+    d->sum += s->sum;
+    if (s->min < d->min) { d->min = s->min; }
+    if (s->max > d->max) { d->max = s->max; }
+}
+
+uint64_t rt_histogram_percentile(const rt_histogram_t* h, double percentile) {
+    if (h->count == 0) { return 0; }
+    if (percentile >= 100) { return h->max; }
+    uint64_t rank = (uint64_t)(percentile / 100 * (double)h->count + 0.5);
+    if (rank == 0) { rank = 1; }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < rt_histogram_buckets; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            const uint64_t v = rt_histogram_highest(i);
+            return v < h->max ? (v > h->min ? v : h->min) : h->max;
+        }
+    }
+    return h->max;
+}
+
+double rt_histogram_mean(const rt_histogram_t* h) {
+    return h->count == 0 ? 0 : h->sum / (double)h->count;
+}
+
+void rt_histogram_println(const char* label, const rt_histogram_t* h,
+                          double scale) {
+    rt_println("%s count: %llu mean: %.1f p50: %.1f p99: %.1f "
+               "p99.9: %.1f max: %.1f", label,
+               (unsigned long long)h->count, rt_histogram_mean(h) * scale,
+               rt_histogram_percentile(h, 50) * scale,
+               rt_histogram_percentile(h, 99) * scale,
+               rt_histogram_percentile(h, 99.9) * scale,
+               (double)h->max * scale);
+}
+
 uint64_t rt_random64(uint64_t* state) {
     // Linear Congruential Generator with inline mixing
     thread_local static bool initialized; // must start with ODD seed!
@@ -1,6 +1,7 @@
 ﻿#define UNSTD_NO_RT_IMPLEMENTATION
 #include "rt/ustd.h"
 #include "kvm.h"
+#include "map.h" // exact LRU for comparison with kvm_cache()
 
 #ifndef swear
 
@@ -15,6 +16,8 @@
 
 static uint64_t seed = 1;
 
+extern bool tests_large; // main.cpp --large
+
 static int test0(void) {
     kvm(int, double, 16) m;
     kvm_alloc(&m);
@@ -216,6 +219,16 @@ static int test4(void) {
     }
     t = nanoseconds() - t;
     printf("kvm_get   : %.3f" "\xCE\xBC" "s\n", (t * 1e-3) / (double)n);
+    t = nanoseconds();
+    uint64_t sum = 0;
+    struct kvm_iterator iterator = kvm_iterator(&m);
+    while (kvm_has_next(&iterator)) {
+        uint64_t val = 0;
+        sum += *kvm_next_entry(&m, &iterator, &val) + val;
+    }
+    t = nanoseconds() - t;
+    swear(sum != 0);
+    printf("kvm_next  : %.3f" "\xCE\xBC" "s\n", (t * 1e-3) / (double)n);
     shuffle(index, n);
     t = nanoseconds();
     for (size_t i = 0; i < n; i++) {
@@ -253,9 +266,1264 @@ static int test5(void) {
     return 0;
 }
 
+static int test6(void) {
+    kvm(uint64_t, uint64_t) m0;
+    kvm(uint64_t, double, 64) m1;
+    kvm_alloc(&m0, 4);
+    kvm_alloc(&m1);
+    for (uint64_t i = 0; i < 32; i++) {
+        const uint64_t h = kvm_hash_key(&m0, i);
+        swear(h == kvm_hash_key(&m1, i)); // same hash for all kvm(uint64_t,)
+        swear(kvm_put_hashed(&m0, i, i * i, h));
+        swear(kvm_put_hashed(&m1, i, i * 0.5, h));
+    }
+    for (uint64_t i = 0; i < 32; i++) {
+        const uint64_t h = kvm_hash_key(&m0, i);
+        swear(*kvm_get_hashed(&m0, i, h) == i * i);
+        swear(*kvm_get_hashed(&m1, i, h) == i * 0.5);
+        swear(*kvm_get(&m0, i) == i * i); // interchangeable with kvm_get()
+        if (i % 2 == 0) {
+            swear(kvm_delete_hashed(&m0, i, h));
+            swear(!kvm_get_hashed(&m0, i, h));
+        }
+    }
+    swear(m0.n == 16 && m1.n == 32);
+    kvm_free(&m0);
+    kvm_free(&m1);
+    return 0;
+}
+
+static int test7(void) {
+    enum { n = 1000 };
+    static bool seen[n];
+    kvm(uint32_t, uint32_t) m;
+    kvm_alloc(&m, 4);
+    for (uint32_t i = 0; i < n; i++) { kvm_put(&m, i, i * 3); }
+    for (uint32_t i = 0; i < n; i += 3) { kvm_delete(&m, i); }
+    size_t count = 0;
+    struct kvm_iterator iterator = kvm_iterator(&m);
+    while (kvm_has_next(&iterator)) {
+        uint32_t val = 0;
+        const uint32_t key = *kvm_next_entry(&m, &iterator, &val);
+        swear(key < n && key % 3 != 0 && !seen[key] && val == key * 3);
+        kvm_put(&m, key, val + 1); // replacing values is allowed
+        seen[key] = true;
+        count++;
+    }
+    swear(count == m.n && !kvm_next(&m, &iterator));
+    kvm(int, int, 8) f; // fixed size and empty
+    kvm_init(&f);
+    iterator = kvm_iterator(&f);
+    swear(!kvm_has_next(&iterator));
+    kvm_free(&m);
+    return 0;
+}
+
+static int test8_verify(void* mv, bool heap) {
+    // random puts and deletes against a reference array:
+    enum { n = 4096 };
+    static uint64_t ref[n]; // 0 absent
+    memset(ref, 0, sizeof(ref));
+    kvm(uint64_t, uint64_t, 1024)* f = mv; // fixed or cast of heap
+    kvm(uint64_t, uint64_t)* h = mv;
+    size_t count = 0;
+    for (int i = 0; i < 200 * 1000; i++) {
+        const uint64_t key = random64(&seed) % n;
+        const uint64_t val = random64(&seed) | 1;
+        const int op = (int)(random64(&seed) % 3);
+        if (op == 0 || (op == 1 && !heap && count >= 900)) {
+            bool deleted = heap ? kvm_delete(h, key) : kvm_delete(f, key);
+            swear(deleted == (ref[key] != 0));
+            if (deleted) { count--; }
+            ref[key] = 0;
+        } else if (op == 1) {
+            bool ok = heap ? kvm_put(h, key, val) : kvm_put(f, key, val);
+            swear(ok);
+            if (ref[key] == 0) { count++; }
+            ref[key] = val;
+        } else {
+            uint64_t* r = heap ? kvm_get(h, key) : kvm_get(f, key);
+            swear(ref[key] == 0 ? r == null : *r == ref[key]);
+        }
+        swear(count == (heap ? h->n : f->n));
+        if (i % 50000 == 0) { heap ? kvm_compact(h) : kvm_compact(f); }
+    }
+    for (uint64_t key = 0; key < n; key++) {
+        uint64_t* r = heap ? kvm_get(h, key) : kvm_get(f, key);
+        swear(ref[key] == 0 ? r == null : *r == ref[key]);
+    }
+    return 0;
+}
+
+static int test8(void) {
+    kvm(uint64_t, uint64_t, 1024) f;
+    kvm_init(&f);
+    uint64_t tombs[kvm_tombstones_words(1024)];
+    swear(kvm_tombstones(&f, true, tombs));
+    test8_verify(&f, false);
+    swear(kvm_tombstones(&f, false));
+    struct kvm_stats s;
+    kvm_stats(&f, &s, 0);
+    swear(s.tombstones == 0 && s.bitmap_bytes ==
+          kvm_tombstones_words(kvm_capacity(&f)) * sizeof(uint64_t));
+    kvm_free(&f);
+    kvm(uint64_t, uint64_t) m;
+    kvm_alloc(&m, 4);
+    swear(kvm_tombstones(&m, true));
+    test8_verify(&m, true);
+    kvm_free(&m);
+    // churn: constant number of entries, delete one and insert one
+    enum { n = 1024 * 1024, churn = 4 * n };
+    static uint64_t k[n];
+    for (int pass = 0; pass < 2; pass++) {
+        kvm_alloc(&m, n * 2);
+        kvm_tombstones(&m, pass == 1);
+        for (size_t i = 0; i < n; i++) {
+            k[i] = random64(&seed);
+            kvm_put(&m, k[i], i);
+        }
+        uint64_t td = 0;
+        uint64_t tp = 0;
+        enum { batch = 4096 };
+        for (size_t i = 0; i < churn; i += batch) {
+            uint64_t t = nanoseconds();
+            for (size_t j = i % n; j < i % n + batch; j++) {
+                bool deleted = kvm_delete(&m, k[j]);
+                swear(deleted);
+            }
+            td += nanoseconds() - t;
+            for (size_t j = i % n; j < i % n + batch; j++) {
+                k[j] = random64(&seed);
+            }
+            t = nanoseconds();
+            for (size_t j = i % n; j < i % n + batch; j++) {
+                kvm_put(&m, k[j], j);
+            }
+            tp += nanoseconds() - t;
+        }
+        swear(m.n == n);
+        for (size_t i = 0; i < n; i += 7) {
+            uint64_t* r = kvm_get(&m, k[i]);
+            swear(r != null && *r == i);
+        }
+        printf("%-10s kvm_delete: %.3f" "\xCE\xBC" "s kvm_put: %.3f" "\xCE\xBC" "s\n",
+               pass == 0 ? "shift" : "tombstones",
+               (td * 1e-3) / (double)churn, (tp * 1e-3) / (double)churn);
+        kvm_free(&m);
+    }
+    return 0;
+}
+
+static int test9(void) {
+    kvm(uint32_t, uint32_t) m;
+    kvm_alloc(&m, 4);
+    swear(kvm_reserve(&m, 1000));
+    const size_t reserved = m.a;
+    for (uint32_t i = 0; i < 1000; i++) { kvm_put(&m, i, i); }
+    swear(m.a == reserved); // did not grow
+    for (uint32_t i = 0; i < 1000; i++) { kvm_delete(&m, i); }
+    swear(m.a == reserved); // did not shrink below reserved
+    for (uint32_t i = 0; i < 100 * 1000; i++) { kvm_put(&m, i, i); }
+    const size_t peak = m.a;
+    for (uint32_t i = 1000; i < 100 * 1000; i++) { kvm_delete(&m, i); }
+    swear(m.a < peak / 8); // shrunk automatically
+    swear(kvm_shrink_to_fit(&m) && m.a < 1500);
+    for (uint32_t i = 0; i < 1000; i++) { swear(*kvm_get(&m, i) == i); }
+    swear(m.n == 1000);
+    kvm_free(&m);
+    kvm(uint32_t, uint32_t, 16) f;
+    kvm_init(&f);
+    swear(kvm_reserve(&f, 16) && kvm_shrink_to_fit(&f));
+    // memory and throughput for max load factors 50%..90%:
+    enum { n = 1024 * 1024 };
+    static uint64_t k[n];
+    for (size_t i = 0; i < n; i++) { k[i] = random64(&seed); }
+    kvm(uint64_t, uint64_t) h;
+    for (size_t load = 50; load <= 90; load += 10) {
+        kvm_alloc(&h, 4);
+        swear(kvm_load_factors(&h, load, 150, load / 4));
+        swear(kvm_reserve(&h, n));
+        uint64_t t = nanoseconds();
+        for (size_t i = 0; i < n; i++) { kvm_put(&h, k[i], i); }
+        const double put = (nanoseconds() - t) * 1e-3 / n;
+        t = nanoseconds();
+        for (size_t i = 0; i < n; i++) { swear(*kvm_get(&h, k[i]) == i); }
+        const double get = (nanoseconds() - t) * 1e-3 / n;
+        const size_t bytes = h.a * (sizeof(h.k[0]) + sizeof(h.v[0])) + h.a / 8;
+        printf("load %zd%% kvm_put: %.3f" "\xCE\xBC" "s kvm_get: %.3f" "\xCE\xBC"
+               "s %.1f bytes/entry\n", load, put, get, bytes / (double)n);
+        kvm_free(&h);
+    }
+    return 0;
+}
+
+static void test10_bench(size_t n, bool huge) {
+    kvm(uint64_t, uint64_t) m;
+    kvm_alloc(&m, 4);
+    swear(kvm_huge_pages(&m, huge, huge));
+    uint64_t t = nanoseconds();
+    swear(kvm_reserve(&m, n));
+    const double reserve = (nanoseconds() - t) * 1e-6;
+    const uint64_t odd = 0x9E3779B97F4A7C15uLL; // distinct keys
+    t = nanoseconds();
+    for (size_t i = 0; i < n; i++) { kvm_put(&m, i * odd, i); }
+    const double put = (nanoseconds() - t) * 1e-3 / n;
+    t = nanoseconds();
+    for (size_t i = 0; i < n; i++) { swear(*kvm_get(&m, i * odd) == i); }
+    const double get = (nanoseconds() - t) * 1e-3 / n;
+    printf("%4zdM huge pages: %-3s reserve: %7.1fms kvm_put: %.3f" "\xCE\xBC"
+           "s kvm_get: %.3f" "\xCE\xBC" "s\n", n / (1024 * 1024),
+           huge ? "on" : "off", reserve, put, get);
+    kvm_free(&m);
+}
+
+static int test10(void) {
+    kvm(uint64_t, uint32_t) m;
+    kvm_alloc(&m, 4);
+    for (uint32_t i = 0; i < 1000 * 1000; i++) { kvm_put(&m, i, i); }
+    swear(kvm_huge_pages(&m, true, true));
+    kvm_tombstones(&m, true);
+    for (uint32_t i = 0; i < 1000 * 1000; i += 2) { kvm_delete(&m, i); }
+    for (uint32_t i = 1000 * 1000; i < 2000 * 1000; i++) { kvm_put(&m, i, i); }
+    swear(kvm_huge_pages(&m, false, false));
+    for (uint32_t i = 0; i < 2000 * 1000; i++) {
+        uint32_t* r = kvm_get(&m, i);
+        swear(i < 1000 * 1000 && i % 2 == 0 ? r == null : *r == i);
+    }
+    kvm_free(&m);
+    const size_t largest = (tests_large ? 16 : 1) * 1024 * 1024;
+    for (size_t n = 1024 * 1024; n <= largest; n *= 16) {
+        test10_bench(n, false);
+        test10_bench(n, true);
+    }
+    return 0;
+}
+
+static size_t test11_allocated; // bytes
+
+static void* test11_alloc(void* context, size_t bytes) {
+    swear(context == &test11_allocated);
+    size_t* p = malloc(bytes + sizeof(size_t)); // remember size to verify free
+    if (p) { *p = bytes; test11_allocated += bytes; }
+    return p ? p + 1 : null;
+}
+
+static void* test11_zalloc(void* context, size_t bytes) {
+    void* p = test11_alloc(context, bytes);
+    if (p) { memset(p, 0, bytes); }
+    return p;
+}
+
+static void test11_free(void* context, void* p, size_t bytes) {
+    swear(context == &test11_allocated);
+    size_t* s = (size_t*)p - 1;
+    swear(*s == bytes);
+    test11_allocated -= bytes;
+    free(s);
+}
+
+static int test11(void) {
+    static struct kvm_allocator allocator = {
+        test11_alloc, test11_zalloc, test11_free, &test11_allocated
+    };
+    kvm(uint64_t, uint16_t) m;
+    swear(kvm_alloc_with(&m, 4, &allocator));
+    for (uint64_t i = 0; i < 100 * 1000; i++) { kvm_put(&m, i, (uint16_t)i); }
+    swear(kvm_tombstones(&m, true));
+    for (uint64_t i = 0; i < 100 * 1000; i += 3) { kvm_delete(&m, i); }
+    swear(kvm_shrink_to_fit(&m) && kvm_huge_pages(&m, true, true));
+    for (uint64_t i = 0; i < 100 * 1000; i++) {
+        uint16_t* r = kvm_get(&m, i);
+        swear(i % 3 == 0 ? r == null : *r == (uint16_t)i);
+    }
+    swear(test11_allocated > 0);
+    kvm_free(&m);
+    swear(test11_allocated == 0);
+    kvm_global_allocator = &allocator;
+    swear(kvm_alloc(&m, 16));
+    kvm_global_allocator = null;
+    swear(m.allocator == &allocator && test11_allocated > 0);
+    kvm_free(&m);
+    swear(test11_allocated == 0);
+    return 0;
+}
+
+static bool test12_odd(void* context, const void* key, void* val) {
+    (void)context; (void)val;
+    return *(const uint64_t*)key % 2 == 1;
+}
+
+static bool test12_below(void* context, const void* key, void* val) {
+    (void)key;
+    return *(uint64_t*)val < *(uint64_t*)context;
+}
+
+static int test12(void) {
+    kvm(uint64_t, uint64_t, 64) f;
+    kvm_init(&f);
+    const uint64_t c = kvm_capacity(&f);
+    for (uint64_t i = 0; i < c; i++) { swear(kvm_put(&f, i, i)); }
+    swear(f.n == c && c % 2 == 0); // full, no vacant slot
+    swear(kvm_erase_if(&f, test12_odd, null) == c / 2 && f.n == c / 2);
+    for (uint64_t i = 0; i < c; i++) {
+        uint64_t* r = kvm_get(&f, i);
+        swear(i % 2 == 1 ? r == null : *r == i);
+    }
+    kvm(uint64_t, uint64_t) m;
+    kvm_alloc(&m, 4);
+    kvm_tombstones(&m, true);
+    for (uint64_t i = 0; i < 100 * 1000; i++) { kvm_put(&m, i, i); }
+    for (uint64_t i = 0; i < 100 * 1000; i += 3) { kvm_delete(&m, i); }
+    uint64_t below = 50 * 1000;
+    swear(kvm_erase_if(&m, test12_odd, null) > 0);
+    struct kvm_stats s;
+    kvm_stats(&m, &s, 0);
+    swear(s.tombstones == 0);
+    swear(kvm_erase_if(&m, test12_below, &below) > 0);
+    for (uint64_t i = 0; i < 100 * 1000; i++) {
+        uint64_t* r = kvm_get(&m, i);
+        swear(i % 3 == 0 || i % 2 == 1 || i < below ? r == null : *r == i);
+    }
+    kvm_free(&m);
+    // drop 50% of 1M (10M with --large) entries: erase_if vs collect keys
+    // and kvm_delete()
+    enum { largest = 10 * 1000 * 1000 };
+    const size_t n = (tests_large ? 10 : 1) * 1000 * 1000;
+    static uint64_t k[largest / 2];
+    const uint64_t odd = 0x9E3779B97F4A7C15uLL; // distinct keys
+    for (int pass = 0; pass < 2; pass++) {
+        kvm_alloc(&m, 4);
+        swear(kvm_reserve(&m, n));
+        for (uint64_t i = 0; i < n; i++) { kvm_put(&m, i * odd, i); }
+        const size_t bytes = m.a * (sizeof(m.k[0]) + sizeof(m.v[0])) + m.a / 8;
+        below = n / 2;
+        uint64_t t = nanoseconds();
+        if (pass == 0) {
+            swear(kvm_erase_if(&m, test12_below, &below) == n / 2);
+        } else {
+            size_t j = 0;
+            struct kvm_iterator it = kvm_iterator(&m);
+            while (kvm_has_next(&it)) {
+                uint64_t val;
+                const uint64_t key = *kvm_next_entry(&m, &it, &val);
+                if (val < below) { k[j++] = key; }
+            }
+            for (size_t i = 0; i < j; i++) { kvm_delete(&m, k[i]); }
+        }
+        const double ns = (double)(nanoseconds() - t);
+        swear(m.n == n / 2);
+        printf("drop 50%% of %zdM %-20s: %7.1fms %5.2fGB/s\n", n / 1000000,
+               pass == 0 ? "kvm_erase_if()" : "iterate+kvm_delete()",
+               ns * 1e-6, bytes / ns);
+        kvm_free(&m);
+    }
+    return 0;
+}
+
+static uint64_t test13_time; // simulated clock
+
+static bool test13_due(void* context, const void* key, void* val) {
+    (void)key; (void)val;
+    return *(uint64_t*)context == 0; // never, measures a full scan
+}
+
+static uint64_t test13_clock(void) { return test13_time; }
+
+static void test13_verify(void* mv, const uint64_t* ref, const uint64_t* due,
+                          size_t n) {
+    kvm(uint64_t, uint64_t)* m = mv;
+    size_t count = 0;
+    for (uint64_t key = 0; key < n; key++) {
+        uint64_t* r = kvm_get(m, key);
+        const bool live = ref[key] != 0 &&
+                          (due[key] == 0 || due[key] > test13_time);
+        swear(live ? r != null && *r == ref[key] : r == null);
+        count += ref[key] != 0;
+    }
+    swear(m->n == count);
+}
+
+static int test13(void) {
+    // random puts, deletes, deadlines and time jumps against reference
+    enum { n = 4096 };
+    static uint64_t ref[n]; // 0 absent
+    static uint64_t due[n]; // deadlines, 0 none
+    kvm(uint64_t, uint64_t) m;
+    kvm_alloc(&m, 4);
+    test13_time = 1000uLL * 1000 * 1000 * 1000 * 1000; // far from 0
+    swear(kvm_expiry(&m, true, test13_clock));
+    for (int step = 0; step < 200 * 1000; step++) {
+        const uint64_t key = random64(&seed) % n;
+        const uint64_t r = random64(&seed) % 100;
+        if (r < 40) {
+            const uint64_t val = random64(&seed) | 1;
+            swear(kvm_put(&m, key, val));
+            if (ref[key] == 0 ||
+                (due[key] != 0 && due[key] <= test13_time)) {
+                due[key] = 0; // new or expired key has no deadline
+            }
+            ref[key] = val;
+        } else if (r < 70) {
+            // deadlines from the past to far future in all levels:
+            const uint64_t ttl = random64(&seed) >> (random64(&seed) % 64);
+            const uint64_t deadline = r < 45 ? test13_time - ttl % 100 :
+                                               test13_time + ttl;
+            const bool live = ref[key] != 0 &&
+                              (due[key] == 0 || due[key] > test13_time);
+            swear(kvm_expire_at(&m, key, deadline) == live);
+            if (live) { due[key] = deadline; }
+        } else if (r < 85) {
+            swear(kvm_delete(&m, key) == (ref[key] != 0));
+            ref[key] = 0;
+            due[key] = 0;
+        } else {
+            test13_time += random64(&seed) % 4 == 0 ?
+                random64(&seed) % (1uLL << 40) : random64(&seed) % 300;
+            size_t expected = 0;
+            for (uint64_t i = 0; i < n; i++) {
+                if (ref[i] != 0 && due[i] != 0 && due[i] <= test13_time) {
+                    ref[i] = 0;
+                    due[i] = 0;
+                    expected++;
+                }
+            }
+            swear(kvm_expire(&m, test13_time) == expected);
+        }
+        if (step == 100 * 1000) { swear(kvm_tombstones(&m, true)); }
+        if (step % 10000 == 0) { test13_verify(&m, ref, due, n); }
+    }
+    test13_verify(&m, ref, due, n);
+    swear(kvm_huge_pages(&m, true, false) && kvm_shrink_to_fit(&m));
+    test13_verify(&m, ref, due, n);
+    kvm_clear(&m);
+    swear(kvm_expire(&m, UINT64_MAX) == 0);
+    kvm_free(&m);
+    // 1M (10M with --large) entries with mixed TTLs in milliseconds:
+    enum { tick = 10 };
+    const size_t entries = (tests_large ? 10 : 1) * 1000 * 1000;
+    static const uint64_t ttls[] = { 1000, 1000, 1000, 1000, 1000,
+        10 * 1000, 10 * 1000, 10 * 1000, 60 * 1000, 3600 * 1000 };
+    uint64_t now = 1700000000000uLL; // epoch milliseconds
+    const uint64_t start = now;
+    kvm(uint64_t, uint64_t) e;
+    kvm_alloc(&e, 4);
+    swear(kvm_reserve(&e, entries) && kvm_expiry(&e, true, null));
+    swear(kvm_expire(&e, now) == 0); // sets wheel time
+    const uint64_t odd = 0x9E3779B97F4A7C15uLL; // distinct keys
+    uint64_t t = nanoseconds();
+    for (size_t i = 0; i < entries; i++) { // 10K inserts per millisecond
+        const uint64_t key = i * odd;
+        kvm_put(&e, key, i);
+        kvm_expire_at(&e, key, start + i / 10000 +
+                      ttls[random64(&seed) % countof(ttls)]);
+    }
+    const double put = (nanoseconds() - t) * 1e-3 / entries;
+    t = nanoseconds();
+    swear(kvm_erase_if(&e, test13_due, &now) == 0);
+    const double scan = (nanoseconds() - t) * 1e-6;
+    size_t expired = 0;
+    uint64_t worst = 0;
+    t = nanoseconds();
+    while (e.n > 0) {
+        now += tick;
+        const uint64_t call = nanoseconds();
+        expired += kvm_expire(&e, now);
+        const uint64_t elapsed = nanoseconds() - call;
+        if (elapsed > worst) { worst = elapsed; }
+    }
+    const double total = (double)(nanoseconds() - t);
+    swear(expired == entries);
+    printf("%zdM TTLs kvm_put+kvm_expire_at: %.3f" "\xCE\xBC" "s "
+           "kvm_expire: %.3f" "\xCE\xBC" "s per entry, %zd ticks "
+           "worst tick: %.1fms (full scan: %.1fms per tick)\n",
+           entries / 1000000, put, total * 1e-3 / entries, (size_t)((now - start) / tick),
+           worst * 1e-6, scan);
+    kvm_free(&e);
+    return 0;
+}
+
+static void test14_evict(void* context, const void* key, void* val) {
+    bool* present = context;
+    const uint64_t k = *(const uint64_t*)key;
+    swear(present[k] && *(uint64_t*)val == k * 3);
+    present[k] = false;
+}
+
+static void test14_bench(const uint32_t* trace, size_t requests,
+                         size_t keys, size_t entries) {
+    // kvm_cache() with backward shift and tombstones, map_lru()
+    static const char* names[] = { "CLOCK", "CLOCK+tombstones", "LRU" };
+    for (int mode = 0; mode < 3; mode++) {
+        kvm(uint64_t, uint64_t) c;
+        kvm_alloc(&c, 4);
+        if (mode == 1) { swear(kvm_tombstones(&c, true)); }
+        swear(kvm_cache(&c, entries, null, null));
+        map(uint64_t, uint64_t) m;
+        map_alloc(&m, 4);
+        swear(map_lru(&m, entries, null, null));
+        const bool lru = mode == 2;
+        size_t hits = 0;
+        uint64_t t = nanoseconds();
+        for (size_t i = 0; i < requests; i++) {
+            const uint64_t key = trace[i];
+            if (lru ? map_get(&m, key) != null : kvm_get(&c, key) != null) {
+                hits++;
+            } else if (lru) {
+                map_put(&m, key, key);
+            } else {
+                kvm_put(&c, key, key);
+            }
+        }
+        t = nanoseconds() - t;
+        swear((lru ? m.n : c.n) == entries);
+        printf("%-16s %7zd of %zd keys hit rate: %5.1f%% %.3f" "\xCE\xBC"
+               "s per request\n", names[mode], entries, keys,
+               hits * 100.0 / requests, (t * 1e-3) / (double)requests);
+        kvm_free(&c);
+        map_free(&m);
+    }
+}
+
+static int test14(void) {
+    // CLOCK eviction against a reference presence array
+    enum { n = 40, keys = 200 };
+    static bool present[keys];
+    kvm(uint64_t, uint64_t, 64) f;
+    kvm_init(&f);
+    uint64_t counters[kvm_cache_words(64)];
+    uint64_t tombs[kvm_tombstones_words(64)];
+    swear(kvm_cache(&f, n, test14_evict, present, counters));
+    const uint64_t hot = keys - 1;
+    present[hot] = true;
+    swear(kvm_put(&f, hot, hot * 3));
+    for (int step = 0; step < 100 * 1000; step++) {
+        const uint64_t key = random64(&seed) % (keys - 1);
+        if (step == 50 * 1000) { swear(kvm_tombstones(&f, true, tombs)); }
+        if (random64(&seed) % 4 == 0) {
+            swear(kvm_delete(&f, key) == present[key]);
+            present[key] = false;
+        } else if (random64(&seed) % 2 == 0) {
+            uint64_t* r = kvm_get(&f, key);
+            swear(present[key] ? *r == key * 3 : r == null);
+        } else {
+            present[key] = true;
+            swear(kvm_put(&f, key, key * 3));
+            swear(present[key]); // just inserted key is never evicted
+        }
+        // saturated counter outlives entries referenced less often:
+        for (int i = 0; i < 3; i++) { swear(kvm_get(&f, hot) != null); }
+        size_t count = 0;
+        for (size_t k = 0; k < keys; k++) { count += present[k]; }
+        swear(f.n == count && f.n <= n);
+    }
+    swear(kvm_cache(&f, 10, test14_evict, present, counters) && f.n == 10);
+    swear(kvm_get(&f, hot) != null);
+    swear(kvm_cache(&f, 0, null, null));
+    struct kvm_stats s; // tombstones but no counters
+    kvm_stats(&f, &s, 0);
+    swear(s.bitmap_bytes == 2 * sizeof(tombs));
+    kvm_free(&f);
+    // heap cache must not grow, huge pages and resize keep counters
+    kvm(uint64_t, uint64_t) m;
+    kvm_alloc(&m, 4);
+    memset(present, 0, sizeof(present));
+    swear(kvm_cache(&m, 100, test14_evict, present));
+    const size_t a = m.a;
+    for (uint64_t i = 0; i < keys - 1; i++) {
+        present[i] = true;
+        swear(kvm_put(&m, i, i * 3));
+        if (i == 50) { swear(kvm_huge_pages(&m, true, false)); }
+        swear(kvm_get(&m, 0) != null); // keep 0
+    }
+    swear(m.n == 100 && m.a == a && kvm_get(&m, 0) != null);
+    swear(kvm_cache(&m, 1000, test14_evict, present) && m.a > a);
+    swear(m.n == 100 && kvm_get(&m, 0) != null);
+    kvm_free(&m);
+    // Zipf (s = 1) distributed trace of 1M requests over 256K keys,
+    // 4M requests over 1M keys with --large:
+    enum { largest = 4 * 1024 * 1024 };
+    const size_t requests = (tests_large ? 4 : 1) * 1024 * 1024;
+    const size_t universe = requests / 4;
+    static double cdf[largest / 4];
+    static uint32_t trace[largest];
+    double sum = 0;
+    for (size_t r = 0; r < universe; r++) { sum += 1.0 / (r + 1); cdf[r] = sum; }
+    for (size_t i = 0; i < requests; i++) {
+        const double u = (random64(&seed) >> 11) * 0x1.0p-53 * sum;
+        size_t lo = 0, hi = universe - 1;
+        while (lo < hi) {
+            const size_t mid = (lo + hi) / 2;
+            if (cdf[mid] < u) { lo = mid + 1; } else { hi = mid; }
+        }
+        trace[i] = (uint32_t)lo;
+    }
+    for (size_t entries = universe / 100; entries <= universe / 4; entries *= 5) {
+        test14_bench(trace, requests, universe, entries);
+    }
+    return 0;
+}
+
+static void test15_add(void* val, const void* with) {
+    *(uint64_t*)val += *(const uint64_t*)with;
+}
+
+static void test15_bench(size_t keys) {
+    // word count style aggregation: get + put, upsert, get_or_insert
+    const size_t events = (tests_large ? 10 : 1) * 1000 * 1000;
+    static const char* names[] = { "get+put", "upsert", "get_or_insert" };
+    double us[3];
+    uint64_t sum[3] = {0};
+    for (int mode = 0; mode < 3; mode++) {
+        kvm(uint64_t, uint64_t) m;
+        kvm_alloc(&m, 4);
+        uint64_t s = 1; // same keys for all modes
+        uint64_t t = nanoseconds();
+        for (size_t i = 0; i < events; i++) {
+            const uint64_t key = random64(&s) % keys;
+            if (mode == 0) {
+                const uint64_t* v = kvm_get(&m, key);
+                kvm_put(&m, key, v ? *v + 1 : 1);
+            } else if (mode == 1) {
+                kvm_upsert(&m, key, 1, test15_add);
+            } else {
+                (*kvm_get_or_insert(&m, key, null))++;
+            }
+        }
+        t = nanoseconds() - t;
+        us[mode] = (t * 1e-3) / (double)events;
+        struct kvm_iterator iterator = kvm_iterator(&m);
+        while (kvm_has_next(&iterator)) {
+            uint64_t v = 0;
+            kvm_next_entry(&m, &iterator, &v);
+            sum[mode] += v;
+        }
+        kvm_free(&m);
+    }
+    swear(sum[0] == events && sum[1] == events && sum[2] == events);
+    printf("%8zd keys %s: %.3f %s: %.3f %s: %.3f" "\xCE\xBC" "s per event\n",
+           keys, names[0], us[0], names[1], us[1], names[2], us[2]);
+}
+
+static int test15(void) {
+    // single probe updates against reference counts
+    enum { keys = 1000 };
+    static uint64_t ref[keys]; // 0 absent
+    kvm(uint64_t, uint64_t) m;
+    kvm_alloc(&m, 4);
+    for (int step = 0; step < 100 * 1000; step++) {
+        const uint64_t key = random64(&seed) % keys;
+        const uint64_t r = random64(&seed) % 10;
+        if (step == 50 * 1000) { swear(kvm_tombstones(&m, true)); }
+        if (r < 4) {
+            swear(kvm_upsert(&m, key, r + 1, test15_add));
+            ref[key] += r + 1;
+        } else if (r < 8) {
+            bool inserted = false;
+            uint64_t* v = kvm_get_or_insert(&m, key, &inserted);
+            swear(v != null && inserted == (ref[key] == 0) && *v == ref[key]);
+            (*v)++;
+            ref[key]++;
+        } else {
+            swear(kvm_delete(&m, key) == (ref[key] != 0));
+            ref[key] = 0;
+        }
+    }
+    size_t count = 0;
+    for (uint64_t key = 0; key < keys; key++) {
+        const uint64_t* v = kvm_get(&m, key);
+        swear(ref[key] != 0 ? *v == ref[key] : v == null);
+        count += ref[key] != 0;
+    }
+    swear(m.n == count);
+    // expired entry is reinserted with zero value and no deadline
+    swear(kvm_expiry(&m, true, test13_clock));
+    test13_time = 100;
+    swear(kvm_put(&m, keys, 7) && kvm_expire_at(&m, keys, 100));
+    bool inserted = false;
+    swear(*kvm_get_or_insert(&m, keys, &inserted) == 0 && inserted);
+    swear(kvm_expire(&m, 1000) == 0 && kvm_get(&m, keys) != null);
+    kvm_free(&m);
+    // the slot returned after an eviction is the inserted one
+    kvm(uint64_t, uint64_t, 16) f;
+    kvm_init(&f);
+    uint64_t counters[kvm_cache_words(16)];
+    swear(kvm_cache(&f, 12, null, null, counters));
+    for (uint64_t key = 0; key < 1000; key++) {
+        uint64_t* v = kvm_get_or_insert(&f, key, &inserted);
+        swear(inserted && *v == 0);
+        *v = key * 3;
+        swear(*kvm_get(&f, key) == key * 3 && f.n == (key < 12 ? key + 1 : 12));
+    }
+    kvm_free(&f);
+    test15_bench(64 * 1024);
+    if (tests_large) { test15_bench(4 * 1024 * 1024); }
+    return 0;
+}
+
+static void test16_bench(size_t keys) {
+    // dedup: kvm(uint64_t, uint8_t) as a set against kvs(uint64_t)
+    const size_t events = (tests_large ? 10 : 1) * 1000 * 1000;
+    double us[2];
+    size_t added[2] = {0};
+    size_t bytes[2] = {0};
+    for (int mode = 0; mode < 2; mode++) {
+        kvm(uint64_t, uint8_t) m;
+        kvs(uint64_t) s;
+        if (mode == 0) { kvm_alloc(&m, 4); } else { kvs_alloc(&s, 4); }
+        uint64_t r = 1; // same keys for both modes
+        uint64_t t = nanoseconds();
+        for (size_t i = 0; i < events; i++) {
+            const uint64_t key = random64(&r) % keys;
+            if (mode == 0) {
+                if (kvm_get(&m, key) == null) {
+                    kvm_put(&m, key, 1);
+                    added[mode]++;
+                }
+            } else {
+                added[mode] += kvs_add(&s, key);
+            }
+        }
+        t = nanoseconds() - t;
+        us[mode] = (t * 1e-3) / (double)events;
+        if (mode == 0) {
+            bytes[mode] = m.a * (sizeof(m.k[0]) + sizeof(m.v[0]));
+            kvm_free(&m);
+        } else {
+            bytes[mode] = s.a * sizeof(s.k[0]);
+            kvs_free(&s);
+        }
+    }
+    swear(added[0] == added[1]);
+    printf("%8zd keys kvm get+put: %.3f %zdKB kvs_add: %.3f %zdKB "
+           "(" "\xCE\xBC" "s per event)\n", keys,
+           us[0], bytes[0] / 1024, us[1], bytes[1] / 1024);
+}
+
+static int test16(void) {
+    // sets against reference membership, fixed and heap allocated
+    enum { keys = 1000 };
+    static bool ref[keys];
+    kvs(uint64_t, 64) f;
+    kvs_init(&f);
+    swear(sizeof(f) < sizeof(kvm(uint64_t, uint64_t, 64)));
+    for (uint64_t key = 0; key < 40; key++) {
+        swear(kvs_add(&f, key * 7) && !kvs_add(&f, key * 7));
+    }
+    for (uint64_t key = 0; key < 280; key++) {
+        swear(kvs_contains(&f, key) == (key % 7 == 0 && key < 280));
+    }
+    swear(kvs_remove(&f, 14) && !kvs_remove(&f, 14) && !kvs_contains(&f, 14));
+    swear(f.n == 39 && f.pv == null);
+    kvs_free(&f);
+    kvs(uint32_t) s;
+    kvs_alloc(&s, 4);
+    for (int step = 0; step < 200 * 1000; step++) {
+        const uint32_t key = (uint32_t)(random64(&seed) % keys);
+        if (step == 100 * 1000) { swear(kvs_tombstones(&s, true)); }
+        if (random64(&seed) % 3 != 0) {
+            swear(kvs_add(&s, key) == !ref[key]);
+            ref[key] = true;
+        } else {
+            swear(kvs_remove(&s, key) == ref[key]);
+            ref[key] = false;
+        }
+    }
+    swear(s.pv == null);
+    size_t count = 0;
+    for (uint32_t key = 0; key < keys; key++) {
+        swear(kvs_contains(&s, key) == ref[key]);
+        count += ref[key];
+    }
+    swear(s.n == count);
+    struct kvm_iterator iterator = kvs_iterator(&s);
+    while (kvs_has_next(&iterator)) {
+        const uint32_t* key = kvs_next(&s, &iterator);
+        swear(ref[*key]);
+        count--;
+    }
+    swear(count == 0);
+    kvs_free(&s);
+    test16_bench(64 * 1024);
+    if (tests_large) { test16_bench(4 * 1024 * 1024); }
+    return 0;
+}
+
+static void test17_bench(double misses) {
+    // enrichment join: 1M (4M with --large) keys table, lookups missing
+    // at given ratio
+    enum { largest = 4 * 1024 * 1024 };
+    const size_t keys = (tests_large ? 4 : 1) * 1024 * 1024;
+    const size_t lookups = (tests_large ? 10 : 2) * 1000 * 1000;
+    static uint64_t present[largest];
+    double us[2];
+    size_t found[2] = {0};
+    for (int bloom = 0; bloom < 2; bloom++) {
+        kvm(uint64_t, uint64_t) m;
+        kvm_alloc(&m, 4);
+        uint64_t r = 1;
+        for (size_t i = 0; i < keys; i++) {
+            present[i] = random64(&r) | 1; // odd keys present
+            kvm_put(&m, present[i], i);
+        }
+        if (bloom) { swear(kvm_bloom(&m, true)); }
+        const uint64_t threshold = (uint64_t)(misses * (double)UINT32_MAX);
+        uint64_t q = 2; // same lookups for both runs
+        uint64_t t = nanoseconds();
+        for (size_t i = 0; i < lookups; i++) {
+            uint64_t key = random64(&q);
+            if ((key >> 32) < threshold) {
+                key &= ~1uLL; // even keys are absent
+            } else {
+                key = present[key % keys];
+            }
+            found[bloom] += kvm_get(&m, key) != null;
+        }
+        t = nanoseconds() - t;
+        us[bloom] = (t * 1e-3) / (double)lookups;
+        kvm_free(&m);
+    }
+    swear(found[0] == found[1]);
+    printf("misses %4.1f%% kvm_get: %.3f with kvm_bloom: %.3f"
+           "\xCE\xBC" "s (hits %zd)\n", misses * 100, us[0], us[1], found[1]);
+}
+
+static int test17(void) {
+    // Bloom filter never hides present keys through grow, shrink,
+    // tombstones and deletions
+    enum { keys = 10 * 1000 };
+    static bool ref[keys];
+    kvm(uint32_t, uint32_t) m;
+    kvm_alloc(&m, 4);
+    swear(kvm_bloom(&m, true));
+    for (int step = 0; step < 400 * 1000; step++) {
+        const uint32_t key = (uint32_t)(random64(&seed) % keys);
+        if (step == 200 * 1000) { swear(kvm_tombstones(&m, true)); }
+        if (step == 300 * 1000) { swear(kvm_tombstones(&m, false)); }
+        // phases: fill up to keys, drain to shrink, fill again
+        const uint64_t r = random64(&seed) % 8;
+        const bool put = (step / 50000) % 2 == 0 ? r != 0 : r == 0;
+        if (put) {
+            swear(kvm_put(&m, key, key * 3));
+            ref[key] = true;
+        } else {
+            swear(kvm_delete(&m, key) == ref[key]);
+            ref[key] = false;
+        }
+        if (step % 1000 == 0) {
+            for (uint32_t k = 0; k < keys; k++) {
+                const uint32_t* v = kvm_get(&m, k);
+                swear(ref[k] ? v != null && *v == k * 3 : v == null);
+            }
+        }
+    }
+    swear(kvm_bloom(&m, false));
+    struct kvm_stats st;
+    kvm_stats(&m, &st, 0);
+    swear(st.other_bytes == 0);
+    kvm_free(&m);
+    kvs(uint64_t) s;
+    kvs_alloc(&s, 4);
+    swear(kvs_bloom(&s, true));
+    for (uint64_t key = 0; key < 1000; key++) { swear(kvs_add(&s, key * 2)); }
+    for (uint64_t key = 0; key < 2000; key++) {
+        swear(kvs_contains(&s, key) == (key % 2 == 0));
+    }
+    kvs_free(&s);
+    static const double misses[] = { 0, 0.5, 0.9, 0.99 };
+    for (size_t i = 0; i < sizeof(misses) / sizeof(misses[0]); i++) {
+        test17_bench(misses[i]);
+    }
+    return 0;
+}
+
+typedef struct { int64_t key; double val; } test18_pair;
+
+static int test18_compare(const void* a, const void* b) {
+    const int64_t x = ((const test18_pair*)a)->key;
+    const int64_t y = ((const test18_pair*)b)->key;
+    return x < y ? -1 : x > y;
+}
+
+static void test18_bench(size_t n) {
+    // nightly dump: iterate, copy and qsort against kvm_export_sorted()
+    kvm(uint64_t, double) m;
+    kvm_alloc(&m, 4);
+    uint64_t r = 1;
+    for (size_t i = 0; i < n; i++) { kvm_put(&m, random64(&r) >> 1, (double)i); }
+    test18_pair* pairs = malloc(m.n * sizeof(pairs[0]));
+    uint64_t* keys = malloc(m.n * sizeof(keys[0]));
+    double*   vals = malloc(m.n * sizeof(vals[0]));
+    swear(pairs && keys && vals);
+    uint64_t t = nanoseconds();
+    size_t count = 0;
+    struct kvm_iterator iterator = kvm_iterator(&m);
+    while (kvm_has_next(&iterator)) {
+        double val = 0;
+        const uint64_t key = *kvm_next_entry(&m, &iterator, &val);
+        pairs[count++] = (test18_pair){ (int64_t)key, val };
+    }
+    qsort(pairs, count, sizeof(pairs[0]), test18_compare);
+    const double qs = (nanoseconds() - t) * 1e-6;
+    printf("%8zd entries iterate+qsort: %7.1fms", n, qs);
+    static const size_t threads[] = { 1, 2, 4, 8 };
+    for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+        t = nanoseconds();
+        swear(kvm_export_sorted(&m, keys, vals, threads[i]));
+        const double ms = (nanoseconds() - t) * 1e-6;
+        printf(" threads %zd: %6.1fms", threads[i], ms);
+        for (size_t j = 0; j < count; j += 997) {
+            swear(keys[j] == (uint64_t)pairs[j].key && vals[j] == pairs[j].val);
+        }
+    }
+    printf("\n");
+    free(pairs); free(keys); free(vals);
+    kvm_free(&m);
+}
+
+static int test18(void) {
+    // sorted columns against qsort of iterated entries
+    enum { n = 100 * 1000 };
+    static test18_pair pairs[n];
+    static int32_t keys[n];
+    static double  vals[n];
+    kvm(int32_t, double) m;
+    kvm_alloc(&m, 4);
+    for (int i = 0; i < n; i++) {
+        const int32_t key = (int32_t)(random64(&seed) % (2 * n)) - n;
+        if (i % 5 == 4) {
+            kvm_delete(&m, key);
+        } else {
+            kvm_put(&m, key, key * 0.5);
+        }
+    }
+    size_t count = 0;
+    struct kvm_iterator iterator = kvm_iterator(&m);
+    while (kvm_has_next(&iterator)) {
+        double val = 0;
+        const int32_t key = *kvm_next_entry(&m, &iterator, &val);
+        pairs[count++] = (test18_pair){ key, val };
+    }
+    qsort(pairs, count, sizeof(pairs[0]), test18_compare);
+    for (size_t threads = 1; threads <= 4; threads++) {
+        memset(keys, 0, sizeof(keys));
+        swear(kvm_export_sorted(&m, keys, vals, threads));
+        for (size_t i = 0; i < count; i++) {
+            swear(keys[i] == pairs[i].key && vals[i] == pairs[i].val);
+        }
+    }
+    swear(kvm_export_sorted(&m, keys, null, 2)); // keys only
+    swear(keys[0] == pairs[0].key && keys[count - 1] == pairs[count - 1].key);
+    kvm_free(&m);
+    // sets and fixed maps, unsigned keys above INT16_MAX order last
+    kvs(uint16_t, 16) s;
+    kvs_init(&s);
+    const uint16_t set[] = { 40000, 7, 65535, 0, 300 };
+    for (size_t i = 0; i < countof(set); i++) { kvs_add(&s, set[i]); }
+    uint16_t sorted[countof(set)];
+    swear(kvs_export_sorted(&s, sorted, 1));
+    const uint16_t order[] = { 0, 7, 300, 40000, 65535 };
+    swear(memcmp(sorted, order, sizeof(order)) == 0);
+    kvs_clear(&s);
+    swear(kvs_export_sorted(&s, sorted, 1)); // empty
+    // double keys in numeric order, negative zero first
+    kvs(double, 16) r;
+    kvs_init(&r);
+    const double real[] = { 2.5, -0.0, -1e300, 0.0, 1e-300, -2.5, 1.0 };
+    for (size_t i = 0; i < countof(real); i++) { kvs_add(&r, real[i]); }
+    double reals[countof(real)];
+    swear(kvs_export_sorted(&r, reals, 1));
+    const double ascending[] = { -1e300, -2.5, -0.0, 0.0, 1e-300, 1.0, 2.5 };
+    swear(memcmp(reals, ascending, sizeof(ascending)) == 0);
+    test18_bench(1024 * 1024);
+    if (tests_large) { test18_bench(8 * 1024 * 1024); }
+    return 0;
+}
+
+static void test19_bench(size_t n) {
+    // build once, read for hours: live map against frozen copy
+    uint64_t* keys = malloc(n * sizeof(keys[0]));
+    swear(keys);
+    kvm(uint64_t, uint64_t) m;
+    kvm_alloc(&m, 4);
+    uint64_t r = 1;
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = random64(&r);
+        kvm_put(&m, keys[i], i);
+    }
+    kvm_frozen(uint64_t, uint64_t) f;
+    uint64_t t = nanoseconds();
+    swear(kvm_freeze(&m, &f));
+    const double build = (nanoseconds() - t) * 1e-9;
+    for (size_t i = 0; i < n; i++) { // random order
+        const size_t j = random64(&r) % n;
+        const uint64_t swap = keys[i]; keys[i] = keys[j]; keys[j] = swap;
+    }
+    uint64_t sum[2] = {0};
+    t = nanoseconds();
+    for (size_t i = 0; i < n; i++) { sum[0] += *kvm_get(&m, keys[i]); }
+    const double live = (nanoseconds() - t) * 1e-3 / n;
+    t = nanoseconds();
+    for (size_t i = 0; i < n; i++) { sum[1] += *kvm_frozen_get(&f, keys[i]); }
+    const double frozen = (nanoseconds() - t) * 1e-3 / n;
+    swear(sum[0] == sum[1]);
+    const double mb = 1024.0 * 1024.0;
+    const double live_mb = m.a * 16 / mb;
+    const double frozen_mb = (f.n * 16 + f.buckets * sizeof(f.pilots[0]) +
+                             (f.slots - f.n) * sizeof(f.remap[0])) / mb;
+    printf("%8zd entries kvm_freeze: %.2fs kvm_get: %.3f kvm_frozen_get: %.3f"
+           "\xCE\xBC" "s %.0fMB -> %.0fMB\n", n, build, live, frozen,
+           live_mb, frozen_mb);
+    kvm_frozen_free(&f);
+    kvm_free(&m);
+    free(keys);
+}
+
+static int test19(void) {
+    // every key is found at its value and absent keys are not
+    static const size_t sizes[] = { 0, 1, 7, 1000, 100 * 1000 };
+    for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+        kvm(uint32_t, double) m;
+        kvm_alloc(&m, 4);
+        for (size_t i = 0; i < sizes[k]; i++) {
+            kvm_put(&m, (uint32_t)(i * 7919), i * 0.5);
+        }
+        kvm_frozen(uint32_t, double) f;
+        swear(kvm_freeze(&m, &f) && f.n == m.n);
+        kvm_free(&m); // frozen copy does not refer to the map
+        for (size_t i = 0; i < sizes[k]; i++) {
+            const double* v = kvm_frozen_get(&f, (uint32_t)(i * 7919));
+            swear(v != null && *v == i * 0.5);
+            swear(kvm_frozen_get(&f, (uint32_t)(i * 7919 + 1)) == null);
+        }
+        kvm_frozen_free(&f);
+        swear(f.n == 0 && kvm_frozen_get(&f, 0) == null);
+    }
+    // entries past their deadline are not frozen
+    kvm(uint32_t, double) m;
+    kvm_alloc(&m, 4);
+    swear(kvm_expiry(&m, true, test13_clock));
+    test13_time = 100;
+    for (uint32_t i = 0; i < 100; i++) {
+        swear(kvm_put(&m, i, i) && kvm_expire_at(&m, i, 50 + i * 2));
+    }
+    kvm_frozen(uint32_t, double) f;
+    swear(kvm_freeze(&m, &f) && f.n == 74 && m.n == 100);
+    for (uint32_t i = 0; i < 100; i++) {
+        const double* v = kvm_frozen_get(&f, i);
+        swear(i > 25 ? v != null && *v == i : v == null);
+    }
+    kvm_frozen_free(&f);
+    kvm_free(&m);
+    test19_bench(1024 * 1024);
+    if (tests_large) { test19_bench(10 * 1000 * 1000); }
+    return 0;
+}
+
+static void test20_add(void* val, const void* with) {
+    *(uint32_t*)val += *(const uint32_t*)with;
+}
+
+static void test20_verify(size_t n, size_t threads) {
+    // keys [0, n) of a and [n / 2, n * 3 / 2) of b overlap in half
+    kvm(uint32_t, uint32_t) a, b, u, w, i, d;
+    kvm_alloc(&a, 4); kvm_alloc(&b, 4); kvm_alloc(&u, 4); kvm_alloc(&w, 4);
+    kvm_alloc(&i, 4); kvm_alloc(&d, 4);
+    for (uint32_t k = 0; k < n; k++) { kvm_put(&a, k * 3, k); }
+    for (uint32_t k = (uint32_t)n / 2; k < n * 3 / 2; k++) {
+        kvm_put(&b, k * 3, k * 10);
+    }
+    kvm_put(&d, 1, 1); // existing entries of the destination are kept
+    swear(kvm_union(&u, &a, &b, test20_add, threads));
+    kvm_put(&w, 1, 1); // not empty: b probes a
+    swear(kvm_union(&w, &a, &b, null, threads) && w.n == u.n + 1);
+    swear(kvm_intersect(&i, &b, &a, null, threads)); // values of b
+    swear(kvm_difference(&d, &a, &b, threads));
+    swear(u.n == n * 3 / 2 && i.n == n - n / 2 && d.n == n / 2 + 1);
+    for (uint32_t k = 0; k < n * 3 / 2; k++) {
+        const bool in_a = k < n, in_b = k >= n / 2;
+        const uint32_t* v = kvm_get(&u, k * 3);
+        swear(*v == (in_a ? k : 0) + (in_b ? k * 10 : 0));
+        swear(*kvm_get(&w, k * 3) == (in_b ? k * 10 : k)); // b wins
+        v = kvm_get(&i, k * 3);
+        swear(in_a && in_b ? *v == k * 10 : v == null);
+        v = kvm_get(&d, k * 3);
+        swear(in_a && !in_b ? *v == k : v == null);
+    }
+    swear(*kvm_get(&d, 1) == 1 && *kvm_get(&w, 1) == 1);
+    kvm_free(&a); kvm_free(&b); kvm_free(&u); kvm_free(&w);
+    kvm_free(&i); kvm_free(&d);
+}
+
+static void test20_bench(size_t n) {
+    // reconciliation: intersect two tables of n random keys, half shared
+    uint64_t r = 1;
+    kvm(uint64_t, uint64_t) a, b, d;
+    kvm_alloc(&a, 4); kvm_alloc(&b, 4);
+    for (size_t k = 0; k < n; k++) {
+        const uint64_t key = random64(&r);
+        kvm_put(&a, key, k);
+        kvm_put(&b, k % 2 == 0 ? key : random64(&r), k);
+    }
+    double ms[3];
+    for (int pass = 0; pass < 3; pass++) {
+        kvm_alloc(&d, 4);
+        const uint64_t t = nanoseconds();
+        if (pass == 0) { // kvm_get over one and kvm_put into a third
+            struct kvm_iterator iterator = kvm_iterator(&a);
+            while (kvm_has_next(&iterator)) {
+                uint64_t val = 0;
+                const uint64_t key = *kvm_next_entry(&a, &iterator, &val);
+                if (kvm_get(&b, key)) { kvm_put(&d, key, val); }
+            }
+        } else {
+            swear(kvm_intersect(&d, &a, &b, null, pass == 1 ? 1 : 4));
+        }
+        ms[pass] = (nanoseconds() - t) * 1e-6;
+        swear(d.n >= n / 2);
+        kvm_free(&d);
+    }
+    printf("%9zd entries intersect get+put: %.1fms "
+           "kvm_intersect threads 1: %.1fms threads 4: %.1fms\n",
+           n, ms[0], ms[1], ms[2]);
+    kvm_free(&a); kvm_free(&b);
+}
+
+static int test20(void) {
+    test20_verify(0, 1);
+    test20_verify(1000, 1);
+    test20_verify(300 * 1000, 4); // 64K or more entries per thread
+    kvs(int8_t) x, y, z; // sets
+    kvs_alloc(&x, 4); kvs_alloc(&y, 4); kvs_alloc(&z, 4);
+    for (int k = -100; k < 100; k++) {
+        kvs_add(&x, (int8_t)k);
+        if (k % 2 == 0) { kvs_add(&y, (int8_t)k); }
+    }
+    swear(kvs_difference(&z, &x, &y, 1) && z.n == 100);
+    swear(kvs_contains(&z, -99) && !kvs_contains(&z, -100));
+    kvs_clear(&z);
+    swear(kvs_intersect(&z, &x, &y, 1) && z.n == 100);
+    swear(kvs_union(&z, &x, &y, 1) && z.n == 200);
+    kvs_free(&x); kvs_free(&y); kvs_free(&z);
+    test20_bench(1024 * 1024);
+    if (tests_large) { test20_bench(8 * 1024 * 1024); }
+    return 0;
+}
+
+static void test21_latency(size_t n, bool grow) {
+    // per operation latency: grow spikes show up in p99.9 and max
+    static rt_histogram_t put, get, del;
+    rt_histogram_init(&put);
+    rt_histogram_init(&get);
+    rt_histogram_init(&del);
+    uint64_t r = 1;
+    kvm(uint64_t, uint64_t) m;
+    kvm_alloc(&m, grow ? 4 : n + n / 4);
+    for (size_t i = 0; i < n; i++) {
+        const uint64_t key = random64(&r);
+        const uint64_t t = rt_ticks();
+        kvm_put(&m, key, i);
+        rt_histogram_record(&put, rt_ticks() - t);
+    }
+    r = 1;
+    for (size_t i = 0; i < n; i++) {
+        const uint64_t key = random64(&r);
+        const uint64_t t = rt_ticks();
+        uint64_t* v = kvm_get(&m, key);
+        rt_histogram_record(&get, rt_ticks() - t);
+        swear(v != null && *v == i);
+    }
+    r = 1;
+    for (size_t i = 0; i < n; i++) {
+        const uint64_t key = random64(&r);
+        const uint64_t t = rt_ticks();
+        bool deleted = kvm_delete(&m, key);
+        rt_histogram_record(&del, rt_ticks() - t);
+        swear(deleted);
+    }
+    swear(m.n == 0);
+    kvm_free(&m);
+    const double ns = rt_tick_ns();
+    printf("%zd entries %s (nanoseconds):\n", n, grow ? "growing" : "presized");
+    rt_histogram_println("kvm_put   ", &put, ns);
+    rt_histogram_println("kvm_get   ", &get, ns);
+    rt_histogram_println("kvm_delete", &del, ns);
+}
+
+static int test21(void) {
+    static rt_histogram_t h, g;
+    rt_histogram_init(&h);
+    rt_histogram_init(&g);
+    swear(rt_histogram_percentile(&h, 50) == 0);
+    for (uint64_t v = 1; v <= 100000; v++) { rt_histogram_record(&h, v); }
+    swear(h.count == 100000 && h.min == 1 && h.max == 100000);
+    for (int i = 0; i < 3; i++) {
+        const double p[] = { 50, 99, 99.9 };
+        const double x = (double)rt_histogram_percentile(&h, p[i]);
+        const double e = p[i] * 1000;
+        swear(e <= x && x <= e * 1.016);
+    }
+    swear(rt_histogram_percentile(&h, 100) == 100000);
+    for (uint64_t v = 0; v < 100; v++) { rt_histogram_record(&g, v); }
+    swear(rt_histogram_percentile(&g, 50) == 49); // exact below 128
+    rt_histogram_record(&g, UINT64_MAX);
+    rt_histogram_merge(&h, &g);
+    swear(h.count == 100101 && h.min == 0 && h.max == UINT64_MAX);
+    const uint64_t t = rt_ticks();
+    swear(rt_ticks() >= t && rt_tick_ns() > 0);
+    test21_latency(1024 * 1024, false);
+    test21_latency(1024 * 1024, true);
+    return 0;
+}
+
+static int test22(void) {
+    // eight keys with the same home slot form one cluster of eight
+    kvm(uint64_t, uint64_t, 64) f;
+    kvm_init(&f);
+    struct kvm_stats s;
+    kvm_stats(&f, &s, 0);
+    swear(s.capacity == 64 && s.clusters == 0 && s.miss_mean == 1.0);
+    for (uint64_t key = 0; f.n < 8; key++) {
+        if (kvm_hash_key(&f, key) % 64 == 5) { kvm_put(&f, key, key); }
+    }
+    kvm_stats(&f, &s, 0);
+    swear(s.n == 8 && s.sampled == 64 && s.hit_mean == 4.5 && s.hit_max == 8);
+    swear(s.clusters == 1 && s.cluster_max == 8 && s.cluster[3] == 1);
+    swear(s.miss_max == 9 && s.miss_mean == (44.0 + 56.0) / 64);
+    swear(s.key_bytes == 64 * 8 && s.val_bytes == 64 * 8 && s.grows == 0);
+    // sampling a huge table estimates the same probe lengths
+    enum { n = 1024 * 1024 };
+    kvm(uint64_t, uint64_t) m;
+    kvm_alloc(&m, 4);
+    uint64_t r = 1;
+    for (size_t i = 0; i < n; i++) { kvm_put(&m, random64(&r), i); }
+    struct kvm_stats all, part;
+    uint64_t t = nanoseconds();
+    kvm_stats(&m, &all, 0);
+    const double full = (nanoseconds() - t) * 1e-6;
+    t = nanoseconds();
+    kvm_stats(&m, &part, 64 * 1024);
+    const double sampled = (nanoseconds() - t) * 1e-6;
+    swear(all.n == n && all.sampled == all.capacity && all.grows > 0);
+    swear(64 * 1024 <= part.sampled && part.sampled < 80 * 1024);
+    swear(fabs(part.hit_mean - all.hit_mean) < all.hit_mean / 10);
+    swear(fabs(part.miss_mean - all.miss_mean) < all.miss_mean / 5);
+    printf("%zd entries load %.2f grows %zd hit mean %.2f max %zd "
+           "miss mean %.2f max %zd clusters %zd max %zd: %.1fms\n",
+           all.n, all.load, all.grows, all.hit_mean, all.hit_max,
+           all.miss_mean, all.miss_max, all.clusters, all.cluster_max, full);
+    printf("%zd slots sampled: hit mean %.2f miss mean %.2f: %.1fms\n",
+           part.sampled, part.hit_mean, part.miss_mean, sampled);
+    kvm_free(&m);
+    return 0;
+}
+
 int kvm_tests(void) {
     kvm_fatalist  = true;
-    return test0() || test1() || test2() || test3() ||  test4() || test5();
+    return test0() || test1() || test2() || test3() ||  test4() || test5() ||
+           test6() || test7() || test8() || test9() || test10() ||
+           test11() || test12() || test13() || test14() || test15() ||
+           test16() || test17() || test18() || test19() || test20() ||
+           test21() || test22();
 }
 
 #define kvm_implementation
@@ -4,7 +4,6 @@
     # Usage:
 
     For all maps initial number of key value pair entries must be >= 4.
-    kvm() does not support iterators
 
     kvm_fatalist = true; // errors will raise SIGABRT before returning false
 
@@ -39,6 +38,115 @@
 
     kvm_clear(m); // removes all entries from the map
 
+    ## Updating in place:
+
+    bool inserted = false;
+    value_type* v = kvm_get_or_insert(m, key, &inserted); // null on failure
+    if (v) { *v += 1; } // new values are zero initialized
+
+    static void add(void* val, const void* with) {
+        *(uint64_t*)val += *(const uint64_t*)with;
+    }
+    bool kvm_upsert(m, key, 1, add); // puts 1 or calls add(val, &1)
+
+    Both probe the table once. The value pointer is valid until the next
+    insert or delete. inserted may be null. kvm_put() of an existing key
+    only writes the value.
+
+    ## Iterating:
+
+    struct kvm_iterator iterator = kvm_iterator(m);
+    while (kvm_has_next(&iterator)) {
+        value_type val;
+        key_type key = *kvm_next_entry(m, &iterator, &val);
+    }
+
+    kvm_next(m, &iterator) returns only the key pointer.
+    Iteration order is slot order (not insertion order). Inserting new
+    keys or deleting keys during iteration is fatal; replacing values
+    of existing keys is allowed.
+
+    ## Precomputed hashes:
+
+    uint64_t h = kvm_hash_key(m, key); // hash once
+
+    value_type* v = kvm_get_hashed(m, key, h);
+    bool kvm_put_hashed(m, key, value, h);
+    bool kvm_delete_hashed(m, key, h);
+
+    The hash does not depend on map capacity or instance and can be
+    reused for the same key with any kvm() or map() of the same key type
+    (map() with const char* keys hashes strings differently).
+    Passing a hash not obtained from kvm_hash_key() for the same key
+    is undefined behavior.
+
+    ## Erasing by predicate:
+
+    static bool expired(void* context, const void* key, void* val) {
+        return ((const session_t*)val)->deadline < *(uint64_t*)context;
+    }
+    size_t erased = kvm_erase_if(m, expired, &now);
+
+    Single sweep over the table, clusters are compacted in place.
+    pred must not modify the map. It is called once per entry except on
+    a full fixed map: the first matching entry is deleted to make room
+    for the sweep and the entries before it are passed to pred twice.
+
+    ## Sorted export:
+
+    uint64_t keys[m.n]; // any storage for m.n keys and values
+    double   vals[m.n];
+    bool kvm_export_sorted(m, keys, vals, threads); // vals may be null
+
+    Copies all entries into key and value columns in ascending key order
+    (signed or unsigned integer order of the key type, float and double
+    keys in numeric order with -0.0 before +0.0). Occupied slots are
+    gathered from the bitmap and sorted with a stable LSD radix sort
+    (8 bits per pass, passes where all keys share the digit are skipped)
+    on up to `threads` threads. Allocates scratch columns of m.n entries.
+    kvs_export_sorted(s, keys, threads) exports sets.
+
+    ## Set algebra:
+
+    bool kvm_union(d, a, b, merge, threads);      // d gets a and b
+    bool kvm_intersect(d, a, b, merge, threads);  // keys of a also in b
+    bool kvm_difference(d, a, b, threads);        // keys of a not in b
+
+    Result entries are put into d (existing entries of d are kept), d must
+    be neither a nor b. Values come from a; for keys in both maps
+    merge(val, &b_val) is called on the value in d, null merge means the
+    value of b wins for kvm_union() and a wins for kvm_intersect().
+    kvm_union() puts all of a into d and then iterates b. Into an empty
+    d that is not a kvm_cache() the put of each key of b tells whether
+    it came from a, so a is not probed. kvm_intersect() iterates the
+    smaller map and kvm_difference() iterates a. Both, and kvm_union()
+    into a d that already had entries, probe the other map through its
+    bitmap in batches of 16 keys whose home slots are prefetched first.
+    Heap maps d are reserved for the result size upfront. threads > 1
+    probe in parallel (64K entries per thread at least) while a single
+    thread inserts into d. kvs_union(d, a, b, threads), kvs_intersect() and
+    kvs_difference() are the same for sets.
+
+    ## Tombstones:
+
+    bool kvm_tombstones(m, true); // O(1) kvm_delete() for delete heavy maps
+    bool kvm_tombstones(f, true, bitmap); // fixed map f
+
+    In tombstone mode kvm_delete() marks the slot as deleted instead of
+    shifting the rest of the cluster back. kvm_put() reuses tombstones.
+    Tombstones are purged in place when they exceed 1/4 of capacity or
+    when live entries plus tombstones reach the load limit, on grow,
+    on kvm_tombstones(m, false) or on explicit call to:
+
+    size_t kvm_compact(m); // returns number of purged tombstones
+
+    Fixed size maps in tombstone mode hold at most capacity - 1 entries
+    and take caller storage uint64_t bitmap[kvm_tombstones_words(capacity)]
+    that outlives the tombstone mode (fixed maps do not carry it).
+    State of optional modes (tombstones, cache, expiry, Bloom filter,
+    load factors, huge pages) lives in a small block allocated on first
+    use, so kvm_free() releases it for fixed maps too.
+
     ## To create a dynamically allocated map on the heap:
 
     kvm(int, double) m; // the map allocated on the heap and will grow
@@ -48,6 +156,134 @@
     // map will automatically grow as key-value pairs are added
 
     kvm_free(m); // must be called to free memory for heap allocated maps
+
+    ## Capacity of heap maps:
+
+    bool kvm_reserve(m, n);     // n entries will fit without growing
+    bool kvm_shrink_to_fit(m);  // minimum capacity for current entries
+
+    // max load 75%, grow by 150%, shrink below 18% load (0 never):
+    bool kvm_load_factors(m, 75, 150, 18); // defaults, all in percents
+
+    Map grows when entries reach max load and shrinks on kvm_delete()
+    when entries fall below the low-water mark. The map never shrinks
+    below the initial capacity of kvm_alloc() or kvm_reserve().
+    Fixed size maps ignore load factors.
+
+    ## Huge pages:
+
+    bool kvm_huge_pages(m, true, populate); // heap maps only
+
+    Arrays of 2MB and larger are allocated 2MB aligned with mmap() and
+    madvise(MADV_HUGEPAGE) on Linux (transparent huge pages must be
+    "always" or "madvise" in /sys/kernel/mm/transparent_hugepage/enabled)
+    or VirtualAlloc(MEM_LARGE_PAGES) on Windows (requires
+    SeLockMemoryPrivilege, falls back to regular pages). populate
+    pre-faults new arrays so page faults do not happen on first touch.
+    Existing arrays are moved to the new kind of memory immediately.
+
+    ## Expiry:
+
+    bool kvm_expiry(m, true, clock);    // heap maps only, clock may be null
+    bool kvm_expire_at(m, key, deadline); // false if key is not present
+    size_t kvm_expire(m, now); // removes entries with deadline <= now
+
+    Deadlines are absolute times in any units (e.g. milliseconds) and 0
+    means no expiry. kvm_put() of a new key sets no deadline, replacing
+    the value keeps it. Deadlines are kept in a hierarchical timing wheel
+    (11 levels of 64 buckets) so kvm_expire() costs amortized O(expired)
+    instead of O(capacity). With a clock kvm_get() also treats entries
+    past their deadline as missing before kvm_expire() removes them and
+    kvm_put() of such a key clears its deadline. Without a clock call
+    kvm_expire(m, now) once before setting deadlines so the wheel starts
+    at current time. Iterators still see entries until they are removed.
+    Costs 16 bytes per slot.
+
+    ## Cache:
+
+    bool kvm_cache(m, n, evict, context); // at most n entries, 0 turns off
+    bool kvm_cache(f, n, evict, context, counters); // fixed map f
+
+    kvm_put() of a new key into a map holding n entries evicts another
+    entry after calling evict(context, key, val) if evict is not null.
+    Eviction is CLOCK with 2-bit reference counters per slot (1/4 byte
+    per slot, no list links): kvm_get() and kvm_put() of existing keys
+    increment the counter up to 3, so hits on hot entries do not write.
+    The hand visits slots in scattered order, decrements not zero
+    counters and evicts the first entry with zero counter. Heap maps
+    reserve room for n entries and do not grow, fixed maps require n
+    less than the capacity that fits and caller storage for counters:
+    uint64_t counters[kvm_cache_words(capacity)] that outlives the cache
+    mode (fixed maps do not carry it). Call kvm_tombstones(m, true)
+    before kvm_cache() to make evictions O(1) for extra n / 4 slots.
+
+    ## Bloom filter:
+
+    bool kvm_bloom(m, on); // heap maps only
+
+    kvm_get(), kvm_delete() and kvs_contains() of absent keys are answered
+    by one cache line of a blocked Bloom filter (1 byte per slot) without
+    probing keys. kvm_put() adds keys to the filter. Deleted keys stay in
+    the filter until it is rebuilt on grow, shrink, tombstone purge or
+    after deletions of a quarter of the capacity. Pays off when most
+    lookups miss in tables larger than the CPU caches.
+
+    ## Sets:
+
+    kvs(uint64_t, 16) s; // fixed size set, kvs(uint64_t) heap allocated
+    bool kvs_init(s);    // or kvs_alloc(s, 16) for heap sets
+    bool kvs_add(s, key);      // true if key was not present
+    bool kvs_contains(s, key);
+    bool kvs_remove(s, key);   // true if key was present
+    kvs_free(s);
+
+    Keys only: no value array is allocated, copied or probed.
+    kvs_capacity(), kvs_clear(), kvs_reserve(), kvs_tombstones(),
+    kvs_iterator(), kvs_has_next() and kvs_next() are the same as
+    for kvm().
+
+    ## Frozen maps:
+
+    kvm_frozen(uint64_t, double) f; // same key and value types as the map
+    bool kvm_freeze(m, &f);         // m is not modified and stays usable
+    const double* v = kvm_frozen_get(&f, key); // null if absent
+    kvm_frozen_free(&f);
+
+    Read-only copy of the map for build once, read for hours tables.
+    Keys and values are stored densely in n slots placed by a minimal
+    perfect hash (PTHash style: a 32-bit pilot per bucket of ~5 keys),
+    so a lookup reads one pilot and one key slot, with no probing. About
+    5% of keys take one more read through a remap table. Costs ~10 bits
+    per key on top of keys and values. Uses the map's allocator.
+
+    ## Statistics:
+
+    struct kvm_stats s;
+    kvm_stats(m, &s, 0);         // examines every slot
+    kvm_stats(m, &s, 64 * 1024); // examines ~64K slots of huge tables
+
+    Reports capacity, live entries, tombstones, load, mean and max
+    number of slots probed by kvm_get() of present (hit) and absent
+    (miss) keys, number and length histogram of clusters (runs of not
+    empty slots, cluster[i] counts lengths 2^i..2^(i+1)-1), bytes used
+    by each array and the number of times the map grew. Read only: it
+    neither modifies the map nor touches kvm_cache() counters. With
+    sample != 0 only windows of 1024 slots spread over the table (whole
+    clusters) are examined; probe and cluster figures describe these
+    `sampled` slots. Long clusters and growing hit/miss means at the
+    same load indicate clustering of keys by the hash.
+    kvs_stats(s, &stats, sample) is the same for sets.
+
+    ## Allocators:
+
+    struct kvm_allocator arena = { alloc, zalloc, free, context };
+    bool kvm_alloc_with(m, 16, &arena); // heap map in caller's memory
+
+    kvm_global_allocator = &arena; // used by subsequent kvm_alloc() calls
+
+    free(context, p, bytes) receives the size passed to alloc()/zalloc().
+    Null kvm_global_allocator (default) is malloc()/calloc()/free().
+    Huge pages apply to the default allocator only.
 */
 
 #include <signal.h>
@@ -58,39 +294,197 @@
 
 bool kvm_fatalist; // any of kvm errors are fatal
 
-#define kvm_struct(tk, tv, _n_)                         \
-    struct {                                            \
+struct kvm_allocator {
+    void* (*alloc)(void* context, size_t bytes);
+    void* (*zalloc)(void* context, size_t bytes); // zero initialized
+    void  (*free)(void* context, void* p, size_t bytes);
+    void* context;
+};
+
+const struct kvm_allocator* kvm_global_allocator; // null: malloc()/free()
+
+struct _kvm_wheel; // timing wheel of kvm_expiry()
+struct _kvm_ext;   // state of optional modes
+
+struct kvm_iterator {
+    size_t   next; /* index of next occupied slot or capacity */
+    size_t   c;    /* capacity */
+    void*    m;    /* map */
+    uint64_t mc;   /* modification count */
+};
+
+// fields shared by kvm() maps and kvs() sets (values are absent in sets):
+
+#define _kvm_fields(_n_)                                \
         uint8_t*  pv;                                   \
         uint8_t*  pk;                                   \
         uint64_t* bm;                                   \
         size_t    a;  /* allocated capacity */          \
         size_t    n;  /* number of not empty entries */ \
-        uint64_t  bitmap[(((_n_ + 7) / 8)|1)];          \
+        uint64_t  mc; /* modification count */          \
+        size_t    r;  /* reserved capacity */           \
+        size_t    grows; /* times the map grew */       \
+        const struct kvm_allocator* allocator;          \
+        struct _kvm_ext* ext; /* optional modes or 0 */ \
+        uint64_t  bitmap[(((_n_ + 7) / 8)|1)];
+
+#define kvm_struct(tk, tv, _n_)                         \
+    struct {                                            \
+        _kvm_fields(_n_)                                \
         tv v[(_n_ + (_n_ == 0))];                       \
         tk k[(_n_ + (_n_ == 0))];                       \
 }
 
+#define kvs_struct(tk, _n_)                             \
+    struct {                                            \
+        _kvm_fields(_n_)                                \
+        tk k[(_n_ + (_n_ == 0))];                       \
+}
+
+#define kvm_frozen_struct(tk, tv)                       \
+    struct {                                            \
+        uint8_t*  pk;      /* n dense keys */           \
+        uint8_t*  pv;      /* n dense values */         \
+        uint32_t* pilots;  /* one per bucket */         \
+        size_t*   remap;   /* slots >= n to holes < n */ \
+        size_t    n;       /* number of entries */      \
+        size_t    slots;   /* hash range >= n */        \
+        size_t    buckets;                              \
+        const struct kvm_allocator* allocator;          \
+        tk* k; /* key type only, never allocated */     \
+        tv* v; /* val type only, never allocated */     \
+}
+
+#define kvm_frozen(tk, tv) kvm_frozen_struct(tk, tv)
+
+enum { kvm_stats_clusters = 24 };
+
+struct kvm_stats {
+    size_t capacity;     // slots
+    size_t n;            // live entries
+    size_t tombstones;
+    double load;         // n / capacity
+    size_t sampled;      // slots examined: capacity unless sampling
+    double hit_mean;     // slots probed by kvm_get() of present keys
+    size_t hit_max;
+    double miss_mean;    // slots probed by kvm_get() of absent keys
+    size_t miss_max;
+    size_t clusters;     // runs of not empty slots
+    size_t cluster_max;  // longest run
+    size_t cluster[kvm_stats_clusters]; // [i] runs of 2^i..2^(i+1)-1 slots
+    size_t key_bytes;
+    size_t val_bytes;
+    size_t bitmap_bytes; // occupancy, tombstones and kvm_cache() counters
+    size_t other_bytes;  // kvm_bloom() filter and kvm_expiry() wheel
+    size_t grows;        // times the map grew
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 bool _kvm_init(void* mv, size_t kb, size_t vb, size_t n,
-               void* k, void* v, size_t c);
+               void* k, void* v, size_t c,
+               const struct kvm_allocator* allocator);
+
+uint64_t _kvm_hash_key(const void* pkey, const size_t kb);
 
 bool _kvm_put(void* mv, const size_t c,
               const size_t kb, const size_t vb,
               const void* pkey, const void* pval);
 
+bool _kvm_put_hashed(void* mv, const size_t c,
+                     const size_t kb, const size_t vb,
+                     const void* pkey, const void* pval, uint64_t hash);
+
 const void* _kvm_get(const void* mv, const size_t c,
                      const size_t kb, const size_t vb,
                      const void* pkey);
 
+const void* _kvm_get_hashed(const void* mv, const size_t c,
+                            const size_t kb, const size_t vb,
+                            const void* pkey, uint64_t hash);
+
+void* _kvm_get_or_insert(void* mv, const size_t c,
+                         const size_t kb, const size_t vb,
+                         const void* pkey, bool* inserted);
+
+bool _kvm_upsert(void* mv, const size_t c,
+                 const size_t kb, const size_t vb,
+                 const void* pkey, const void* pval,
+                 void (*merge)(void* val, const void* with));
+
 bool _kvm_delete(void* mv, const size_t c,
                  size_t kb, size_t vb, const void* pkey);
 
+bool _kvs_add(void* mv, const size_t c, const size_t kb, const void* pkey);
+
+bool _kvs_contains(const void* mv, const size_t c, const size_t kb,
+                   const void* pkey);
+
+bool _kvm_delete_hashed(void* mv, const size_t c,
+                        size_t kb, size_t vb, const void* pkey,
+                        uint64_t hash);
+
+struct kvm_iterator _kvm_iterator(void* mv, size_t c);
+
+bool kvm_has_next(struct kvm_iterator* iterator);
+
+void* _kvm_next(struct kvm_iterator* iterator, size_t kb, size_t vb,
+                void* pval);
+
+size_t _kvm_erase_if(void* mv, size_t c, size_t kb, size_t vb,
+        bool (*pred)(void* context, const void* key, void* val),
+        void* context);
+
+bool _kvm_export_sorted(const void* mv, size_t c, size_t kb, size_t vb,
+                        int sign, void* keys, void* vals, size_t threads);
+
+bool _kvm_combine(void* dv, size_t cd, const void* av, size_t ca,
+                  const void* bv, size_t cb, size_t kb, size_t vb, int op,
+                  void (*merge)(void* val, const void* with), size_t threads,
+                  bool same_types);
+
+bool _kvm_tombstones(void* mv, size_t c, size_t kb, size_t vb,
+                     void* tombs, bool on);
+
+size_t _kvm_compact(void* mv, size_t c, size_t kb, size_t vb);
+
+bool _kvm_reserve(void* mv, size_t c, size_t kb, size_t vb, size_t n);
+
+bool _kvm_shrink_to_fit(void* mv, size_t kb, size_t vb);
+
+bool _kvm_load_factors(void* mv, size_t load, size_t growth, size_t low);
+
+bool _kvm_huge_pages(void* mv, size_t kb, size_t vb, bool on, bool populate);
+
+bool _kvm_expiry(void* mv, bool on, uint64_t (*clock)(void));
+
+bool _kvm_expire_at(void* mv, const size_t c, size_t kb, size_t vb,
+                    const void* pkey, uint64_t deadline);
+
+size_t _kvm_expire(void* mv, size_t kb, size_t vb, uint64_t now);
+
+bool _kvm_cache(void* mv, size_t c, size_t kb, size_t vb, void* refs,
+        size_t n, void (*evict)(void* context, const void* key, void* val),
+        void* context);
+
+bool _kvm_bloom(void* mv, size_t c, size_t kb, bool on);
+
+void _kvm_stats(const void* mv, size_t c, size_t kb, size_t vb,
+                struct kvm_stats* s, size_t sample);
+
 void _kvm_clear(void* mv, size_t c);
 
-void _kvm_free(void* mv, size_t c);
+void _kvm_free(void* mv, size_t c, size_t kb, size_t vb);
+
+bool _kvm_freeze(const void* mv, size_t c, size_t kb, size_t vb,
+                 void* fv, bool same_types);
+
+const void* _kvm_frozen_get(const void* fv, size_t kb, size_t vb,
+                            const void* pkey);
+
+void _kvm_frozen_free(void* fv, size_t kb, size_t vb);
 
 #ifdef __cplusplus
 } // extern "C"
@@ -102,8 +496,8 @@ void _kvm_free(void* mv, size_t c);
 #define _kvm_chooser(...) _kvm_get_4th_arg(__VA_ARGS__, _kvm_3_arg, _kvm_2_arg, )
 #define kvm(...) _kvm_chooser(__VA_ARGS__)(__VA_ARGS__)
 
-#define _kvm_alloc_and_init(m, n) \
-    _kvm_init(m, _kvm_kb(m), _kvm_vb(m), n, &(m)->k, &(m)->v, _kvm_fixed_c(m))
+#define _kvm_alloc_and_init(m, n) _kvm_init(m, _kvm_kb(m), _kvm_vb(m), \
+    n, &(m)->k, &(m)->v, _kvm_fixed_c(m), kvm_global_allocator)
 
 
 #define _kvm_init_1_arg(m)    _kvm_alloc_and_init(m, 0)
@@ -114,6 +508,9 @@ void _kvm_free(void* mv, size_t c);
 #define kvm_alloc(...) _kvm_init_chooser(__VA_ARGS__)(__VA_ARGS__)
 #define kvm_init(m)    _kvm_alloc_and_init(m, 0)
 
+#define kvm_alloc_with(m, n, allocator) _kvm_init(m, _kvm_kb(m), _kvm_vb(m), \
+    n, &(m)->k, &(m)->v, _kvm_fixed_c(m), allocator)
+
 #define _kvm_tk(m) typeof((m)->k[0]) // type of key
 #define _kvm_tv(m) typeof((m)->v[0]) // type of val
 
@@ -128,7 +525,7 @@ void _kvm_free(void* mv, size_t c);
 #define kvm_capacity(m) ((m)->a > 0 ? (m)->a : _kvm_fixed_c(m))
 
 #define kvm_clear(m) _kvm_clear(m, _kvm_fixed_c(m))
-#define kvm_free(m)  _kvm_free(m,  _kvm_fixed_c(m))
+#define kvm_free(m)  _kvm_free(m,  _kvm_fixed_c(m), _kvm_kb(m), _kvm_vb(m))
 
 #define kvm_put(m, key, val) _kvm_put(m, kvm_capacity(m), \
     _kvm_kb(m), _kvm_vb(m), _kvm_ka(m, key), _kvm_va(m, val))
@@ -139,12 +536,211 @@ void _kvm_free(void* mv, size_t c);
 #define kvm_delete(m, key) _kvm_delete(m, kvm_capacity(m), \
     _kvm_kb(m), _kvm_vb(m), _kvm_ka(m, key))
 
+#define kvm_get_or_insert(m, key, inserted) (_kvm_tv(m)*)_kvm_get_or_insert(m, \
+    kvm_capacity(m), _kvm_kb(m), _kvm_vb(m), _kvm_ka(m, key), inserted)
+
+#define kvm_upsert(m, key, init, merge) _kvm_upsert(m, kvm_capacity(m), \
+    _kvm_kb(m), _kvm_vb(m), _kvm_ka(m, key), _kvm_va(m, init), merge)
+
+#define kvm_hash_key(m, key) _kvm_hash_key(_kvm_ka(m, key), _kvm_kb(m))
+
+#define kvm_put_hashed(m, key, val, hash) _kvm_put_hashed(m,          \
+    kvm_capacity(m), _kvm_kb(m), _kvm_vb(m), _kvm_ka(m, key),         \
+    _kvm_va(m, val), hash)
+
+#define kvm_get_hashed(m, key, hash) (_kvm_tv(m)*)_kvm_get_hashed(m,  \
+    kvm_capacity(m), _kvm_kb(m), _kvm_vb(m), _kvm_ka(m, key), hash)
+
+#define kvm_delete_hashed(m, key, hash) _kvm_delete_hashed(m,         \
+    kvm_capacity(m), _kvm_kb(m), _kvm_vb(m), _kvm_ka(m, key), hash)
+
+#define kvm_iterator(m) _kvm_iterator(m, kvm_capacity(m))
+
+#define kvm_erase_if(m, pred, context) _kvm_erase_if(m, kvm_capacity(m), \
+    _kvm_kb(m), _kvm_vb(m), pred, context)
+
+// compile time key order: 1 signed integers, 2 float and double,
+// 0 unsigned and pointers
+#define _kvm_sign(m) _Generic(((m)->k[0]),                      \
+    signed char: 1, short: 1, int: 1, long: 1, long long: 1,    \
+    char: (char)-1 < 0, float: 2, double: 2, default: 0)
+
+#define kvm_export_sorted(m, keys, vals, threads) _kvm_export_sorted(m, \
+    kvm_capacity(m), _kvm_kb(m), _kvm_vb(m), _kvm_sign(m), keys, vals, threads)
+
+enum { _kvm_union = 0, _kvm_intersect = 1, _kvm_difference = 2 };
+
+#define _kvm_same_types(d, a, b)                                   \
+    (sizeof((a)->k[0]) == _kvm_kb(d) && sizeof((b)->k[0]) == _kvm_kb(d) && \
+     sizeof((a)->v[0]) == _kvm_vb(d) && sizeof((b)->v[0]) == _kvm_vb(d))
+
+#define _kvm_combine_op(d, a, b, op, merge, threads)                \
+    _kvm_combine(d, kvm_capacity(d), a, kvm_capacity(a),            \
+                 b, kvm_capacity(b), _kvm_kb(d), _kvm_vb(d), op,    \
+                 merge, threads, _kvm_same_types(d, a, b))
+
+#define kvm_union(d, a, b, merge, threads) \
+    _kvm_combine_op(d, a, b, _kvm_union, merge, threads)
+
+#define kvm_intersect(d, a, b, merge, threads) \
+    _kvm_combine_op(d, a, b, _kvm_intersect, merge, threads)
+
+#define kvm_difference(d, a, b, threads) \
+    _kvm_combine_op(d, a, b, _kvm_difference, 0, threads)
+
+#define _kvm_tombstones_2_arg(m, on) _kvm_tombstones(m, kvm_capacity(m), \
+    _kvm_kb(m), _kvm_vb(m), 0, on)
+#define _kvm_tombstones_3_arg(m, on, bitmap) _kvm_tombstones(m, \
+    kvm_capacity(m), _kvm_kb(m), _kvm_vb(m), bitmap, on)
+#define kvm_tombstones(...) _kvm_get_4th_arg(__VA_ARGS__, \
+    _kvm_tombstones_3_arg, _kvm_tombstones_2_arg, )(__VA_ARGS__)
+
+// uint64_t bitmap[kvm_tombstones_words(capacity)] of fixed maps
+#define kvm_tombstones_words(capacity) (((capacity) + 63) / 64)
+
+#define kvm_compact(m) _kvm_compact(m, kvm_capacity(m), _kvm_kb(m), _kvm_vb(m))
+
+#define kvm_reserve(m, n) _kvm_reserve(m, kvm_capacity(m), \
+    _kvm_kb(m), _kvm_vb(m), n)
+
+#define kvm_shrink_to_fit(m) _kvm_shrink_to_fit(m, _kvm_kb(m), _kvm_vb(m))
+
+#define kvm_load_factors(m, load, growth, low) \
+    _kvm_load_factors(m, load, growth, low)
+
+#define kvm_huge_pages(m, on, populate) \
+    _kvm_huge_pages(m, _kvm_kb(m), _kvm_vb(m), on, populate)
+
+#define kvm_expiry(m, on, clock) _kvm_expiry(m, on, clock)
+
+#define kvm_expire_at(m, key, deadline) _kvm_expire_at(m, kvm_capacity(m), \
+    _kvm_kb(m), _kvm_vb(m), _kvm_ka(m, key), deadline)
+
+#define kvm_expire(m, now) _kvm_expire(m, _kvm_kb(m), _kvm_vb(m), now)
+
+#define _kvm_cache_4_arg(m, n, evict, context) _kvm_cache(m, \
+    kvm_capacity(m), _kvm_kb(m), _kvm_vb(m), 0, n, evict, context)
+#define _kvm_cache_5_arg(m, n, evict, context, counters) _kvm_cache(m, \
+    kvm_capacity(m), _kvm_kb(m), _kvm_vb(m), counters, n, evict, context)
+#define _kvm_get_6th_arg(arg1, arg2, arg3, arg4, arg5, arg6, ...) arg6
+#define kvm_cache(...) _kvm_get_6th_arg(__VA_ARGS__, \
+    _kvm_cache_5_arg, _kvm_cache_4_arg, )(__VA_ARGS__)
+
+// uint64_t counters[kvm_cache_words(capacity)] of fixed kvm_cache() maps
+#define kvm_cache_words(capacity) (((capacity) + 31) / 32)
+
+#define kvm_bloom(m, on) _kvm_bloom(m, kvm_capacity(m), _kvm_kb(m), on)
+
+#define kvm_stats(m, s, sample) _kvm_stats(m, kvm_capacity(m), \
+    _kvm_kb(m), _kvm_vb(m), s, sample)
+
+#define kvm_next(m, iterator) \
+        (_kvm_tk(m)*)_kvm_next(iterator, _kvm_kb(m), _kvm_vb(m), 0)
+
+#define kvm_next_entry(m, iterator, pv) \
+        (_kvm_tk(m)*)_kvm_next(iterator, _kvm_kb(m), _kvm_vb(m), pv)
+
+#define _kvs_1_arg(tk)    kvs_struct(tk, 0)
+#define _kvs_2_arg(tk, n) kvs_struct(tk, n)
+#define kvs(...) _kvm_get_3rd_arg(__VA_ARGS__, _kvs_2_arg, _kvs_1_arg, ) \
+                 (__VA_ARGS__)
+
+#define _kvs_alloc_and_init(m, n) _kvm_init(m, _kvm_kb(m), 0, \
+    n, &(m)->k, 0, _kvm_fixed_c(m), kvm_global_allocator)
+
+#define _kvs_init_1_arg(m)    _kvs_alloc_and_init(m, 0)
+#define _kvs_init_2_arg(m, n) _kvs_alloc_and_init(m, n)
+#define kvs_alloc(...) _kvm_get_3rd_arg(__VA_ARGS__, \
+                       _kvs_init_2_arg, _kvs_init_1_arg, )(__VA_ARGS__)
+#define kvs_init(m)    _kvs_alloc_and_init(m, 0)
+
+#define kvs_capacity(m) kvm_capacity(m)
+
+#define kvs_clear(m) _kvm_clear(m, _kvm_fixed_c(m))
+#define kvs_free(m)  _kvm_free(m,  _kvm_fixed_c(m), _kvm_kb(m), 0)
+
+#define kvs_add(m, key) _kvs_add(m, kvm_capacity(m), _kvm_kb(m), \
+    _kvm_ka(m, key))
+
+#define kvs_contains(m, key) _kvs_contains(m, kvm_capacity(m), _kvm_kb(m), \
+    _kvm_ka(m, key))
+
+#define kvs_remove(m, key) _kvm_delete(m, kvm_capacity(m), _kvm_kb(m), 0, \
+    _kvm_ka(m, key))
+
+#define kvs_reserve(m, n) _kvm_reserve(m, kvm_capacity(m), _kvm_kb(m), 0, n)
+
+#define _kvs_tombstones_2_arg(m, on) _kvm_tombstones(m, kvm_capacity(m), \
+    _kvm_kb(m), 0, 0, on)
+#define _kvs_tombstones_3_arg(m, on, bitmap) _kvm_tombstones(m, \
+    kvm_capacity(m), _kvm_kb(m), 0, bitmap, on)
+#define kvs_tombstones(...) _kvm_get_4th_arg(__VA_ARGS__, \
+    _kvs_tombstones_3_arg, _kvs_tombstones_2_arg, )(__VA_ARGS__)
+
+#define kvs_bloom(m, on) kvm_bloom(m, on)
+
+#define kvm_freeze(m, f) _kvm_freeze(m, kvm_capacity(m),            \
+    _kvm_kb(m), _kvm_vb(m), f, sizeof((f)->k[0]) == _kvm_kb(m) &&  \
+    sizeof((f)->v[0]) == _kvm_vb(m))
+
+#define kvm_frozen_get(f, key) (const typeof((f)->v[0])*)           \
+    _kvm_frozen_get(f, sizeof((f)->k[0]), sizeof((f)->v[0]),       \
+                    &(typeof((f)->k[0])){(key)})
+
+#define kvm_frozen_free(f) \
+    _kvm_frozen_free(f, sizeof((f)->k[0]), sizeof((f)->v[0]))
+
+#define kvs_export_sorted(m, keys, threads) _kvm_export_sorted(m, \
+    kvm_capacity(m), _kvm_kb(m), 0, _kvm_sign(m), keys, 0, threads)
+
+#define _kvs_combine_op(d, a, b, op, threads)                       \
+    _kvm_combine(d, kvm_capacity(d), a, kvm_capacity(a),            \
+                 b, kvm_capacity(b), _kvm_kb(d), 0, op, 0, threads, \
+                 sizeof((a)->k[0]) == _kvm_kb(d) &&                 \
+                 sizeof((b)->k[0]) == _kvm_kb(d))
+
+#define kvs_union(d, a, b, threads) \
+    _kvs_combine_op(d, a, b, _kvm_union, threads)
+
+#define kvs_intersect(d, a, b, threads) \
+    _kvs_combine_op(d, a, b, _kvm_intersect, threads)
+
+#define kvs_difference(d, a, b, threads) \
+    _kvs_combine_op(d, a, b, _kvm_difference, threads)
+
+#define kvs_stats(m, s, sample) _kvm_stats(m, kvm_capacity(m), \
+    _kvm_kb(m), 0, s, sample)
+
+#define kvs_iterator(m) _kvm_iterator(m, kvm_capacity(m))
+
+#define kvs_has_next(iterator) kvm_has_next(iterator)
+
+#define kvs_next(m, iterator) \
+        (_kvm_tk(m)*)_kvm_next(iterator, _kvm_kb(m), 0, 0)
+
 #endif // kvm_h_included
 
 #if defined(kvm_implementation) && !defined(kvm_implemented)
 
 #define kvm_implemented
 
+#include <assert.h>
+#include <stdio.h> // fprintf() of fatal errors
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#elif defined(_WIN32)
+#include <Windows.h> // VirtualAlloc() CreateThread()
+#endif
+
+#if !defined(_WIN32)
+#include <pthread.h> // kvm_export_sorted()
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h> // _BitScanForward64 _mm_prefetch
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -159,22 +755,143 @@ extern "C" {
 
 // _t suffixes reserved by posix, but kvm_t is not exposed from implementation
 
-typedef kvm(void*, void*) kvm_t;
+typedef kvs(void*) kvm_t; // fields common to kvm() and kvs()
+
+// State of optional modes is allocated on the first kvm_tombstones(),
+// kvm_expiry(), kvm_cache(), kvm_bloom(), kvm_load_factors() or
+// kvm_huge_pages() call, so maps using none of them keep the header to
+// the arrays, counts and allocator touched by every operation.
+
+struct _kvm_ext {
+    uint64_t* tb;     // tombstones bitmap or null
+    size_t    t;      // number of tombstones
+    struct _kvm_wheel* wheel; // kvm_expiry()
+    uint64_t* rb;     // kvm_cache() counters
+    size_t    cache;  // kvm_cache() limit or 0
+    size_t    hand;   // kvm_cache() clock hand
+    size_t    step;   // kvm_cache() hand stride
+    void (*evict)(void* context, const void* key, void* val);
+    void*     context; // of evict()
+    uint64_t* bf;     // kvm_bloom() blocks
+    size_t    blocks; // 64 byte filter blocks
+    size_t    stale;  // deleted since rebuild
+    uint16_t  load;   // max load percent
+    uint16_t  growth; // growth percent
+    uint16_t  low;    // shrink below percent
+    uint8_t   huge;   // kvm_huge_pages()
+};
+
+static const struct _kvm_ext _kvm_ext_none = {
+    .load = 75, .growth = 150, .low = 18
+};
+
+static inline const struct _kvm_ext* _kvm_x(const kvm_t* m) {
+    // read only view: defaults when no mode was ever enabled
+    return m->ext ? m->ext : &_kvm_ext_none;
+}
 
 // `kb` key bytes sizeof(tk) key type
 // `vb` val bytes sizeof(tv) val type
 
-static bool _kvm_alloc(kvm_t* m,  size_t kb, size_t vb, size_t n) {
+enum { _kvm_huge = 1, _kvm_populate = 2 }; // _kvm_ext.huge bits
+
+#define _kvm_huge_page ((size_t)2 * 1024 * 1024)
+
+#define _kvm_bm_bytes(a) ((((a) + 63) / 64) * sizeof(uint64_t))
+
+static inline bool _kvm_is_huge(const uint8_t huge, const size_t bytes) {
+    // the same decision is made on allocate and deallocate
+    return (huge & _kvm_huge) != 0 && bytes >= _kvm_huge_page;
+}
+
+static void* _kvm_allocate(const kvm_t* m, const uint8_t huge,
+                           const size_t bytes, const bool zero) {
+    const struct kvm_allocator* allocator = m->allocator;
+    if (allocator) {
+        return zero ? allocator->zalloc(allocator->context, bytes) :
+                      allocator->alloc(allocator->context, bytes);
+    } else if (!_kvm_is_huge(huge, bytes)) {
+        return zero ? calloc(1, bytes) : malloc(bytes);
+    }
+    const size_t size = (bytes + _kvm_huge_page - 1) & ~(_kvm_huge_page - 1);
+    uint8_t* p = 0; // huge pages memory is always zero initialized
+#if defined(__linux__)
+    // over-allocate by 2MB and trim to 2MB aligned address:
+    uint8_t* r = mmap(0, size + _kvm_huge_page, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (r == MAP_FAILED) { return 0; }
+    p = (uint8_t*)(((uintptr_t)r + _kvm_huge_page - 1) &
+                   ~(uintptr_t)(_kvm_huge_page - 1));
+    if (p > r) { munmap(r, (size_t)(p - r)); }
+    const size_t tail = (size_t)(r + size + _kvm_huge_page - (p + size));
+    if (tail > 0) { munmap(p + size, tail); }
+    #if defined(MADV_HUGEPAGE)
+    (void)madvise(p, size, MADV_HUGEPAGE); // advisory, failure is benign
+    #endif
+#elif defined(_WIN32)
+    p = VirtualAlloc(0, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                     PAGE_READWRITE);
+    if (!p) { // no SeLockMemoryPrivilege
+        p = VirtualAlloc(0, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    }
+    if (!p) { return 0; }
+#else
+    p = zero ? calloc(1, bytes) : malloc(bytes);
+    if (!p) { return 0; }
+#endif
+    if (huge & _kvm_populate) { // pre-fault pages now instead of first touch
+        for (size_t i = 0; i < bytes; i += 4096) { ((volatile uint8_t*)p)[i] = 0; }
+    }
+    return p;
+}
+
+static void _kvm_deallocate(const kvm_t* m, const uint8_t huge,
+                            void* p, const size_t bytes) {
+    if (!p) {
+        // nothing to free
+    } else if (m->allocator) {
+        m->allocator->free(m->allocator->context, p, bytes);
+    } else if (!_kvm_is_huge(huge, bytes)) {
+        free(p);
+    } else {
+#if defined(__linux__)
+        munmap(p, (bytes + _kvm_huge_page - 1) & ~(_kvm_huge_page - 1));
+#elif defined(_WIN32)
+        VirtualFree(p, 0, MEM_RELEASE);
+#else
+        free(p);
+#endif
+    }
+}
+
+static struct _kvm_ext* _kvm_ext_of(kvm_t* m) {
+    // state of optional modes for writing, null when out of memory
+    if (!m->ext) {
+        m->ext = _kvm_allocate(m, 0, sizeof(struct _kvm_ext), false);
+        if (m->ext) { *m->ext = _kvm_ext_none; }
+    }
+    return m->ext;
+}
+
+static bool _kvm_alloc(kvm_t* m,  size_t kb, size_t vb, size_t n,
+                       const struct kvm_allocator* allocator) {
     if (n >= 4) { // dynamically allocated map
-        m->pk = malloc(n * kb);
-        m->pv = malloc(n * vb);
-        m->bm = calloc((n + 63) / 64, sizeof(uint64_t)); // zero init
-        if (!m->pk || !m->pv || !m->bm) {
-            free(m->pk); free(m->pv); free(m->bm);
+        m->allocator = allocator;
+        m->pk = _kvm_allocate(m, 0, n * kb, false);
+        m->pv = vb != 0 ? _kvm_allocate(m, 0, n * vb, false) : 0; // kvs()
+        m->bm = _kvm_allocate(m, 0, _kvm_bm_bytes(n), true);
+        if (!m->pk || (vb != 0 && !m->pv) || !m->bm) {
+            _kvm_deallocate(m, 0, m->pk, n * kb);
+            _kvm_deallocate(m, 0, m->pv, n * vb);
+            _kvm_deallocate(m, 0, m->bm, _kvm_bm_bytes(n));
             kvm_fatal_return_zero("out of memory\n");
         }
-        m->a = n;
-        m->n = 0;
+        m->ext = 0;
+        m->grows = 0;
+        m->a  = n;
+        m->r  = n;
+        m->n  = 0;
+        m->mc = 0;
         return true;
     } else { // invalid usage
         kvm_fatal_return_zero("invalid argument n: %zd\n", n);
@@ -182,16 +899,22 @@ static bool _kvm_alloc(kvm_t* m,  size_t kb, size_t vb, size_t n) {
 }
 
 bool _kvm_init(void* mv, size_t kb, size_t vb, size_t n,
-               void* k, void* v, size_t c) {
+               void* k, void* v, size_t c,
+               const struct kvm_allocator* allocator) {
     kvm_t* m = mv;
     if (c == 1) {
-        return _kvm_alloc(m, kb, vb, n);
+        return _kvm_alloc(m, kb, vb, n, allocator);
     } else if (n != 0) {
         kvm_fatal_return_zero("invalid argument n: %zd\n", n);
     } else {
         memset(m->bitmap, 0, sizeof(m->bitmap));
         m->a  = 0;
+        m->r  = 0;
         m->n  = 0;
+        m->mc = 0;
+        m->ext = 0;
+        m->grows = 0;
+        m->allocator = 0; // fixed maps do not allocate arrays
         m->pk = k;
         m->pv = v;
         m->bm = m->bitmap;
@@ -199,32 +922,210 @@ bool _kvm_init(void* mv, size_t kb, size_t vb, size_t n,
     }
 }
 
-static void _kvm_set_pointers(kvm_t* m, void* pk, void* pv, void* bm) {
-    free(m->pk); m->pk = pk;
-    free(m->pv); m->pv = pv;
-    free(m->bm); m->bm = bm;
+// Expiry deadlines are kept in a hierarchical timing wheel. Level l has
+// 64 buckets of 64^l time units. A deadline is linked into the bucket of
+// the highest 6-bit group in which it differs from wheel time w->now, so
+// buckets at level l > 0 are cascaded to lower levels once when wheel
+// time reaches them and level 0 buckets hold deadlines due at one time.
+// Deadlines already behind wheel time go to the overdue list instead.
+// Every slot has a timer node of an intrusive circular list; bucket
+// heads are sentinel nodes following the a slot nodes. Timer nodes move
+// together with entries, so a node is never stale.
+
+enum { _kvm_wheel_levels = 11, // 11 * 6 bits cover 64-bit deadlines
+       _kvm_wheel_overdue = _kvm_wheel_levels * 64, // after the buckets
+       _kvm_wheel_sentinels = _kvm_wheel_overdue + 1 };
+
+struct _kvm_timer {
+    uint64_t deadline; // 0 not linked
+    uint32_t prev;
+    uint32_t next;
+};
+
+struct _kvm_wheel {
+    uint64_t now; // deadlines before now have expired
+    uint64_t (*clock)(void); // null: kvm_get() does not check deadlines
+    uint64_t bits[_kvm_wheel_levels]; // not empty buckets, may be stale
+    struct _kvm_timer t[]; // [a] slots followed by bucket sentinels
+};
+
+static inline size_t _kvm_wheel_bytes(const size_t a) {
+    return sizeof(struct _kvm_wheel) +
+           (a + _kvm_wheel_sentinels) * sizeof(struct _kvm_timer);
+}
+
+static inline size_t _kvm_clz64(uint64_t w) {
+    #if defined(_MSC_VER)
+        unsigned long i; _BitScanReverse64(&i, w); return 63 - i;
+    #else
+        return (size_t)__builtin_clzll(w);
+    #endif
+}
+
+static void _kvm_wheel_reset(struct _kvm_wheel* w, const size_t a) {
+    for (size_t i = 0; i < a; i++) { w->t[i].deadline = 0; }
+    for (size_t b = 0; b < _kvm_wheel_sentinels; b++) {
+        const uint32_t s = (uint32_t)(a + b);
+        w->t[s].deadline = 0;
+        w->t[s].prev = w->t[s].next = s;
+    }
+    memset(w->bits, 0, sizeof(w->bits));
+}
+
+static void _kvm_timer_link(struct _kvm_wheel* w, const size_t a,
+                            const size_t i, const uint64_t deadline) {
+    uint32_t s = (uint32_t)(a + _kvm_wheel_overdue);
+    if (deadline >= w->now) {
+        const uint64_t x = deadline ^ w->now;
+        const size_t level = x == 0 ? 0 : (63 - _kvm_clz64(x)) / 6;
+        const size_t slot = (size_t)(deadline >> (level * 6)) & 63;
+        s = (uint32_t)(a + level * 64 + slot);
+        w->bits[level] |= 1uLL << slot;
+    }
+    struct _kvm_timer* t = w->t;
+    t[i].deadline = deadline;
+    t[i].next = s;
+    t[i].prev = t[s].prev;
+    t[t[s].prev].next = (uint32_t)i;
+    t[s].prev = (uint32_t)i;
+}
+
+static inline void _kvm_timer_unlink(kvm_t* m, const size_t i) {
+    struct _kvm_wheel* w = _kvm_x(m)->wheel;
+    if (w && w->t[i].deadline != 0) {
+        struct _kvm_timer* t = w->t;
+        t[t[i].prev].next = t[i].next;
+        t[t[i].next].prev = t[i].prev;
+        t[i].deadline = 0;
+    }
+}
+
+static inline void _kvm_timer_move(kvm_t* m, const size_t i, const size_t x) {
+    // entry moved from slot x to slot i, its timer keeps the bucket
+    struct _kvm_wheel* w = _kvm_x(m)->wheel;
+    if (w && w->t[x].deadline != 0) {
+        struct _kvm_timer* t = w->t;
+        t[i] = t[x];
+        t[t[i].prev].next = (uint32_t)i;
+        t[t[i].next].prev = (uint32_t)i;
+        t[x].deadline = 0;
+    }
+}
+
+static inline bool _kvm_expired(const kvm_t* m, const size_t i) {
+    const struct _kvm_wheel* w = _kvm_x(m)->wheel;
+    return w && w->clock && w->t[i].deadline != 0 &&
+           w->t[i].deadline <= w->clock();
+}
+
+// kvm_cache() keeps a 2-bit reference counter per slot (GCLOCK) in an
+// array indexed like the occupancy bitmap instead of per entry list links.
+
+#define _kvm_rb_bytes(a) ((((a) + 31) / 32) * sizeof(uint64_t))
+
+// kvm_bloom() filter has a 64 byte block (one cache line) per 64 slots
+// and one extra block to align blocks to cache lines.
+
+#define _kvm_bf_blocks(a) (((a) + 63) / 64)
+#define _kvm_bf_bytes(blocks) (((blocks) + 1) * 8 * sizeof(uint64_t))
+
+static inline size_t _kvm_ref(const uint64_t* rb, const size_t i) {
+    return (size_t)(rb[i / 32] >> (i % 32 * 2)) & 3;
+}
+
+static inline void _kvm_ref_set(uint64_t* rb, const size_t i, const size_t r) {
+    const size_t shift = i % 32 * 2;
+    rb[i / 32] = (rb[i / 32] & ~(3uLL << shift)) | ((uint64_t)r << shift);
+}
+
+static inline void _kvm_referenced(const kvm_t* m, const size_t i) {
+    // saturated counters of hot entries are not written again
+    uint64_t* rb = _kvm_x(m)->rb;
+    if (rb) {
+        const size_t r = _kvm_ref(rb, i);
+        if (r < 3) { _kvm_ref_set(rb, i, r + 1); }
+    }
+}
+
+static size_t _kvm_hand_step(const size_t c) {
+    // The hand visits all slots in scattered order. Evicting in slot
+    // order would empty the table behind the hand and pile new entries
+    // into long linear probing clusters in front of it.
+    size_t step = (c * 5 / 8) | 1;
+    for (;;) {
+        size_t a = c, b = step; // gcd(c, step) == 1: full cycle
+        while (b != 0) { const size_t r = a % b; a = b; b = r; }
+        if (a == 1) { return step; }
+        step += 2;
+    }
+}
+
+static inline void _kvm_slot_moved(kvm_t* m, const size_t i, const size_t x) {
+    // entry moved from slot x to slot i
+    _kvm_timer_move(m, i, x);
+    uint64_t* rb = _kvm_x(m)->rb;
+    if (rb) { _kvm_ref_set(rb, i, _kvm_ref(rb, x)); }
+}
+
+static void _kvm_set_pointers(kvm_t* m, size_t kb, size_t vb,
+                              void* pk, void* pv, void* bm) {
+    // frees arrays of current capacity m->a
+    const uint8_t huge = _kvm_x(m)->huge;
+    _kvm_deallocate(m, huge, m->pk, m->a * kb); m->pk = pk;
+    _kvm_deallocate(m, huge, m->pv, m->a * vb); m->pv = pv;
+    _kvm_deallocate(m, huge, m->bm, _kvm_bm_bytes(m->a)); m->bm = bm;
 }
 
 void _kvm_clear(void* mv, size_t c) {
     kvm_t* m = mv;
     m->n = 0;
+    m->mc++;
     const size_t capacity = m->a > 0 ? m->a : c;
     memset(m->bm, 0, ((capacity + 63) / 64) * sizeof(m->bm[0]));
+    struct _kvm_ext* x = m->ext;
+    if (!x) { return; }
+    if (x->tb) {
+        memset(x->tb, 0, ((capacity + 63) / 64) * sizeof(x->tb[0]));
+        x->t = 0;
+    }
+    if (x->wheel) { _kvm_wheel_reset(x->wheel, capacity); }
+    if (x->rb) { memset(x->rb, 0, _kvm_rb_bytes(capacity)); }
+    if (x->bf) {
+        memset(x->bf, 0, _kvm_bf_bytes(x->blocks));
+        x->stale = 0;
+    }
 }
 
-void _kvm_free(void* mv, size_t c) {
+void _kvm_free(void* mv, size_t c, size_t kb, size_t vb) {
     _kvm_clear(mv, c);
     kvm_t* m = mv;
-    if (c == 1 && m->a != 0) { _kvm_set_pointers(m, 0, 0, 0); m->a = 0; }
+    struct _kvm_ext* x = m->ext;
+    if (c == 1 && m->a != 0) {
+        if (x) {
+            _kvm_deallocate(m, x->huge, x->tb, _kvm_bm_bytes(m->a));
+            _kvm_deallocate(m, x->huge, x->wheel, _kvm_wheel_bytes(m->a));
+            _kvm_deallocate(m, x->huge, x->rb, _kvm_rb_bytes(m->a));
+            _kvm_deallocate(m, 0, x->bf, _kvm_bf_bytes(x->blocks));
+        }
+        _kvm_set_pointers(m, kb, vb, 0, 0, 0);
+        m->a = 0;
+    }
+    // fixed maps: bitmap and counters of modes are caller storage
+    _kvm_deallocate(m, 0, x, sizeof(*x));
+    m->ext = 0;
 }
 
-static inline size_t _kvm_hash(uint64_t key, size_t c) {
+static inline uint64_t _kvm_hash64(uint64_t key) {
     key ^= key >> 33;
     key *= 0XFF51AFD7ED558CCDuLL;
     key ^= key >> 33;
     key *= 0XC4CEB9FE1A85EC53uLL;
     key ^= key >> 33;
-    return (size_t)(key % c);
+    return key;
+}
+
+static inline size_t _kvm_hash(uint64_t key, size_t c) {
+    return (size_t)(_kvm_hash64(key) % c);
 }
 
 #define _kvm_bm_incl(bm, i) do { bm[i / 64] |=  (1uLL << (i % 64)); } while (0)
@@ -233,6 +1134,37 @@ static inline size_t _kvm_hash(uint64_t key, size_t c) {
 
 #define _kvm_is_empty(m, i) _kvm_bm_is_empty((m)->bm, i)
 
+#if defined(__GNUC__) || defined(__clang__)
+#define _kvm_prefetch(p) __builtin_prefetch(p)
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define _kvm_prefetch(p) _mm_prefetch((const char*)(p), _MM_HINT_T0)
+#else
+#define _kvm_prefetch(p) ((void)(p))
+#endif
+
+enum { _kvm_prefetch_distance = 256 }; // bytes ahead of the next entry
+
+static inline size_t _kvm_ctz64(uint64_t w) {
+    #if defined(_MSC_VER)
+        unsigned long i; _BitScanForward64(&i, w); return i;
+    #else
+        return (size_t)__builtin_ctzll(w);
+    #endif
+}
+
+static size_t _kvm_next_occupied(const uint64_t* bm, size_t i, size_t c) {
+    // scans occupancy bitmap a 64-bit word at a time
+    while (i < c) {
+        const uint64_t w = bm[i / 64] >> (i % 64);
+        if (w != 0) {
+            i += _kvm_ctz64(w);
+            return i < c ? i : c;
+        }
+        i = (i / 64 + 1) * 64;
+    }
+    return c;
+}
+
 static inline uint64_t _kvm_key(const uint8_t* pkey, const size_t kb) {
     // if compiler propagates constant values of kb to this point
     // it can eliminate sequential ifs and expensive memcpy call
@@ -252,6 +1184,7 @@ static inline void _kvm_set_at(uint8_t* d, const size_t i,
                               const uint8_t* s, const size_t b) {
     // if compiler propagates constant values of kb to this point
     // it can eliminate sequential ifs and expensive memcpy call
+    if (b == 0) { return; } // kvs() values
     if (b == 1) { d[i] = *s; return; }
     if (b == 2) { *(uint16_t*)(d + i * b) = *(uint16_t*)s; return; }
     if (b == 4) { *(uint32_t*)(d + i * b) = *(uint32_t*)s; return; }
@@ -261,31 +1194,168 @@ static inline void _kvm_set_at(uint8_t* d, const size_t i,
 
 static inline void _kvm_move(uint8_t* d, const size_t i,
                             const uint8_t* s, const size_t j, const size_t b) {
-    _kvm_set_at(d, i, s + j * b, b);
+    if (b != 0) { _kvm_set_at(d, i, s + j * b, b); }
 }
 
-#define _kvm_set_entry(k, v, i, pkey, pval, kb, vb) do { \
-    _kvm_set_at(k, i, pkey, kb);                         \
-    _kvm_set_at(v, i, pval, vb);                         \
-} while (0)
-
 #define _kvm_move_entry(dk, dv, i, sk, sv, j, kb, vb) do { \
     _kvm_move(dk, i, sk, j, kb);                           \
     _kvm_move(dv, i, sv, j, vb);                           \
 } while (0)
 
-const void* _kvm_get(const void* mv, const size_t c,
-                     const size_t kb, const size_t vb,
-                     const void* pkey) {
+uint64_t _kvm_hash_key(const void* pkey, const size_t kb) {
+    return _kvm_hash64(_kvm_key(pkey, kb));
+}
+
+// Split block Bloom filter: the high half of the key hash selects a
+// block, the low half sets one bit in each of its 8 words. A miss costs
+// one cache line and no probing of pk and bm. Deleted keys cannot be
+// cleared and are dropped by rebuilding the filter.
+
+static inline const uint64_t* _kvm_bf_block(const kvm_t* m, uint64_t hash) {
+    const uintptr_t p = ((uintptr_t)m->ext->bf + 63) & ~(uintptr_t)63;
+    return (const uint64_t*)p + ((hash >> 32) * m->ext->blocks >> 32) * 8;
+}
+
+static inline uint64_t _kvm_bf_bit(const uint64_t hash, const size_t w) {
+    static const uint32_t salt[8] = {
+        0x47B6137Bu, 0x44974D91u, 0x8824AD5Bu, 0xA2B7289Du,
+        0x705495C7u, 0x2DF1424Bu, 0x9EFC4947u, 0x5C6BFB31u
+    };
+    return 1uLL << ((uint32_t)((uint32_t)hash * salt[w]) >> 26);
+}
+
+static inline bool _kvm_bloom_has(const kvm_t* m, const uint64_t hash) {
+    const uint64_t* b = _kvm_bf_block(m, hash);
+    uint64_t miss = 0;
+    for (size_t w = 0; w < 8; w++) { miss |= ~b[w] & _kvm_bf_bit(hash, w); }
+    return miss == 0;
+}
+
+static inline void _kvm_bloom_add(kvm_t* m, const uint64_t hash) {
+    uint64_t* b = (uint64_t*)_kvm_bf_block(m, hash);
+    for (size_t w = 0; w < 8; w++) { b[w] |= _kvm_bf_bit(hash, w); }
+}
+
+static void _kvm_bloom_rebuild(kvm_t* m, const size_t c, const size_t kb) {
+    memset(m->ext->bf, 0, _kvm_bf_bytes(m->ext->blocks));
+    size_t i = _kvm_next_occupied(m->bm, 0, c);
+    while (i < c) {
+        _kvm_bloom_add(m, _kvm_hash64(_kvm_key_at(m->pk, kb, i)));
+        i = _kvm_next_occupied(m->bm, i + 1, c);
+    }
+    m->ext->stale = 0;
+}
+
+static size_t _kvm_find_past_tombs(const kvm_t* m, const size_t c,
+        const size_t kb, const uint64_t key, const size_t h) {
+    // tombstones do not terminate probing, returns c if key is not found
+    size_t i = h;
+    for (;;) {
+        if (!_kvm_is_empty(m, i)) {
+            if (_kvm_key_at(m->pk, kb, i) == key) { return i; }
+        } else if (_kvm_bm_is_empty(m->ext->tb, i)) {
+            return c;
+        }
+        i = (i + 1) % c;
+        if (i == h) { return c; }
+    }
+}
+
+static size_t _kvm_find(const kvm_t* m, const size_t c,
+        const size_t kb, const uint64_t key, const size_t h) {
+    // returns slot of the key or c if key is not found
+    if (_kvm_x(m)->tb) { return _kvm_find_past_tombs(m, c, kb, key, h); }
+    size_t i = h;
+    while (!_kvm_is_empty(m, i)) {
+        if (_kvm_key_at(m->pk, kb, i) == key) { return i; }
+        i = (i + 1) % c;
+        if (i == h) { break; }
+    }
+    return c;
+}
+
+static size_t _kvm_sweep(kvm_t* m, const size_t c,
+        const size_t kb, const size_t vb,
+        bool (*pred)(void* context, const void* key, void* val),
+        void* context) {
+    // Removes all tombstones and entries matching pred (if not null) in
+    // place in a single sweep. The sweep starts after a vacant slot so
+    // every cluster is visited from its first slot. Each entry in a
+    // cluster that has lost a slot before it is moved back to the first
+    // vacant slot at or after its home slot, which restores the linear
+    // probing invariant for the whole cluster.
+    uint64_t* tb = _kvm_x(m)->tb;
+    size_t s = 0;
+    while (s < c && !(_kvm_is_empty(m, s) && (!tb || _kvm_bm_is_empty(tb, s)))) {
+        s++;
+    }
+    assert(s < c); // at least one vacant slot always exists
+    uint8_t* k = m->pk;
+    uint8_t* v = m->pv;
+    size_t erased = 0;
+    bool dirty = false; // current cluster has vacated slots
+    for (size_t j = 1; j < c; j++) {
+        const size_t x = (s + j) % c;
+        if (tb && !_kvm_bm_is_empty(tb, x)) {
+            _kvm_bm_excl(tb, x);
+            dirty = true;
+        } else if (_kvm_is_empty(m, x)) {
+            dirty = false; // end of cluster
+        } else if (pred && pred(context, k + x * kb, v + x * vb)) {
+            _kvm_bm_excl(m->bm, x);
+            _kvm_timer_unlink(m, x);
+            erased++;
+            dirty = true;
+        } else if (dirty) {
+            size_t y = _kvm_hash(_kvm_key_at(k, kb, x), c);
+            while (y != x && !_kvm_is_empty(m, y)) { y = (y + 1) % c; }
+            if (y != x) {
+                _kvm_move_entry(k, v, y, k, v, x, kb, vb);
+                _kvm_slot_moved(m, y, x);
+                _kvm_bm_incl(m->bm, y);
+                _kvm_bm_excl(m->bm, x);
+            }
+        }
+    }
+    if (tb) { m->ext->t = 0; }
+    m->n -= erased;
+    m->mc++; // entries may have moved
+    if (_kvm_x(m)->bf && (erased > 0 || m->ext->stale > 0)) {
+        _kvm_bloom_rebuild(m, c, kb);
+    }
+    return erased;
+}
+
+static void _kvm_purge(kvm_t* m, const size_t c,
+                       const size_t kb, const size_t vb) {
+    _kvm_sweep(m, c, kb, vb, 0, 0);
+}
+
+static inline const void* _kvm_found(const kvm_t* m, const size_t i,
+                                     const uint8_t* v, const size_t vb) {
+    if (_kvm_expired(m, i)) { return 0; }
+    _kvm_referenced(m, i);
+    return v + i * vb;
+}
+
+const void* _kvm_get_hashed(const void* mv, const size_t c,
+                            const size_t kb, const size_t vb,
+                            const void* pkey, uint64_t hash) {
     const kvm_t* m = mv;
     const uint8_t* k = m->pk;
     const uint8_t* v = m->pv;
     const uint64_t key = _kvm_key(pkey, kb);
-    const size_t h = _kvm_hash(key, c);
+    assert(hash == _kvm_hash64(key));
+    if (_kvm_x(m)->bf && !_kvm_bloom_has(m, hash)) { return 0; }
+    const size_t h = (size_t)(hash % c);
     size_t i = h; // start
+    if (_kvm_x(m)->tb) {
+        i = _kvm_find_past_tombs(m, c, kb, key, h);
+        return i < c ? _kvm_found(m, i, v, vb) : 0;
+    }
     while (!_kvm_is_empty(m, i)) {
         if (_kvm_key_at(k, kb, i) == key) {
-            return v + i * vb;
+            return _kvm_found(m, i, v, vb);
         } else {
             i = (i + 1) % c;
             if (i == h) { return 0; }
@@ -294,20 +1364,56 @@ const void* _kvm_get(const void* mv, const size_t c,
     return 0;
 }
 
-static bool _kvm_grow(kvm_t* m, const size_t kb, const size_t vb) {
-    if (m->a >= (size_t)(UINTPTR_MAX / 2)) {
-        kvm_fatal_return_zero("allocated overflow: %zd\n", m->a);
-    }
+const void* _kvm_get(const void* mv, const size_t c,
+                     const size_t kb, const size_t vb,
+                     const void* pkey) {
+    return _kvm_get_hashed(mv, c, kb, vb, pkey, _kvm_hash_key(pkey, kb));
+}
+
+static bool _kvm_resize(kvm_t* m, const size_t kb, const size_t vb,
+                        const size_t a) {
+    assert(m->a != 0 && a > m->n);
+    const struct _kvm_ext* x = _kvm_x(m);
+    const uint8_t huge = x->huge;
     uint8_t*  k  = m->pk;
     uint8_t*  v  = m->pv;
-    size_t    a  = m->a * 3 / 2;
-    uint8_t*  pk = malloc(a * kb);
-    uint8_t*  pv = malloc(a * vb);
-    uint64_t* bm = calloc((a + 63) / 64, sizeof(uint64_t)); // zero init
-    if (!pk || !pv || !bm) {
-        free(pk); free(pv); free(bm);
+    const size_t bb = _kvm_bm_bytes(a);
+    uint8_t*  pk = _kvm_allocate(m, huge, a * kb, false);
+    uint8_t*  pv = vb != 0 ? _kvm_allocate(m, huge, a * vb, false) : 0;
+    uint64_t* bm = _kvm_allocate(m, huge, bb, true);
+    uint64_t* tb = x->tb ? _kvm_allocate(m, huge, bb, true) : 0;
+    const size_t rbb = _kvm_rb_bytes(a);
+    uint64_t* rb = x->rb ? _kvm_allocate(m, huge, rbb, true) : 0;
+    const size_t bfb = _kvm_bf_bytes(_kvm_bf_blocks(a));
+    uint64_t* bf = x->bf ? _kvm_allocate(m, 0, bfb, false) : 0;
+    struct _kvm_wheel* w = x->wheel;
+    if (w && a >= UINT32_MAX - _kvm_wheel_sentinels) {
+        _kvm_deallocate(m, huge, pk, a * kb);
+        _kvm_deallocate(m, huge, pv, a * vb);
+        _kvm_deallocate(m, huge, bm, bb);
+        _kvm_deallocate(m, huge, tb, bb);
+        _kvm_deallocate(m, huge, rb, rbb);
+        _kvm_deallocate(m, 0, bf, bfb);
+        kvm_fatal_return_zero("expiry capacity overflow: %zd\n", a);
+    }
+    struct _kvm_wheel* nw = w ?
+        _kvm_allocate(m, huge, _kvm_wheel_bytes(a), false) : 0;
+    if (!pk || (vb != 0 && !pv) || !bm || (x->tb && !tb) || (x->rb && !rb) ||
+        (x->bf && !bf) || (w && !nw)) {
+        _kvm_deallocate(m, huge, pk, a * kb);
+        _kvm_deallocate(m, huge, pv, a * vb);
+        _kvm_deallocate(m, huge, bm, bb);
+        _kvm_deallocate(m, huge, tb, bb);
+        _kvm_deallocate(m, huge, rb, rbb);
+        _kvm_deallocate(m, 0, bf, bfb);
+        _kvm_deallocate(m, huge, nw, _kvm_wheel_bytes(a));
         kvm_fatal_return_zero("out of memory\n");
     } else {
+        if (w) {
+            nw->now = w->now;
+            nw->clock = w->clock;
+            _kvm_wheel_reset(nw, a);
+        }
         // rehash all entries into new arrays:
         for (size_t i = 0; i < m->a; i++) {
             if (!_kvm_is_empty(m, i)) {
@@ -318,86 +1424,1403 @@ static bool _kvm_grow(kvm_t* m, const size_t kb, const size_t vb) {
                 }
                 _kvm_move_entry(pk, pv, h, k, v, i, kb, vb);
                 _kvm_bm_incl(bm, h);
+                if (w && w->t[i].deadline != 0) {
+                    _kvm_timer_link(nw, a, h, w->t[i].deadline);
+                }
+                if (rb) { _kvm_ref_set(rb, h, _kvm_ref(x->rb, i)); }
             }
         }
-        _kvm_set_pointers(m, pk, pv, bm);
-        m->a = a;
+        // any of the arrays exists only when m->ext does
+        if (rb) {
+            _kvm_deallocate(m, huge, x->rb, _kvm_rb_bytes(m->a));
+            m->ext->rb = rb;
+            m->ext->hand = 0;
+            m->ext->step = _kvm_hand_step(a);
+        }
+        if (w) {
+            _kvm_deallocate(m, huge, w, _kvm_wheel_bytes(m->a));
+            m->ext->wheel = nw;
+        }
+        if (tb) {
+            _kvm_deallocate(m, huge, x->tb, _kvm_bm_bytes(m->a));
+            m->ext->tb = tb;
+            m->ext->t = 0;
+        }
+        _kvm_set_pointers(m, kb, vb, pk, pv, bm);
+        m->a = a;
+        if (bf) { // rebuilt for the new capacity, drops deleted keys
+            _kvm_deallocate(m, 0, x->bf, _kvm_bf_bytes(x->blocks));
+            m->ext->bf = bf;
+            m->ext->blocks = _kvm_bf_blocks(a);
+            _kvm_bloom_rebuild(m, a, kb);
+        }
         return true;
     }
 }
 
-bool _kvm_put(void* mv, const size_t capacity,
-              const size_t kb, const size_t vb,
-              const void* pkey, const void* pval) {
-    kvm_t* m = mv;
+static bool _kvm_grow(kvm_t* m, const size_t kb, const size_t vb) {
+    const size_t growth = _kvm_x(m)->growth;
+    if (m->a >= (size_t)(UINTPTR_MAX / growth)) {
+        kvm_fatal_return_zero("allocated overflow: %zd\n", m->a);
+    }
+    const size_t a = m->a * growth / 100;
+    if (!_kvm_resize(m, kb, vb, a > m->a ? a : m->a + 1)) { return false; }
+    m->grows++;
+    return true;
+}
+
+static size_t _kvm_fit(const kvm_t* m, const size_t n) {
+    // minimum capacity to hold n entries below max load
+    const size_t load = _kvm_x(m)->load;
+    const size_t a = (n * 100 + load - 1) / load + 1;
+    return a < 4 ? 4 : a;
+}
+
+static void _kvm_remove_at(kvm_t* m, const size_t c,
+                           const size_t kb, const size_t vb, size_t i);
+
+static void _kvm_evict(kvm_t* m, const size_t c,
+                       const size_t kb, const size_t vb, const size_t skip) {
+    // CLOCK: the hand sweeps occupied slots decrementing
+    // reference counters and evicts the first entry with zero counter.
+    // The entry just inserted at slot `skip` (c for none) is not evicted.
+    struct _kvm_ext* x = m->ext; // cache mode
+    uint64_t* rb = x->rb;
+    size_t i = x->hand;
+    for (;;) {
+        i += x->step; // step < c
+        if (i >= c) { i -= c; }
+        if (!_kvm_is_empty(m, i)) {
+            const size_t r = _kvm_ref(rb, i);
+            if (r == 0 && i != skip) { break; }
+            if (r != 0) { _kvm_ref_set(rb, i, r - 1); }
+        }
+    }
+    if (x->evict) { x->evict(x->context, m->pk + i * kb, m->pv + i * vb); }
+    x->hand = i;
+    _kvm_remove_at(m, c, kb, vb, i);
+}
+
+static inline void _kvm_set_val(uint8_t* v, const size_t i,
+                                const void* pval, const size_t vb) {
+    // pval or zeros, kvs() sets have no values
+    if (pval) {
+        _kvm_set_at(v, i, pval, vb);
+    } else if (vb != 0) {
+        memset(v + i * vb, 0, vb);
+    }
+}
+
+static inline void _kvm_update(kvm_t* m, const size_t i, uint8_t* v,
+        const size_t vb, const void* pval, bool* inserted) {
+    // existing key: an expired entry is reinserted without deadline
+    const bool expired = _kvm_expired(m, i);
+    if (expired) { _kvm_timer_unlink(m, i); }
+    if (pval || expired) { _kvm_set_val(v, i, pval, vb); }
+    _kvm_referenced(m, i);
+    *inserted = expired;
+}
+
+static bool _kvm_slot(kvm_t* m, const size_t capacity,
+        const size_t kb, const size_t vb, const void* pkey,
+        const void* pval, uint64_t hash, bool* inserted, size_t* slot) {
+    // Single probe: finds or inserts the key and returns its slot, false
+    // on failure. Existing keys are not rewritten, their values are
+    // replaced by pval if not null. New values are pval or zeros.
     size_t c = capacity;
+    const struct _kvm_ext* x = _kvm_x(m);
+    const size_t limit = m->a != 0 ? c * x->load / 100 : c - 1;
+    if (x->t > 0) {
+        if (x->t >= c / 4 || m->n + x->t >= limit) { _kvm_purge(m, c, kb, vb); }
+    }
     if (m->a != 0) {
-        const size_t c34 = c * 3 / 4;
-        if (m->n >= c34) {
-            if (!_kvm_grow(m, kb, vb)) { return false; }
+        if (m->n + x->t >= limit) {
+            if (!_kvm_grow(m, kb, vb)) { return 0; }
             c = m->a;
         }
     }
     uint8_t* k = m->pk;
     uint8_t* v = m->pv;
     uint64_t key = _kvm_key(pkey, kb);
-    size_t h = _kvm_hash(key, c);
+    assert(hash == _kvm_hash64(key));
+    size_t h = (size_t)(hash % c);
     size_t i = h;
-    while (!_kvm_is_empty(m, i)) {
-        if (key == _kvm_key_at(k, kb, i)) {
-            _kvm_set_entry(k, v, i, pkey, pval, kb, vb);
-            return true;
-        } else {
+    if (x->tb) {
+        size_t tomb = c; // first tombstone on the probe path
+        for (;;) {
+            if (!_kvm_is_empty(m, i)) {
+                if (key == _kvm_key_at(k, kb, i)) {
+                    _kvm_update(m, i, v, vb, pval, inserted);
+                    *slot = i;
+                    return true;
+                }
+            } else if (_kvm_bm_is_empty(x->tb, i)) {
+                break;
+            } else if (tomb == c) {
+                tomb = i;
+            }
             i = (i + 1) % c;
-            if (i == h) { kvm_fatal_return_zero("map is full\n"); }
+            if (i == h) {
+                if (tomb == c) { kvm_fatal_return_zero("map is full\n"); }
+                break;
+            }
+        }
+        if (tomb < c) {
+            i = tomb;
+            _kvm_bm_excl(x->tb, i);
+            m->ext->t--;
+        } else if (m->a == 0 && m->n + x->t + 1 >= c) {
+            // fixed map keeps one vacant slot for _kvm_purge()
+            kvm_fatal_return_zero("map is full\n");
+        }
+    } else {
+        while (!_kvm_is_empty(m, i)) {
+            if (key == _kvm_key_at(k, kb, i)) {
+                _kvm_update(m, i, v, vb, pval, inserted);
+                *slot = i;
+                return true;
+            } else {
+                i = (i + 1) % c;
+                if (i == h) { kvm_fatal_return_zero("map is full\n"); }
+            }
         }
     }
-    _kvm_set_entry(k, v, i, pkey, pval, kb, vb);
+    _kvm_set_at(k, i, pkey, kb);
+    _kvm_set_val(v, i, pval, vb);
     _kvm_bm_incl(m->bm, i);
     m->n++;
+    m->mc++;
+    *inserted = true;
+    if (x->bf) { _kvm_bloom_add(m, hash); }
+    if (x->rb) {
+        _kvm_ref_set(x->rb, i, 0); // new entries start unreferenced
+        if (m->n > x->cache) {
+            _kvm_evict(m, c, kb, vb, i);
+            // backward shift may have moved the new entry:
+            if (_kvm_is_empty(m, i) || _kvm_key_at(k, kb, i) != key) {
+                i = _kvm_find(m, c, kb, key, h);
+            }
+        }
+    }
+    *slot = i;
     return true;
 }
 
-bool _kvm_delete(void* mv, const size_t c,
-                 size_t kb, size_t vb, const void* pkey) {
+bool _kvm_put_hashed(void* mv, const size_t capacity,
+                     const size_t kb, const size_t vb,
+                     const void* pkey, const void* pval, uint64_t hash) {
+    bool inserted = false;
+    size_t i = 0;
+    return _kvm_slot(mv, capacity, kb, vb, pkey, pval, hash, &inserted, &i);
+}
+
+void* _kvm_get_or_insert(void* mv, const size_t c,
+                         const size_t kb, const size_t vb,
+                         const void* pkey, bool* inserted) {
     kvm_t* m = mv;
-    uint8_t* k = m->pk;
-    uint8_t* v = m->pv;
+    bool ignored = false;
+    size_t i = 0;
+    return _kvm_slot(m, c, kb, vb, pkey, 0, _kvm_hash_key(pkey, kb),
+                     inserted ? inserted : &ignored, &i) ? m->pv + i * vb : 0;
+}
+
+bool _kvm_upsert(void* mv, const size_t c,
+                 const size_t kb, const size_t vb,
+                 const void* pkey, const void* pval,
+                 void (*merge)(void* val, const void* with)) {
+    kvm_t* m = mv;
+    bool inserted = false;
+    size_t i = 0;
+    if (!_kvm_slot(m, c, kb, vb, pkey, 0, _kvm_hash_key(pkey, kb),
+                   &inserted, &i)) {
+        return false;
+    } else if (inserted) {
+        _kvm_set_at(m->pv, i, pval, vb);
+    } else {
+        merge(m->pv + i * vb, pval);
+    }
+    return true;
+}
+
+bool _kvs_add(void* mv, const size_t c, const size_t kb, const void* pkey) {
+    // values are never touched: vb == 0 and pv is null
+    bool inserted = false;
+    size_t i = 0;
+    return _kvm_slot(mv, c, kb, 0, pkey, 0, _kvm_hash_key(pkey, kb),
+                     &inserted, &i) && inserted;
+}
+
+bool _kvs_contains(const void* mv, const size_t c, const size_t kb,
+                   const void* pkey) {
+    const kvm_t* m = mv;
     const uint64_t key = _kvm_key(pkey, kb);
-    size_t h = _kvm_hash(key, c);
-    bool found = false;
-    size_t i = h; // start
-    while (!found && !_kvm_is_empty(m, i)) {
-        const uint64_t ki = _kvm_key_at(k, kb, i);
-        found = ki == key;
-        if (!found) {
-            i = (i + 1) % c;
-            if (i == h) { break; }
-        }
+    const uint64_t hash = _kvm_hash64(key);
+    if (_kvm_x(m)->bf && !_kvm_bloom_has(m, hash)) { return false; }
+    return _kvm_find(m, c, kb, key, (size_t)(hash % c)) < c;
+}
+
+bool _kvm_put(void* mv, const size_t capacity,
+              const size_t kb, const size_t vb,
+              const void* pkey, const void* pval) {
+    return _kvm_put_hashed(mv, capacity, kb, vb, pkey, pval,
+                           _kvm_hash_key(pkey, kb));
+}
+
+static void _kvm_shrink_if_sparse(kvm_t* m, const size_t kb, const size_t vb) {
+    const struct _kvm_ext* x = _kvm_x(m);
+    if (x->low != 0 && m->a > m->r && m->n * 100 < (size_t)x->low * m->a) {
+        // leave room to grow so alternating put/delete does not thrash:
+        size_t a = _kvm_fit(m, m->n) * x->growth / 100;
+        if (a < m->r) { a = m->r; }
+        if (a < m->a) { _kvm_resize(m, kb, vb, a); }
     }
-    if (found) {
-        _kvm_bm_excl(m->bm, i);
+}
+
+static void _kvm_remove_at(kvm_t* m, const size_t c,
+                           const size_t kb, const size_t vb, size_t i) {
+    // removes the entry at occupied slot i
+    _kvm_bm_excl(m->bm, i);
+    _kvm_timer_unlink(m, i);
+    if (_kvm_x(m)->tb) {
+        _kvm_bm_incl(m->ext->tb, i);
+        m->ext->t++;
+    } else {
+        uint8_t* k = m->pk;
+        uint8_t* v = m->pv;
         size_t x = i;
         for (;;) {
             x = (x + 1) % c;
             if (_kvm_is_empty(m, x)) { break; }
             assert(x != i); // because empty slot exists
             const uint64_t kx = _kvm_key_at(k, kb, x);
-            h = _kvm_hash(kx, c);
+            const size_t h = _kvm_hash(kx, c);
             const bool can_move = i <= x ? x < h || h <= i :
                                            x < h && h <= i;
             if (can_move) {
                 _kvm_move_entry(k, v, i, k, v, x, kb, vb);
+                _kvm_slot_moved(m, i, x);
                 _kvm_bm_incl(m->bm, i);
                 _kvm_bm_excl(m->bm, x);
                 i = x;
             }
         }
-        m->n--;
+    }
+    m->n--;
+    m->mc++;
+    // deleted keys stay in the filter until a quarter of capacity:
+    if (_kvm_x(m)->bf && ++m->ext->stale >= c / 4) {
+        _kvm_bloom_rebuild(m, c, kb);
+    }
+}
+
+static bool _kvm_remove(kvm_t* m, const size_t c,
+                        size_t kb, size_t vb, const void* pkey,
+                        uint64_t hash) {
+    const uint64_t key = _kvm_key(pkey, kb);
+    assert(hash == _kvm_hash64(key));
+    if (_kvm_x(m)->bf && !_kvm_bloom_has(m, hash)) { return false; }
+    const size_t i = _kvm_find(m, c, kb, key, (size_t)(hash % c));
+    if (i < c) { _kvm_remove_at(m, c, kb, vb, i); }
+    return i < c;
+}
+
+bool _kvm_delete_hashed(void* mv, const size_t c,
+                        size_t kb, size_t vb, const void* pkey,
+                        uint64_t hash) {
+    kvm_t* m = mv;
+    const bool found = _kvm_remove(m, c, kb, vb, pkey, hash);
+    if (found) { _kvm_shrink_if_sparse(m, kb, vb); }
+    return found;
+}
+
+bool _kvm_delete(void* mv, const size_t c,
+                 size_t kb, size_t vb, const void* pkey) {
+    return _kvm_delete_hashed(mv, c, kb, vb, pkey, _kvm_hash_key(pkey, kb));
+}
+
+size_t _kvm_erase_if(void* mv, size_t c, size_t kb, size_t vb,
+        bool (*pred)(void* context, const void* key, void* val),
+        void* context) {
+    kvm_t* m = mv;
+    size_t erased = 0;
+    if (m->n + _kvm_x(m)->t == c) {
+        // full fixed map: the sweep needs a vacant slot to start from
+        size_t i = 0;
+        while (i < c && !pred(context, m->pk + i * kb, m->pv + i * vb)) { i++; }
+        if (i == c) { return 0; }
+        const void* pkey = m->pk + i * kb;
+        _kvm_remove(m, c, kb, vb, pkey, _kvm_hash_key(pkey, kb));
+        erased++;
+    }
+    erased += _kvm_sweep(m, c, kb, vb, pred, context);
+    if (erased > 0) { _kvm_shrink_if_sparse(m, kb, vb); }
+    return erased;
+}
+
+// kvm_export_sorted() runs each phase on all threads and joins them,
+// joining is the barrier between phases.
+
+enum { _kvm_max_threads = 64 };
+
+struct _kvm_task {
+    void (*fn)(void* context, size_t t);
+    void* context;
+    size_t t;
+};
+
+#if defined(_WIN32)
+static DWORD WINAPI _kvm_thread(void* p) {
+    struct _kvm_task* task = p;
+    task->fn(task->context, task->t);
+    return 0;
+}
+#else
+static void* _kvm_thread(void* p) {
+    struct _kvm_task* task = p;
+    task->fn(task->context, task->t);
+    return 0;
+}
+#endif
+
+static void _kvm_parallel(const size_t threads,
+                          void (*fn)(void* context, size_t t), void* context) {
+    struct _kvm_task task[_kvm_max_threads];
+    bool started[_kvm_max_threads] = {0};
+#if defined(_WIN32)
+    HANDLE thread[_kvm_max_threads];
+#else
+    pthread_t thread[_kvm_max_threads];
+#endif
+    for (size_t t = 1; t < threads; t++) {
+        task[t] = (struct _kvm_task){ fn, context, t };
+#if defined(_WIN32)
+        thread[t] = CreateThread(0, 0, _kvm_thread, &task[t], 0, 0);
+        started[t] = thread[t] != 0;
+#else
+        started[t] = pthread_create(&thread[t], 0, _kvm_thread, &task[t]) == 0;
+#endif
+        if (!started[t]) { fn(context, t); } // runs on the caller thread
+    }
+    fn(context, 0);
+    for (size_t t = 1; t < threads; t++) {
+        if (started[t]) {
+#if defined(_WIN32)
+            WaitForSingleObject(thread[t], INFINITE);
+            CloseHandle(thread[t]);
+#else
+            pthread_join(thread[t], 0);
+#endif
+        }
+    }
+}
+
+struct _kvm_sort {
+    const kvm_t* m;
+    size_t c;
+    size_t kb;
+    size_t vb;      // 0 if values are not exported
+    size_t n;
+    size_t threads;
+    int    sign;    // _kvm_sign()
+    size_t digit;   // byte of the key sorted by current pass
+    const uint8_t* sk; // source columns
+    const uint8_t* sv;
+    uint8_t* dk;    // destination columns
+    uint8_t* dv;
+    size_t (*count)[256]; // per thread digit counts, then offsets
+};
+
+#define _kvm_part(n, t, threads) ((n) * (t) / (threads))
+
+static void _kvm_gather_count(void* context, size_t t) {
+    struct _kvm_sort* s = context;
+    const size_t words = (s->c + 63) / 64;
+    size_t n = 0;
+    for (size_t w = _kvm_part(words, t, s->threads);
+                w < _kvm_part(words, t + 1, s->threads); w++) {
+        uint64_t b = s->m->bm[w];
+        while (b != 0) { n++; b &= b - 1; }
+    }
+    s->count[t][0] = n;
+}
+
+static void _kvm_gather(void* context, size_t t) {
+    // copies occupied slots of thread words to its offset in count[t][1]
+    struct _kvm_sort* s = context;
+    const size_t words = (s->c + 63) / 64;
+    const size_t from = _kvm_part(words, t, s->threads) * 64;
+    size_t to = _kvm_part(words, t + 1, s->threads) * 64;
+    if (to > s->c) { to = s->c; }
+    size_t j = s->count[t][1];
+    size_t i = _kvm_next_occupied(s->m->bm, from, to);
+    while (i < to) {
+        _kvm_set_at(s->dk, j, s->m->pk + i * s->kb, s->kb);
+        if (s->vb) { _kvm_set_at(s->dv, j, s->m->pv + i * s->vb, s->vb); }
+        j++;
+        i = _kvm_next_occupied(s->m->bm, i + 1, to);
+    }
+}
+
+static inline size_t _kvm_digit(const struct _kvm_sort* s, const size_t i) {
+    uint64_t key = _kvm_key_at(s->sk, s->kb, i);
+    const uint64_t top = 1uLL << (s->kb * 8 - 1);
+    // signed keys: flipping the sign bit orders negative keys first,
+    // negative IEEE keys also flip magnitude bits to order descending
+    if (s->sign == 2 && (key & top) != 0) {
+        key = ~key;
+    } else if (s->sign) {
+        key ^= top;
+    }
+    return (size_t)(key >> (s->digit * 8)) & 0xFF;
+}
+
+static void _kvm_radix_count(void* context, size_t t) {
+    struct _kvm_sort* s = context;
+    size_t* count = s->count[t];
+    memset(count, 0, 256 * sizeof(count[0]));
+    const size_t to = _kvm_part(s->n, t + 1, s->threads);
+    for (size_t i = _kvm_part(s->n, t, s->threads); i < to; i++) {
+        count[_kvm_digit(s, i)]++;
+    }
+}
+
+static void _kvm_radix_scatter(void* context, size_t t) {
+    // stable: threads own consecutive ranges and their offsets follow
+    // the offsets of previous threads for every digit
+    struct _kvm_sort* s = context;
+    size_t* offset = s->count[t];
+    const size_t to = _kvm_part(s->n, t + 1, s->threads);
+    for (size_t i = _kvm_part(s->n, t, s->threads); i < to; i++) {
+        const size_t j = offset[_kvm_digit(s, i)]++;
+        _kvm_set_at(s->dk, j, s->sk + i * s->kb, s->kb);
+        if (s->vb) { _kvm_set_at(s->dv, j, s->sv + i * s->vb, s->vb); }
+    }
+}
+
+bool _kvm_export_sorted(const void* mv, size_t c, size_t kb, size_t vb,
+                        int sign, void* keys, void* vals, size_t threads) {
+    const kvm_t* m = mv;
+    if (!vals) { vb = 0; }
+    const size_t n = m->n;
+    // small tables do not pay for threads: at least 64K entries each
+    if (threads > n / (64 * 1024)) { threads = n / (64 * 1024); }
+    if (threads > _kvm_max_threads) { threads = _kvm_max_threads; }
+    if (threads == 0) { threads = 1; }
+    uint8_t* tk = n > 0 ? _kvm_allocate(m, 0, n * kb, false) : 0;
+    uint8_t* tv = n > 0 && vb > 0 ? _kvm_allocate(m, 0, n * vb, false) : 0;
+    size_t (*count)[256] = _kvm_allocate(m, 0, threads * sizeof(*count),
+                                         false);
+    if (!count || (n > 0 && !tk) || (n > 0 && vb > 0 && !tv)) {
+        _kvm_deallocate(m, 0, tk, n * kb);
+        _kvm_deallocate(m, 0, tv, n * vb);
+        _kvm_deallocate(m, 0, count, threads * sizeof(*count));
+        kvm_fatal_return_zero("out of memory\n");
+    }
+    struct _kvm_sort s = {
+        .m = m, .c = c, .kb = kb, .vb = vb, .n = n, .threads = threads,
+        .sign = sign, .digit = 0, .sk = keys, .sv = vals,
+        .dk = keys, .dv = vals, .count = count
+    };
+    _kvm_parallel(threads, _kvm_gather_count, &s);
+    size_t sum = 0;
+    for (size_t t = 0; t < threads; t++) {
+        count[t][1] = sum;
+        sum += count[t][0];
+    }
+    assert(sum == n);
+    _kvm_parallel(threads, _kvm_gather, &s);
+    uint8_t* ok = keys; // columns holding current order
+    uint8_t* ov = vals;
+    for (size_t d = 0; d < kb; d++) {
+        s.digit = d;
+        s.sk = ok;
+        s.sv = ov;
+        s.dk = ok == keys ? tk : keys;
+        s.dv = ok == keys ? tv : vals;
+        _kvm_parallel(threads, _kvm_radix_count, &s);
+        bool same = false; // all keys have the same digit
+        size_t offset = 0;
+        for (size_t b = 0; b < 256; b++) {
+            size_t total = 0;
+            for (size_t t = 0; t < threads; t++) {
+                const size_t k = count[t][b];
+                count[t][b] = offset + total;
+                total += k;
+            }
+            same = same || total == n;
+            offset += total;
+        }
+        if (!same) {
+            _kvm_parallel(threads, _kvm_radix_scatter, &s);
+            ok = s.dk;
+            ov = s.dv;
+        }
+    }
+    if (ok != keys) {
+        memcpy(keys, ok, n * kb);
+        if (vb > 0) { memcpy(vals, ov, n * vb); }
+    }
+    _kvm_deallocate(m, 0, tk, n * kb);
+    _kvm_deallocate(m, 0, tv, n * vb);
+    _kvm_deallocate(m, 0, count, threads * sizeof(*count));
+    return true;
+}
+
+// kvm_union(), kvm_intersect() and kvm_difference() iterate one map
+// (s) and probe the other (o) in chunks of slots of s: threads fill
+// found[] with the slot of each key in o, then the caller thread puts
+// the result into d. Probes neither touch kvm_cache() counters nor
+// modify o, so threads only read both maps.
+
+enum {
+    _kvm_probe_batch = 16,         // home slots prefetched ahead
+    _kvm_probe_chunk = 64 * 1024   // slots of s per thread per chunk
+};
+
+struct _kvm_probe {
+    const kvm_t* s;
+    const kvm_t* o;
+    size_t co;      // capacity of o
+    size_t kb;
+    size_t from;    // chunk of slots of s
+    size_t to;
+    size_t threads;
+    size_t* found;  // slot in o for slots [from, to) of s or co
+};
+
+static inline size_t _kvm_probe_key(const kvm_t* o, const size_t co,
+                                    const size_t kb, const uint64_t key,
+                                    const uint64_t hash) {
+    if (o->n == 0 || (_kvm_x(o)->bf && !_kvm_bloom_has(o, hash))) { return co; }
+    const size_t i = _kvm_find(o, co, kb, key, (size_t)(hash % co));
+    return i < co && !_kvm_expired(o, i) ? i : co;
+}
+
+static void _kvm_probe(void* context, size_t t) {
+    struct _kvm_probe* p = context;
+    const kvm_t* s = p->s;
+    const kvm_t* o = p->o;
+    const size_t span = p->to - p->from;
+    const size_t to = p->from + _kvm_part(span, t + 1, p->threads);
+    size_t i = p->from + _kvm_part(span, t, p->threads);
+    i = _kvm_next_occupied(s->bm, i, to);
+    while (i < to) {
+        size_t   slot[_kvm_probe_batch];
+        uint64_t hash[_kvm_probe_batch];
+        size_t k = 0;
+        while (i < to && k < _kvm_probe_batch) {
+            hash[k] = _kvm_hash64(_kvm_key_at(s->pk, p->kb, i));
+            const size_t h = (size_t)(hash[k] % p->co);
+            _kvm_prefetch(&o->bm[h / 64]);
+            _kvm_prefetch(o->pk + h * p->kb);
+            slot[k++] = i;
+            i = _kvm_next_occupied(s->bm, i + 1, to);
+        }
+        for (size_t j = 0; j < k; j++) {
+            const uint64_t key = _kvm_key_at(s->pk, p->kb, slot[j]);
+            p->found[slot[j] - p->from] =
+                _kvm_probe_key(o, p->co, p->kb, key, hash[j]);
+        }
+    }
+}
+
+static inline const uint8_t* _kvm_val_at(const kvm_t* m, const size_t vb,
+                                         const size_t i) {
+    return vb > 0 ? m->pv + i * vb : 0; // sets have no values
+}
+
+static bool _kvm_combine_put(kvm_t* d, const size_t cd, const size_t kb,
+        const size_t vb, const uint8_t* pkey, const uint8_t* pval,
+        const uint8_t* with, void (*merge)(void* val, const void* with)) {
+    // puts key and val into d, with != null: merge or replace with it
+    const uint64_t hash = _kvm_hash64(_kvm_key(pkey, kb));
+    const size_t c = d->a != 0 ? d->a : cd;
+    bool inserted = false;
+    size_t i = 0;
+    if (!_kvm_slot(d, c, kb, vb, pkey, pval, hash, &inserted, &i)) {
+        return false;
+    }
+    if (with && vb > 0) {
+        if (merge) {
+            merge(d->pv + i * vb, with);
+        } else {
+            _kvm_set_at(d->pv, i, with, vb);
+        }
+    }
+    return true;
+}
+
+static bool _kvm_combine_merge(kvm_t* d, const size_t cd, const size_t kb,
+        const size_t vb, const uint8_t* pkey, const uint8_t* with,
+        void (*merge)(void* val, const void* with)) {
+    // new keys get with, existing keys merge or are replaced with it
+    const uint64_t hash = _kvm_hash64(_kvm_key(pkey, kb));
+    const size_t c = d->a != 0 ? d->a : cd;
+    bool inserted = false;
+    size_t i = 0;
+    if (!_kvm_slot(d, c, kb, vb, pkey, merge ? 0 : with, hash,
+                   &inserted, &i)) {
+        return false;
+    }
+    if (merge && vb > 0) {
+        if (inserted) {
+            _kvm_set_at(d->pv, i, with, vb);
+        } else {
+            merge(d->pv + i * vb, with);
+        }
+    }
+    return true;
+}
+
+bool _kvm_combine(void* dv, size_t cd, const void* av, size_t ca,
+                  const void* bv, size_t cb, size_t kb, size_t vb, int op,
+                  void (*merge)(void* val, const void* with), size_t threads,
+                  bool same_types) {
+    kvm_t* d = dv;
+    const kvm_t* a = av;
+    const kvm_t* b = bv;
+    if (!same_types) {
+        kvm_fatal_return_zero("map key or value type mismatch\n");
+    }
+    if (d == a || d == b) {
+        kvm_fatal_return_zero("destination map is an operand\n");
+    }
+    // iterate s, probe o; intersection iterates the smaller map
+    const bool swap = op == _kvm_union ||
+                      (op == _kvm_intersect && b->n < a->n);
+    const kvm_t* s = swap ? b : a;
+    const kvm_t* o = swap ? a : b;
+    const size_t cs = swap ? cb : ca;
+    const size_t co = swap ? ca : cb;
+    const size_t result = op == _kvm_union ? a->n + b->n : s->n;
+    // union into an empty d that does not evict: every key of b found
+    // in d came from a, the inserted flag of the put replaces probing a
+    const bool fresh = d->n == 0 && _kvm_x(d)->cache == 0;
+    if (d->a != 0 && !_kvm_reserve(d, cd, kb, vb, d->n + result)) {
+        return false;
+    }
+    if (op == _kvm_union) { // all of a first, b merges into it
+        size_t i = _kvm_next_occupied(a->bm, 0, ca);
+        while (i < ca) {
+            if (!_kvm_expired(a, i) &&
+                !_kvm_combine_put(d, cd, kb, vb, a->pk + i * kb,
+                                  _kvm_val_at(a, vb, i), 0, 0)) {
+                return false;
+            }
+            i = _kvm_next_occupied(a->bm, i + 1, ca);
+        }
+    }
+    if (op == _kvm_union && fresh) {
+        size_t i = _kvm_next_occupied(b->bm, 0, cb);
+        while (i < cb) {
+            if (!_kvm_expired(b, i) &&
+                !_kvm_combine_merge(d, cd, kb, vb, b->pk + i * kb,
+                                    _kvm_val_at(b, vb, i), merge)) {
+                return false;
+            }
+            i = _kvm_next_occupied(b->bm, i + 1, cb);
+        }
+        return true;
+    }
+    if (s->n == 0) { return true; }
+    const size_t n = s->n;
+    if (threads > n / _kvm_probe_chunk) { threads = n / _kvm_probe_chunk; }
+    if (threads > _kvm_max_threads) { threads = _kvm_max_threads; }
+    if (threads == 0) { threads = 1; }
+    const size_t chunk = threads * _kvm_probe_chunk;
+    const size_t fb = (chunk < cs ? chunk : cs) * sizeof(size_t);
+    size_t* found = _kvm_allocate(d, 0, fb, false);
+    if (!found) { kvm_fatal_return_zero("out of memory\n"); }
+    struct _kvm_probe p = {
+        .s = s, .o = o, .co = co, .kb = kb, .from = 0, .to = 0,
+        .threads = threads, .found = found
+    };
+    bool ok = true;
+    for (size_t from = 0; from < cs && ok; from += chunk) {
+        p.from = from;
+        p.to = from + chunk < cs ? from + chunk : cs;
+        _kvm_parallel(threads, _kvm_probe, &p);
+        size_t i = _kvm_next_occupied(s->bm, p.from, p.to);
+        while (i < p.to && ok) {
+            const size_t j = found[i - from]; // slot in o or co
+            const uint8_t* key = s->pk + i * kb;
+            const uint8_t* val = _kvm_val_at(s, vb, i);
+            if (_kvm_expired(s, i)) {
+                // not a member of s
+            } else if (op == _kvm_union) {
+                ok = _kvm_combine_put(d, cd, kb, vb, key, j < co ? 0 : val,
+                                      j < co ? val : 0, merge);
+            } else if (op == _kvm_difference) {
+                if (j == co) {
+                    ok = _kvm_combine_put(d, cd, kb, vb, key, val, 0, 0);
+                }
+            } else if (j < co) { // intersection: values of a merge b
+                const uint8_t* val_a = swap ? _kvm_val_at(o, vb, j) : val;
+                const uint8_t* val_b = swap ? val : _kvm_val_at(o, vb, j);
+                ok = _kvm_combine_put(d, cd, kb, vb, key, val_a,
+                                      merge ? val_b : 0, merge);
+            }
+            i = _kvm_next_occupied(s->bm, i + 1, p.to);
+        }
+    }
+    _kvm_deallocate(d, 0, found, fb);
+    return ok;
+}
+
+// kvm_freeze() builds a PTHash style minimal perfect hash. Keys are
+// split into buckets by the high half of their hash. Buckets are placed
+// largest first: for each bucket the first pilot p is searched that
+// puts all its keys into free slots at mix(hash ^ p) % slots.
+// _kvm_hash64() is a bijection, so distinct keys never share a hash and
+// every pilot scatters a bucket afresh. slots is ~5% above n, which
+// keeps the search for the last small buckets short; the few keys
+// placed at or above n are remapped into the holes left below n.
+
+typedef kvm_frozen(void*, void*) kvm_frozen_t;
+
+enum { _kvm_bucket_keys = 5 }; // average keys per bucket
+
+static inline size_t _kvm_bucket(const uint64_t hash, const size_t buckets) {
+    return (size_t)(((hash >> 32) * buckets) >> 32);
+}
+
+static inline size_t _kvm_pilot_slot(const uint64_t hash, const uint32_t p,
+                                     const size_t slots) {
+    return (size_t)(_kvm_hash64(hash ^ ((uint64_t)p << 32 | p)) % slots);
+}
+
+static void* _kvm_frozen_allocate(const kvm_frozen_t* f, size_t bytes) {
+    return f->allocator ? f->allocator->alloc(f->allocator->context, bytes) :
+                          malloc(bytes);
+}
+
+static void _kvm_frozen_deallocate(const kvm_frozen_t* f, void* p,
+                                   size_t bytes) {
+    if (!p) {
+        // nothing to free
+    } else if (f->allocator) {
+        f->allocator->free(f->allocator->context, p, bytes);
+    } else {
+        free(p);
+    }
+}
+
+void _kvm_frozen_free(void* fv, size_t kb, size_t vb) {
+    kvm_frozen_t* f = fv;
+    _kvm_frozen_deallocate(f, f->pk, f->n * kb);
+    _kvm_frozen_deallocate(f, f->pv, f->n * vb);
+    _kvm_frozen_deallocate(f, f->pilots, f->buckets * sizeof(uint32_t));
+    _kvm_frozen_deallocate(f, f->remap, (f->slots - f->n) * sizeof(size_t));
+    memset(f, 0, sizeof(*f));
+}
+
+const void* _kvm_frozen_get(const void* fv, size_t kb, size_t vb,
+                            const void* pkey) {
+    const kvm_frozen_t* f = fv;
+    if (f->n == 0) { return 0; }
+    const uint64_t key = _kvm_key(pkey, kb);
+    const uint64_t hash = _kvm_hash64(key);
+    const uint32_t p = f->pilots[_kvm_bucket(hash, f->buckets)];
+    size_t i = _kvm_pilot_slot(hash, p, f->slots);
+    if (i >= f->n) { i = f->remap[i - f->n]; }
+    _kvm_prefetch(f->pv + i * vb); // value miss overlaps the key miss
+    return _kvm_key_at(f->pk, kb, i) == key ? f->pv + i * vb : 0;
+}
+
+static void _kvm_freeze_release(kvm_frozen_t* f, uint64_t* hash,
+        size_t* from, size_t* start, size_t* order, uint64_t* taken,
+        const size_t n, const size_t buckets, const size_t slots) {
+    // frees scratch arrays of _kvm_freeze()
+    _kvm_frozen_deallocate(f, hash, n * sizeof(uint64_t));
+    _kvm_frozen_deallocate(f, from, n * sizeof(size_t));
+    _kvm_frozen_deallocate(f, start, (buckets + 1) * sizeof(size_t));
+    _kvm_frozen_deallocate(f, order, buckets * sizeof(size_t));
+    _kvm_frozen_deallocate(f, taken, _kvm_bm_bytes(slots));
+}
+
+bool _kvm_freeze(const void* mv, size_t c, size_t kb, size_t vb,
+                 void* fv, bool same_types) {
+    const kvm_t* m = mv;
+    kvm_frozen_t* f = fv;
+    if (!same_types) {
+        kvm_fatal_return_zero("frozen map key or value type mismatch\n");
+    }
+    memset(f, 0, sizeof(*f));
+    f->allocator = m->allocator;
+    size_t n = 0; // expired entries are not frozen
+    size_t i = _kvm_next_occupied(m->bm, 0, c);
+    while (i < c) {
+        n += !_kvm_expired(m, i);
+        i = _kvm_next_occupied(m->bm, i + 1, c);
+    }
+    if (n == 0) { return true; }
+    const size_t buckets = (n + _kvm_bucket_keys - 1) / _kvm_bucket_keys;
+    const size_t slots = n + n / 20 + 1;
+    // hashes and source slots of keys ordered by bucket:
+    const size_t sb = (buckets + 1) * sizeof(size_t);
+    uint64_t* hash  = _kvm_frozen_allocate(f, n * sizeof(uint64_t));
+    size_t*   from  = _kvm_frozen_allocate(f, n * sizeof(size_t));
+    size_t*   start = _kvm_frozen_allocate(f, sb);
+    size_t*   order = _kvm_frozen_allocate(f, buckets * sizeof(size_t));
+    uint64_t* taken = _kvm_frozen_allocate(f, _kvm_bm_bytes(slots));
+    f->n = n;
+    f->slots = slots;
+    f->buckets = buckets;
+    f->pk = _kvm_frozen_allocate(f, n * kb);
+    f->pv = vb > 0 ? _kvm_frozen_allocate(f, n * vb) : 0;
+    f->pilots = _kvm_frozen_allocate(f, buckets * sizeof(uint32_t));
+    f->remap  = _kvm_frozen_allocate(f, (slots - n) * sizeof(size_t));
+    if (!hash || !from || !start || !order || !taken || !f->pk ||
+        (vb > 0 && !f->pv) || !f->pilots || !f->remap) {
+        _kvm_freeze_release(f, hash, from, start, order, taken,
+                            n, buckets, slots);
+        _kvm_frozen_free(f, kb, vb);
+        kvm_fatal_return_zero("out of memory\n");
+    }
+    memset(start, 0, sb);
+    memset(taken, 0, _kvm_bm_bytes(slots));
+    i = _kvm_next_occupied(m->bm, 0, c);
+    while (i < c) { // keys per bucket
+        if (!_kvm_expired(m, i)) {
+            const uint64_t h = _kvm_hash64(_kvm_key_at(m->pk, kb, i));
+            start[_kvm_bucket(h, buckets) + 1]++;
+        }
+        i = _kvm_next_occupied(m->bm, i + 1, c);
+    }
+    size_t largest = 0;
+    for (size_t b = 0; b < buckets; b++) {
+        if (start[b + 1] > largest) { largest = start[b + 1]; }
+        start[b + 1] += start[b];
+        order[b] = start[b]; // fill position
+    }
+    i = _kvm_next_occupied(m->bm, 0, c);
+    while (i < c) {
+        if (!_kvm_expired(m, i)) {
+            const uint64_t h = _kvm_hash64(_kvm_key_at(m->pk, kb, i));
+            const size_t j = order[_kvm_bucket(h, buckets)]++;
+            hash[j] = h;
+            from[j] = i;
+        }
+        i = _kvm_next_occupied(m->bm, i + 1, c);
+    }
+    // buckets by size, largest first (counting sort by size)
+    size_t counts[64];
+    size_t* count = largest < 64 ? counts : 0;
+    if (!count) {
+        count = _kvm_frozen_allocate(f, (largest + 1) * sizeof(size_t));
+        if (!count) {
+            _kvm_freeze_release(f, hash, from, start, order, taken,
+                                n, buckets, slots);
+            _kvm_frozen_free(f, kb, vb);
+            kvm_fatal_return_zero("out of memory\n");
+        }
+    }
+    memset(count, 0, (largest + 1) * sizeof(size_t));
+    for (size_t b = 0; b < buckets; b++) {
+        count[largest - (start[b + 1] - start[b])]++;
+    }
+    size_t sum = 0;
+    for (size_t k = 0; k <= largest; k++) {
+        const size_t t = count[k];
+        count[k] = sum;
+        sum += t;
+    }
+    for (size_t b = 0; b < buckets; b++) {
+        order[count[largest - (start[b + 1] - start[b])]++] = b;
+    }
+    if (count != counts) {
+        _kvm_frozen_deallocate(f, count, (largest + 1) * sizeof(size_t));
+    }
+    // pilot search:
+    for (size_t o = 0; o < buckets; o++) {
+        const size_t b = order[o];
+        const size_t s = start[b];
+        const size_t e = start[b + 1];
+        uint32_t p = 0;
+        if (e > s) {
+            for (;;) {
+                bool fits = true;
+                for (size_t j = s; j < e && fits; j++) {
+                    const size_t x = _kvm_pilot_slot(hash[j], p, slots);
+                    fits = _kvm_bm_is_empty(taken, x);
+                    if (fits) {
+                        _kvm_bm_incl(taken, x);
+                    } else { // release slots taken with this pilot
+                        for (size_t r = s; r < j; r++) {
+                            const size_t y = _kvm_pilot_slot(hash[r], p, slots);
+                            _kvm_bm_excl(taken, y);
+                        }
+                    }
+                }
+                if (fits) { break; }
+                p++;
+                if (p == 0) { // all 2^32 pilots tried
+                    _kvm_freeze_release(f, hash, from, start, order, taken,
+                                        n, buckets, slots);
+                    _kvm_frozen_free(f, kb, vb);
+                    kvm_fatal_return_zero("cannot place bucket\n");
+                }
+            }
+        }
+        f->pilots[b] = p;
+    }
+    // slots >= n move to holes below n in order:
+    size_t hole = 0;
+    for (size_t x = n; x < slots; x++) {
+        if (!_kvm_bm_is_empty(taken, x)) {
+            while (!_kvm_bm_is_empty(taken, hole)) { hole++; }
+            f->remap[x - n] = hole++;
+        } else {
+            f->remap[x - n] = 0; // never looked up
+        }
+    }
+    for (size_t j = 0; j < n; j++) {
+        const uint64_t h = hash[j];
+        size_t x = _kvm_pilot_slot(h, f->pilots[_kvm_bucket(h, buckets)], slots);
+        if (x >= n) { x = f->remap[x - n]; }
+        _kvm_set_at(f->pk, x, m->pk + from[j] * kb, kb);
+        if (vb > 0) { _kvm_set_at(f->pv, x, m->pv + from[j] * vb, vb); }
+    }
+    _kvm_freeze_release(f, hash, from, start, order, taken,
+                        n, buckets, slots);
+    return true;
+}
+
+bool _kvm_tombstones(void* mv, size_t c, size_t kb, size_t vb,
+                     void* tombs, bool on) {
+    kvm_t* m = mv;
+    if (on && !_kvm_x(m)->tb) {
+        if (m->a == 0 && m->n + 1 >= c) {
+            kvm_fatal_return_zero("map is full\n");
+        }
+        if (m->a == 0 && !tombs) {
+            kvm_fatal_return_zero("no tombstones bitmap\n");
+        }
+        struct _kvm_ext* x = _kvm_ext_of(m);
+        if (!x) { kvm_fatal_return_zero("out of memory\n"); }
+        if (m->a != 0) {
+            x->tb = _kvm_allocate(m, x->huge, _kvm_bm_bytes(c), true);
+            if (!x->tb) { kvm_fatal_return_zero("out of memory\n"); }
+        } else {
+            x->tb = tombs;
+            memset(x->tb, 0, ((c + 63) / 64) * sizeof(uint64_t));
+        }
+        x->t = 0;
+    } else if (!on && _kvm_x(m)->tb) {
+        if (m->ext->t > 0) { _kvm_purge(m, c, kb, vb); }
+        if (m->a != 0) {
+            _kvm_deallocate(m, m->ext->huge, m->ext->tb, _kvm_bm_bytes(c));
+        }
+        m->ext->tb = 0;
+    }
+    return true;
+}
+
+size_t _kvm_compact(void* mv, size_t c, size_t kb, size_t vb) {
+    kvm_t* m = mv;
+    const size_t t = _kvm_x(m)->t;
+    if (t > 0) { _kvm_purge(m, c, kb, vb); }
+    return t;
+}
+
+bool _kvm_reserve(void* mv, size_t c, size_t kb, size_t vb, size_t n) {
+    kvm_t* m = mv;
+    if (m->a == 0) {
+        const size_t fits = _kvm_x(m)->tb ? c - 1 : c; // see kvm_tombstones()
+        if (n > fits) {
+            kvm_fatal_return_zero("fixed map capacity: %zd\n", c);
+        }
+        return true;
+    } else {
+        const size_t a = _kvm_fit(m, n);
+        if (a > m->r) { m->r = a; }
+        return a <= m->a || _kvm_resize(m, kb, vb, a);
+    }
+}
+
+bool _kvm_shrink_to_fit(void* mv, size_t kb, size_t vb) {
+    kvm_t* m = mv;
+    if (m->a == 0) { return true; } // fixed map
+    const size_t a = _kvm_fit(m, m->n);
+    m->r = a;
+    return a >= m->a || _kvm_resize(m, kb, vb, a);
+}
+
+bool _kvm_load_factors(void* mv, size_t load, size_t growth, size_t low) {
+    kvm_t* m = mv;
+    // after growing or shrinking the load must stay above low-water mark:
+    if (load < 10 || load > 95 || growth < 110 || growth > 1000 ||
+        low * growth >= load * 100) {
+        kvm_fatal_return_zero("invalid load factors: %zd %zd %zd\n",
+                              load, growth, low);
+    }
+    struct _kvm_ext* x = _kvm_ext_of(m);
+    if (!x) { kvm_fatal_return_zero("out of memory\n"); }
+    x->load   = (uint16_t)load;
+    x->growth = (uint16_t)growth;
+    x->low    = (uint16_t)low;
+    return true;
+}
+
+bool _kvm_huge_pages(void* mv, size_t kb, size_t vb, bool on, bool populate) {
+    kvm_t* m = mv;
+    if (m->a == 0) { return true; } // fixed maps live in caller memory
+    const uint8_t huge = on ? (uint8_t)(_kvm_huge |
+                              (populate ? _kvm_populate : 0)) : 0;
+    struct _kvm_ext* x = _kvm_ext_of(m);
+    if (!x) { kvm_fatal_return_zero("out of memory\n"); }
+    if (!m->allocator && ((huge ^ x->huge) & _kvm_huge) != 0) {
+        // move arrays to the other kind of memory, slots stay in place:
+        const size_t a  = m->a;
+        const size_t bb = _kvm_bm_bytes(a);
+        uint8_t*  pk = _kvm_allocate(m, huge, a * kb, false);
+        uint8_t*  pv = vb != 0 ? _kvm_allocate(m, huge, a * vb, false) : 0;
+        uint64_t* bm = _kvm_allocate(m, huge, bb, false);
+        uint64_t* tb = x->tb ? _kvm_allocate(m, huge, bb, false) : 0;
+        const size_t wb = _kvm_wheel_bytes(a);
+        struct _kvm_wheel* w = x->wheel ? _kvm_allocate(m, huge, wb, false) : 0;
+        const size_t rbb = _kvm_rb_bytes(a);
+        uint64_t* rb = x->rb ? _kvm_allocate(m, huge, rbb, false) : 0;
+        if (!pk || (vb != 0 && !pv) || !bm || (x->tb && !tb) ||
+            (x->wheel && !w) || (x->rb && !rb)) {
+            _kvm_deallocate(m, huge, pk, a * kb);
+            _kvm_deallocate(m, huge, pv, a * vb);
+            _kvm_deallocate(m, huge, bm, bb);
+            _kvm_deallocate(m, huge, tb, bb);
+            _kvm_deallocate(m, huge, w, wb);
+            _kvm_deallocate(m, huge, rb, rbb);
+            kvm_fatal_return_zero("out of memory\n");
+        }
+        if (x->rb) {
+            memcpy(rb, x->rb, rbb);
+            _kvm_deallocate(m, x->huge, x->rb, rbb);
+            x->rb = rb;
+        }
+        if (x->wheel) {
+            memcpy(w, x->wheel, wb);
+            _kvm_deallocate(m, x->huge, x->wheel, wb);
+            x->wheel = w;
+        }
+        memcpy(pk, m->pk, a * kb);
+        if (vb != 0) { memcpy(pv, m->pv, a * vb); }
+        memcpy(bm, m->bm, bb);
+        if (x->tb) {
+            memcpy(tb, x->tb, bb);
+            _kvm_deallocate(m, x->huge, x->tb, bb);
+            x->tb = tb;
+        }
+        _kvm_set_pointers(m, kb, vb, pk, pv, bm);
+    }
+    x->huge = huge;
+    return true;
+}
+
+bool _kvm_expiry(void* mv, bool on, uint64_t (*clock)(void)) {
+    kvm_t* m = mv;
+    if (m->a == 0) {
+        kvm_fatal_return_zero("expiry requires heap map\n");
+    } else if (on && !_kvm_x(m)->wheel) {
+        if (m->a >= UINT32_MAX - _kvm_wheel_sentinels) {
+            kvm_fatal_return_zero("expiry capacity overflow: %zd\n", m->a);
+        }
+        struct _kvm_ext* x = _kvm_ext_of(m);
+        if (!x) { kvm_fatal_return_zero("out of memory\n"); }
+        x->wheel = _kvm_allocate(m, x->huge, _kvm_wheel_bytes(m->a), false);
+        if (!x->wheel) { kvm_fatal_return_zero("out of memory\n"); }
+        x->wheel->now = clock ? clock() : 0;
+        _kvm_wheel_reset(x->wheel, m->a);
+    } else if (!on && _kvm_x(m)->wheel) {
+        _kvm_deallocate(m, m->ext->huge, m->ext->wheel,
+                        _kvm_wheel_bytes(m->a));
+        m->ext->wheel = 0;
+    }
+    if (_kvm_x(m)->wheel) { m->ext->wheel->clock = clock; }
+    return true;
+}
+
+bool _kvm_expire_at(void* mv, const size_t c, size_t kb, size_t vb,
+                    const void* pkey, uint64_t deadline) {
+    kvm_t* m = mv;
+    struct _kvm_wheel* w = _kvm_x(m)->wheel;
+    if (!w) { kvm_fatal_return_zero("expiry is off\n"); }
+    (void)vb;
+    // not a use of the entry: kvm_cache() counters are not touched
+    const uint64_t key = _kvm_key(pkey, kb);
+    const size_t i = _kvm_find(m, c, kb, key, _kvm_hash(key, c));
+    const bool found = i < c && !_kvm_expired(m, i);
+    if (found) {
+        _kvm_timer_unlink(m, i);
+        if (deadline != 0) { _kvm_timer_link(w, c, i, deadline); }
     }
     return found;
 }
 
+static size_t _kvm_wheel_drain(kvm_t* m, const size_t kb, const size_t vb,
+                               const size_t sentinel, const bool expire) {
+    // removes entries of the bucket or cascades them to lower levels
+    struct _kvm_wheel* w = _kvm_x(m)->wheel;
+    struct _kvm_timer* t = w->t;
+    size_t expired = 0;
+    // removing entries moves other timers, always take the first one:
+    while (t[sentinel].next != sentinel) {
+        const size_t i = t[sentinel].next;
+        const uint64_t deadline = t[i].deadline;
+        _kvm_timer_unlink(m, i);
+        if (expire) {
+            const uint8_t* pkey = m->pk + i * kb;
+            _kvm_remove(m, m->a, kb, vb, pkey, _kvm_hash_key(pkey, kb));
+            expired++;
+        } else {
+            _kvm_timer_link(w, m->a, i, deadline); // to a lower level
+        }
+    }
+    return expired;
+}
+
+size_t _kvm_expire(void* mv, size_t kb, size_t vb, uint64_t now) {
+    kvm_t* m = mv;
+    struct _kvm_wheel* w = _kvm_x(m)->wheel;
+    if (!w) { return 0; }
+    size_t expired = _kvm_wheel_drain(m, kb, vb,
+                                      m->a + _kvm_wheel_overdue, true);
+    for (;;) {
+        // earliest not empty bucket, on ties higher levels cascade first:
+        size_t level = _kvm_wheel_levels;
+        size_t slot  = 0;
+        uint64_t start = UINT64_MAX;
+        for (size_t l = 0; l < _kvm_wheel_levels; l++) {
+            const size_t shift = l * 6;
+            const size_t current = (size_t)(w->now >> shift) & 63;
+            const uint64_t mask = w->bits[l] & (~0uLL << current);
+            if (mask != 0) {
+                const size_t s = _kvm_ctz64(mask);
+                const uint64_t upper = shift + 6 < 64 ?
+                    w->now >> (shift + 6) << (shift + 6) : 0;
+                const uint64_t b = upper | ((uint64_t)s << shift);
+                if (b <= start) { level = l; slot = s; start = b; }
+            }
+        }
+        if (level == _kvm_wheel_levels || start > now) { break; }
+        w->bits[level] &= ~(1uLL << slot);
+        if (start > w->now) { w->now = start; }
+        expired += _kvm_wheel_drain(m, kb, vb, m->a + level * 64 + slot,
+                                    level == 0);
+        if (level == 0) {
+            if (start == UINT64_MAX) { break; }
+            w->now = start + 1;
+        }
+    }
+    // no deadlines before the earliest bucket, safe to move wheel time:
+    if (now >= w->now && now < UINT64_MAX) { w->now = now + 1; }
+    if (expired > 0) { _kvm_shrink_if_sparse(m, kb, vb); }
+    return expired;
+}
+
+bool _kvm_cache(void* mv, size_t c, size_t kb, size_t vb, void* refs,
+        size_t n, void (*evict)(void* context, const void* key, void* val),
+        void* context) {
+    kvm_t* m = mv;
+    if (m->a == 0) {
+        // one slot for the entry inserted right before eviction:
+        const size_t fits = _kvm_x(m)->tb ? c - 1 : c; // see kvm_tombstones()
+        if (n >= fits) {
+            kvm_fatal_return_zero("fixed map capacity: %zd\n", c);
+        }
+    } else if (n != 0) {
+        // evictions leave tombstones, room for n / 4 of them amortizes
+        // purging to O(1) per eviction:
+        const size_t tombs = _kvm_x(m)->tb ? n / 4 : 0;
+        if (!_kvm_reserve(m, c, kb, vb, n + 1 + tombs)) {
+            return false; // fatal already called
+        }
+    }
+    c = m->a > 0 ? m->a : c;
+    if (n == 0 && !m->ext) { return true; } // cache was never on
+    if (n != 0 && m->a == 0 && !refs && !_kvm_x(m)->rb) {
+        kvm_fatal_return_zero("no cache counters\n");
+    }
+    struct _kvm_ext* x = _kvm_ext_of(m);
+    if (!x) { kvm_fatal_return_zero("out of memory\n"); }
+    if (n != 0 && !x->rb) { // existing entries start unreferenced
+        if (m->a != 0) {
+            x->rb = _kvm_allocate(m, x->huge, _kvm_rb_bytes(c), true);
+            if (!x->rb) { kvm_fatal_return_zero("out of memory\n"); }
+        } else {
+            x->rb = refs;
+            memset(x->rb, 0, _kvm_rb_bytes(c));
+        }
+        x->hand = 0;
+        x->step = _kvm_hand_step(c);
+    } else if (n == 0 && x->rb) {
+        if (m->a != 0) { _kvm_deallocate(m, x->huge, x->rb, _kvm_rb_bytes(c)); }
+        x->rb = 0;
+    }
+    x->cache = n;
+    x->evict = n != 0 ? evict : 0;
+    x->context = n != 0 ? context : 0;
+    while (n != 0 && m->n > n) { _kvm_evict(m, c, kb, vb, c); }
+    return true;
+}
+
+bool _kvm_bloom(void* mv, size_t c, size_t kb, bool on) {
+    kvm_t* m = mv;
+    if (m->a == 0) {
+        kvm_fatal_return_zero("bloom filter requires heap map\n");
+    } else if (on && !_kvm_x(m)->bf) {
+        struct _kvm_ext* x = _kvm_ext_of(m);
+        if (!x) { kvm_fatal_return_zero("out of memory\n"); }
+        const size_t blocks = _kvm_bf_blocks(c);
+        x->bf = _kvm_allocate(m, 0, _kvm_bf_bytes(blocks), false);
+        if (!x->bf) { kvm_fatal_return_zero("out of memory\n"); }
+        x->blocks = blocks;
+        _kvm_bloom_rebuild(m, c, kb);
+    } else if (!on && _kvm_x(m)->bf) {
+        struct _kvm_ext* x = m->ext;
+        _kvm_deallocate(m, 0, x->bf, _kvm_bf_bytes(x->blocks));
+        x->bf = 0;
+        x->blocks = 0;
+        x->stale  = 0;
+    }
+    return true;
+}
+
+// kvm_stats() scans whole clusters starting from an empty slot. A miss
+// starting at offset j of a cluster of length L probes L - j slots and
+// the empty slot after it, so a cluster adds (L + 1) * (L + 2) / 2 - 1
+// probes to the sum over all home slots and an empty slot adds 1.
+
+enum { _kvm_stats_window = 1024 };
+
+struct _kvm_stats_sums {
+    double hits;    // sum of probe lengths of present keys
+    double misses;  // sum of miss probe lengths of scanned home slots
+    size_t entries; // present keys scanned
+};
+
+static inline bool _kvm_stats_empty(const kvm_t* m, const size_t i) {
+    // tombstones do not terminate probing and belong to clusters
+    const uint64_t* tb = _kvm_x(m)->tb;
+    return _kvm_is_empty(m, i) && (!tb || _kvm_bm_is_empty(tb, i));
+}
+
+static void _kvm_stats_cluster(struct kvm_stats* s,
+                               struct _kvm_stats_sums* sums, size_t run) {
+    size_t bucket = 63 - _kvm_clz64(run);
+    if (bucket >= kvm_stats_clusters) { bucket = kvm_stats_clusters - 1; }
+    s->cluster[bucket]++;
+    s->clusters++;
+    if (run > s->cluster_max) { s->cluster_max = run; }
+    if (run + 1 > s->miss_max) { s->miss_max = run + 1; }
+    sums->misses += (double)(run + 1) * (double)(run + 2) / 2 - 1;
+}
+
+static size_t _kvm_stats_scan(const kvm_t* m, const size_t c, const size_t kb,
+        struct kvm_stats* s, struct _kvm_stats_sums* sums,
+        const size_t start, const size_t slots, const size_t limit) {
+    // scans at least `slots` slots from `start` up to the end of the
+    // cluster but no more than `limit`, returns number of scanned slots
+    size_t count = 0;
+    size_t run = 0;
+    while (count < limit && (count < slots || run > 0)) {
+        const size_t i = (start + count) % c;
+        if (!_kvm_is_empty(m, i)) {
+            const size_t h = _kvm_hash(_kvm_key_at(m->pk, kb, i), c);
+            const size_t probes = (i + c - h) % c + 1;
+            sums->hits += (double)probes;
+            sums->entries++;
+            if (probes > s->hit_max) { s->hit_max = probes; }
+        }
+        if (!_kvm_stats_empty(m, i)) {
+            run++;
+        } else {
+            if (run > 0) { _kvm_stats_cluster(s, sums, run); run = 0; }
+            sums->misses += 1;
+            if (s->miss_max == 0) { s->miss_max = 1; }
+        }
+        count++;
+    }
+    if (run > 0) { _kvm_stats_cluster(s, sums, run); }
+    return count;
+}
+
+void _kvm_stats(const void* mv, size_t c, size_t kb, size_t vb,
+                struct kvm_stats* s, size_t sample) {
+    const kvm_t* m = mv;
+    memset(s, 0, sizeof(*s));
+    s->capacity = c;
+    s->n = m->n;
+    const struct _kvm_ext* x = _kvm_x(m);
+    s->tombstones = x->t;
+    s->load = (double)m->n / (double)c;
+    s->grows = m->grows;
+    s->key_bytes = c * kb;
+    s->val_bytes = c * vb;
+    s->bitmap_bytes = _kvm_bm_bytes(c) * (x->tb ? 2 : 1) +
+                      (x->rb ? _kvm_rb_bytes(c) : 0);
+    s->other_bytes = (x->bf ? _kvm_bf_bytes(x->blocks) : 0) +
+                     (x->wheel ? _kvm_wheel_bytes(c) : 0);
+    // offsets are relative to an empty slot so no cluster is cut in two
+    size_t start = 0;
+    while (start < c && !_kvm_stats_empty(m, start)) { start++; }
+    if (start == c) { start = 0; } // no empty slots
+    struct _kvm_stats_sums sums = {0};
+    if (sample == 0 || sample >= c) {
+        s->sampled = _kvm_stats_scan(m, c, kb, s, &sums, start, c, c);
+    } else {
+        const size_t windows = (sample + _kvm_stats_window - 1) /
+                               _kvm_stats_window;
+        const size_t stride = c / windows;
+        size_t end = 0; // offset past the last scanned slot
+        for (size_t w = 0; w < windows; w++) {
+            size_t o = w * stride > end ? w * stride : end;
+            while (o < c && !_kvm_stats_empty(m, (start + o) % c)) { o++; }
+            if (o >= c) { break; }
+            const size_t count = _kvm_stats_scan(m, c, kb, s, &sums,
+                (start + o) % c, _kvm_stats_window, c - o);
+            s->sampled += count;
+            end = o + count;
+        }
+    }
+    s->hit_mean  = sums.entries > 0 ? sums.hits / (double)sums.entries : 0;
+    s->miss_mean = s->sampled > 0 ? sums.misses / (double)s->sampled : 0;
+}
+
+struct kvm_iterator _kvm_iterator(void* mv, size_t c) {
+    kvm_t* m = mv;
+    struct kvm_iterator iterator = {
+        .next = _kvm_next_occupied(m->bm, 0, c), .c = c, .m = mv, .mc = m->mc
+    };
+    return iterator;
+}
+
+bool kvm_has_next(struct kvm_iterator* iterator) {
+    kvm_t* m = iterator->m;
+    if (m->mc != iterator->mc) {
+        kvm_fatal_return_zero("map modified during iteration\n");
+    }
+    return iterator->next < iterator->c;
+}
+
+void* _kvm_next(struct kvm_iterator* iterator, size_t kb, size_t vb,
+                void* pval) {
+    kvm_t* m = iterator->m;
+    if (m->mc != iterator->mc) {
+        kvm_fatal_return_zero("map modified during iteration\n");
+    } else if (iterator->next < iterator->c) {
+        const size_t i = iterator->next;
+        const size_t next = _kvm_next_occupied(m->bm, i + 1, iterator->c);
+        iterator->next = next;
+        _kvm_prefetch(m->pk + next * kb + _kvm_prefetch_distance);
+        if (vb != 0) {
+            _kvm_prefetch(m->pv + next * vb + _kvm_prefetch_distance);
+        }
+        if (pval) { memcpy(pval, m->pv + i * vb, vb); }
+        return m->pk + i * kb;
+    } else {
+        return 0;
+    }
+}
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -11,6 +11,11 @@ extern "C" {
 
 int kvm_tests(void);
 int map_tests(void);
+int cmap_tests(void);
+int omap_tests(void);
+int cuckoo_tests(void);
+
+bool tests_large; // --large: benchmarks also run far beyond CPU caches
 
 static uint64_t seed;
 
@@ -123,10 +128,20 @@ static void set_on_signal(void) {
 }
 
 int main(int argc, const char* argv[]) {
-    (void)argc; (void)argv; // unused
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--large") == 0) {
+            tests_large = true;
+        } else {
+            fprintf(stderr, "usage: %s [--large]\n", argv[0]);
+            return 1;
+        }
+    }
     set_on_signal();
     if (kvm_tests()) { return 1; }
     if (map_tests()) { return 1; }
+    if (cmap_tests()) { return 1; }
+    if (omap_tests()) { return 1; }
+    if (cuckoo_tests()) { return 1; }
     if (cpp_test1()) { return 1; }
     if (cpp_test2()) { return 1; }
     return 0;
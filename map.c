@@ -15,6 +15,8 @@
 
 static uint64_t seed = 1;
 
+extern bool tests_large; // main.cpp --large
+
 static int test0(void) {
     map(int, double, 16) m;
     map_alloc(&m);
@@ -322,6 +324,17 @@ static int test7(void) {
     map_put(&m, "Hello", "");
     swear(strcmp(*map_get(&m, ""), "Hello") == 0);
     swear(strcmp(*map_get(&m, "Hello"), "") == 0);
+    map_put(&m, "Hello", "world"); // previous value copy is freed
+    swear(strcmp(*map_get(&m, "Hello"), "world") == 0 && m.n == 2);
+    // map_clear() restarts insertion order, cleared entries are not listed
+    size_t count = 0;
+    iterator = map_iterator(&m);
+    while (map_has_next(&iterator)) {
+        const char* key = *map_next(&m, &iterator);
+        swear(strcmp(key, count == 0 ? "" : "Hello") == 0);
+        count++;
+    }
+    swear(count == m.n);
     map_free(&m);
     free(hello);
     free(good_bye);
@@ -374,10 +387,875 @@ static int test8(void) {
     return 0;
 }
 
+static int test9(void) {
+    const char* k[] = {"session", "quota", "feature"};
+    char* dup = strdup(k[0]);
+    map(const char*, int) m0;
+    map(const char*, const char*, map_heap, map_strdup) m1;
+    map_alloc(&m0, 4);
+    map_alloc(&m1, 4);
+    for (size_t i = 0; i < countof(k); i++) {
+        const uint64_t h = map_hash_key(&m0, k[i]);
+        swear(h == map_hash_key(&m1, k[i]));
+        swear(map_put_hashed(&m0, k[i], (int)i, h));
+        swear(map_put_hashed(&m1, k[i], k[i], h));
+    }
+    const uint64_t h = map_hash_key(&m0, dup); // hash of content
+    swear(h == map_hash_key(&m0, k[0]));
+    swear(*map_get_hashed(&m0, dup, h) == 0);
+    swear(strcmp(*map_get_hashed(&m1, dup, h), k[0]) == 0);
+    swear(map_delete_hashed(&m0, dup, h));
+    swear(map_delete_hashed(&m1, dup, h));
+    swear(!map_get(&m0, k[0]) && !map_get(&m1, k[0]));
+    swear(m0.n == 2 && m1.n == 2);
+    map_free(&m0);
+    map_free(&m1);
+    free(dup);
+    return 0;
+}
+
+static int test10_cmp(uint64_t k0, uint64_t k1) {
+    return (int)(k0 % 100) - (int)(k1 % 100);
+}
+
+static uint64_t test10_hash(uint64_t key) { return key % 100; }
+
+static int test10(void) {
+    // custom comparators are still honored by map_get/map_put/map_delete
+    map(uint64_t, int) m;
+    map_alloc(&m, 4);
+    m.cmp  = test10_cmp;
+    m.hash = test10_hash;
+    for (int i = 0; i < 100; i++) { map_put(&m, (uint64_t)i, i); }
+    swear(m.n == 100);
+    swear(*map_get(&m, 142) == 42); // 142 % 100 == 42
+    map_put(&m, 242, -42);
+    swear(m.n == 100 && *map_get(&m, 42) == -42);
+    swear(map_delete(&m, 342));
+    swear(!map_get(&m, 42) && m.n == 99);
+    map_free(&m);
+    return 0;
+}
+
+static int test11(void) {
+    // tombstones: random puts and deletes against reference arrays,
+    // insertion order must survive purging
+    enum { n = 2048 };
+    static uint64_t ref[n];   // 0 absent
+    static uint64_t order[n]; // insertion stamp
+    memset(ref, 0, sizeof(ref));
+    map(uint64_t, uint64_t) m;
+    map_alloc(&m, 4);
+    swear(map_tombstones(&m, true));
+    uint64_t stamp = 0;
+    for (int i = 0; i < 100 * 1000; i++) {
+        const uint64_t key = random64(&seed) % n;
+        if (random64(&seed) % 2 == 0) {
+            swear(map_delete(&m, key) == (ref[key] != 0));
+            ref[key] = 0;
+        } else {
+            const uint64_t val = random64(&seed) | 1;
+            swear(map_put(&m, key, val));
+            if (ref[key] == 0) { order[key] = ++stamp; }
+            ref[key] = val;
+        }
+        if (i % 10000 == 0) { map_compact(&m); }
+        if (i % 1000 == 0) {
+            size_t count = 0;
+            uint64_t last = 0;
+            struct map_iterator iterator = map_iterator(&m);
+            while (map_has_next(&iterator)) {
+                uint64_t val = 0;
+                const uint64_t key = *map_next_entry(&m, &iterator, &val);
+                swear(ref[key] == val && order[key] > last);
+                last = order[key];
+                count++;
+            }
+            swear(count == m.n);
+        }
+    }
+    swear(map_tombstones(&m, false));
+    struct map_stats s;
+    map_stats(&m, &s, 0);
+    swear(s.tombstones == 0 && s.bitmap_bytes ==
+          map_tombstones_words(map_capacity(&m)) * sizeof(uint64_t));
+    for (uint64_t key = 0; key < n; key++) {
+        uint64_t* r = map_get(&m, key);
+        swear(ref[key] == 0 ? r == null : *r == ref[key]);
+    }
+    map_free(&m);
+    map(const char*, const char*, 16, map_strdup) f; // fixed with strdup()
+    map_alloc(&f);
+    uint64_t tombs[map_tombstones_words(16)];
+    swear(map_tombstones(&f, true, tombs));
+    char key[16];
+    for (int i = 0; i < 1000; i++) {
+        snprintf(key, countof(key), "%d", i % 12);
+        if (i % 3 == 0) {
+            map_delete(&f, key);
+            swear(map_get(&f, key) == null);
+        } else {
+            swear(map_put(&f, key, key));
+            swear(strcmp(*map_get(&f, key), key) == 0);
+        }
+    }
+    map_free(&f);
+    return 0;
+}
+
+static int test12(void) {
+    // shrinking keeps insertion order
+    map(uint32_t, uint32_t) m;
+    map_alloc(&m, 4);
+    swear(map_load_factors(&m, 90, 200, 20));
+    for (uint32_t i = 0; i < 10 * 1000; i++) { map_put(&m, i, i); }
+    const size_t peak = m.a;
+    swear(peak * 90 / 100 >= m.n && peak * 50 / 100 < m.n);
+    for (uint32_t i = 0; i < 10 * 1000; i++) {
+        if (i % 100 != 0) { map_delete(&m, i); }
+    }
+    swear(m.n == 100 && m.a < peak / 8); // shrunk automatically
+    uint32_t order[100];
+    size_t count = 0;
+    struct map_iterator iterator = map_iterator(&m);
+    while (map_has_next(&iterator)) { order[count++] = *map_next(&m, &iterator); }
+    swear(map_shrink_to_fit(&m) && m.a < 200);
+    count = 0;
+    iterator = map_iterator(&m);
+    while (map_has_next(&iterator)) {
+        uint32_t val = 0;
+        const uint32_t key = *map_next_entry(&m, &iterator, &val);
+        swear(key == order[count] && val == key && key % 100 == 0);
+        count++;
+    }
+    swear(count == 100);
+    swear(map_reserve(&m, 1000));
+    const size_t reserved = m.a;
+    for (uint32_t i = 0; i < 900; i++) { map_put(&m, i + 1, i); }
+    swear(m.a == reserved); // did not grow
+    for (uint32_t i = 0; i < 10 * 1000; i++) { map_delete(&m, i); }
+    swear(m.a == reserved && m.n == 0 && m.head == null);
+    map_free(&m);
+    return 0;
+}
+
+static int test13(void) {
+    // huge pages move list nodes and keep insertion order
+    map(uint32_t, uint32_t) m;
+    map_alloc(&m, 4);
+    for (uint32_t i = 0; i < 500 * 1000; i++) { map_put(&m, i, i); }
+    swear(map_huge_pages(&m, true, true));
+    for (uint32_t i = 500 * 1000; i < 1000 * 1000; i++) { map_put(&m, i, i); }
+    swear(map_huge_pages(&m, false, false));
+    uint32_t next = 0;
+    struct map_iterator iterator = map_iterator(&m);
+    while (map_has_next(&iterator)) {
+        uint32_t val = 0;
+        const uint32_t key = *map_next_entry(&m, &iterator, &val);
+        swear(key == next && val == next);
+        next++;
+    }
+    swear(next == 1000 * 1000);
+    swear(map_huge_pages(&m, true, false));
+    map_free(&m);
+    return 0;
+}
+
+typedef struct test14_arena_s { // per-request bump arena
+    uint8_t* base;
+    size_t   used;
+    size_t   size;
+    size_t   allocated; // bytes
+    size_t   freed;     // bytes
+} test14_arena_t;
+
+static void* test14_alloc(void* context, size_t bytes) {
+    test14_arena_t* arena = context;
+    const size_t aligned = (bytes + 15) & ~(size_t)15;
+    if (arena->used + aligned > arena->size) { return null; }
+    void* p = arena->base + arena->used;
+    arena->used += aligned;
+    arena->allocated += bytes;
+    return p;
+}
+
+static void* test14_zalloc(void* context, size_t bytes) {
+    void* p = test14_alloc(context, bytes);
+    if (p) { memset(p, 0, bytes); }
+    return p;
+}
+
+static void test14_free(void* context, void* p, size_t bytes) {
+    // memory is released all at once with the arena
+    test14_arena_t* arena = context;
+    swear(arena->base <= (uint8_t*)p && (uint8_t*)p < arena->base + arena->used);
+    arena->freed += bytes;
+}
+
+static int test14(void) {
+    enum { requests = 100 * 1000, headers = 16 };
+    static uint8_t memory[64 * 1024];
+    test14_arena_t arena = { memory, 0, sizeof(memory), 0, 0 };
+    struct map_allocator allocator = {
+        test14_alloc, test14_zalloc, test14_free, &arena
+    };
+    char keys[headers][16];
+    char vals[headers][16];
+    for (int i = 0; i < headers; i++) {
+        snprintf(keys[i], countof(keys[i]), "header-%d", i);
+        snprintf(vals[i], countof(vals[i]), "value-%d", i * i);
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        const struct map_allocator* a = pass == 0 ? null : &allocator;
+        uint64_t t = nanoseconds();
+        for (int r = 0; r < requests; r++) {
+            map(const char*, const char*, map_heap, map_strdup) m;
+            swear(map_alloc_with(&m, 16, a));
+            for (int i = 0; i < headers; i++) { map_put(&m, keys[i], vals[i]); }
+            for (int i = 0; i < headers; i++) {
+                swear(strcmp(*map_get(&m, keys[i]), vals[i]) == 0);
+            }
+            map_free(&m);
+            if (a) {
+                swear(arena.freed == arena.allocated); // sizes match
+                arena.used = 0; // end of request
+                arena.allocated = 0;
+                arena.freed = 0;
+            }
+        }
+        t = nanoseconds() - t;
+        printf("%s per request map create/put/get/destroy: %.3f" "\xCE\xBC" "s\n",
+               pass == 0 ? "malloc" : "arena ", (t * 1e-3) / (double)requests);
+    }
+    return 0;
+}
+
+static bool test15_odd(void* context, const void* key, void* val) {
+    (void)key;
+    (*(size_t*)context)++;
+    return *(uint64_t*)val % 2 == 1;
+}
+
+static int test15(void) {
+    // erase_if keeps insertion order and frees string copies
+    map(const char*, uint64_t, map_heap, map_keydup) m;
+    map_alloc(&m, 4);
+    char key[16];
+    for (uint64_t i = 0; i < 10 * 1000; i++) {
+        snprintf(key, countof(key), "%d", (int)i);
+        swear(map_put(&m, key, i));
+    }
+    size_t calls = 0;
+    swear(map_erase_if(&m, test15_odd, &calls) == 5000);
+    swear(calls == 10 * 1000 && m.n == 5000);
+    uint64_t last = 0;
+    struct map_iterator iterator = map_iterator(&m);
+    while (map_has_next(&iterator)) {
+        uint64_t val = 0;
+        const char* k = *map_next_entry(&m, &iterator, &val);
+        swear(val % 2 == 0 && (val == 0 || val > last) && atoi(k) == (int)val);
+        last = val;
+    }
+    map_free(&m);
+    map(uint64_t, uint64_t, 32) f; // full fixed map
+    map_alloc(&f);
+    const uint64_t c = map_capacity(&f);
+    for (uint64_t i = 0; i < c; i++) { swear(map_put(&f, i * 7, i)); }
+    swear(f.n == c && c % 2 == 0);
+    calls = 0;
+    swear(map_erase_if(&f, test15_odd, &calls) == c / 2 && f.n == c / 2);
+    swear(c <= calls && calls < c * 2); // prefix before first match twice
+    for (uint64_t i = 0; i < c; i++) {
+        uint64_t* r = map_get(&f, i * 7);
+        swear(i % 2 == 1 ? r == null : *r == i);
+    }
+    map_free(&f);
+    return 0;
+}
+
+static void test16_evict(void* context, const void* key, void* val) {
+    uint64_t* evicted = context; // [0] count [1] last evicted key
+    evicted[0]++;
+    evicted[1] = *(const uint64_t*)key;
+    swear(*(uint64_t*)val == evicted[1] * 3);
+}
+
+static void test16_evict_str(void* context, const void* key, void* val) {
+    (void)val;
+    swear(*(const char**)key != null);
+    (*(size_t*)context)++;
+}
+
+static void test16_bench(const uint32_t* trace, size_t requests,
+                         size_t keys, size_t entries) {
+    map(uint64_t, uint64_t) m;
+    map_alloc(&m, 4);
+    swear(map_lru(&m, entries, null, null));
+    size_t hits = 0;
+    uint64_t t = nanoseconds();
+    for (size_t i = 0; i < requests; i++) {
+        const uint64_t key = trace[i];
+        if (map_get(&m, key)) {
+            hits++;
+        } else {
+            map_put(&m, key, key);
+        }
+    }
+    t = nanoseconds() - t;
+    swear(m.n == entries);
+    printf("LRU %7zd of %zd keys hit rate: %5.1f%% %.3f" "\xCE\xBC"
+           "s per request\n", entries, keys, hits * 100.0 / requests,
+           (t * 1e-3) / (double)requests);
+    map_free(&m);
+}
+
+static int test16(void) {
+    // LRU order against a reference list of keys, least recent first
+    enum { n = 8, keys = 24 };
+    uint64_t ref[n + 1];
+    size_t count = 0;
+    uint64_t evicted[2] = {0};
+    map(uint64_t, uint64_t, 16) f;
+    map_alloc(&f);
+    swear(map_lru(&f, n, test16_evict, evicted));
+    for (int step = 0; step < 10 * 1000; step++) {
+        const uint64_t key = random64(&seed) % keys;
+        size_t j = 0;
+        while (j < count && ref[j] != key) { j++; }
+        const bool found = j < count;
+        if (found) { // move to the end
+            memmove(ref + j, ref + j + 1, (count - j - 1) * sizeof(ref[0]));
+            ref[count - 1] = key;
+        }
+        if (random64(&seed) % 2 == 0) {
+            uint64_t* r = map_get(&f, key);
+            swear(found ? *r == key * 3 : r == null);
+        } else {
+            const uint64_t before = evicted[0];
+            swear(map_put(&f, key, key * 3));
+            if (!found) {
+                ref[count++] = key;
+                if (count > n) {
+                    swear(evicted[0] == before + 1 && evicted[1] == ref[0]);
+                    memmove(ref, ref + 1, n * sizeof(ref[0]));
+                    count--;
+                }
+            }
+        }
+        swear(f.n == count);
+        size_t i = 0;
+        struct map_iterator iterator = map_iterator(&f);
+        while (map_has_next(&iterator)) {
+            swear(*map_next(&f, &iterator) == ref[i++]);
+        }
+    }
+    map_free(&f);
+    // heap LRU with string copies, must not grow
+    map(const char*, const char*, map_heap, map_strdup) m;
+    map_alloc(&m, 4);
+    size_t dropped = 0;
+    swear(map_lru(&m, 1000, test16_evict_str, &dropped));
+    const size_t a = m.a;
+    char key[16];
+    for (int i = 0; i < 10 * 1000; i++) {
+        snprintf(key, countof(key), "%d", i);
+        swear(map_put(&m, key, key));
+        if (i % 7 == 0) { swear(map_get(&m, "0") != null); } // keep "0"
+    }
+    swear(m.n == 1000 && m.a == a && dropped == 9000);
+    swear(map_get(&m, "0") != null && map_get(&m, "1") == null);
+    swear(map_lru(&m, 10, null, null) && m.n == 10);
+    map_free(&m);
+    // Zipf (s = 1) distributed trace of 1M requests over 256K keys,
+    // 4M requests over 1M keys with --large:
+    enum { largest = 4 * 1024 * 1024 };
+    const size_t requests = (tests_large ? 4 : 1) * 1024 * 1024;
+    const size_t universe = requests / 4;
+    static double cdf[largest / 4];
+    static uint32_t trace[largest];
+    double sum = 0;
+    for (size_t r = 0; r < universe; r++) { sum += 1.0 / (r + 1); cdf[r] = sum; }
+    for (size_t i = 0; i < requests; i++) {
+        const double u = (random64(&seed) >> 11) * 0x1.0p-53 * sum;
+        size_t lo = 0, hi = universe - 1;
+        while (lo < hi) {
+            const size_t mid = (lo + hi) / 2;
+            if (cdf[mid] < u) { lo = mid + 1; } else { hi = mid; }
+        }
+        trace[i] = (uint32_t)lo;
+    }
+    for (size_t entries = universe / 100; entries <= universe / 4; entries *= 5) {
+        test16_bench(trace, requests, universe, entries);
+    }
+    return 0;
+}
+
+static uint64_t test17_time; // simulated clock
+
+static uint64_t test17_clock(void) { return test17_time; }
+
+static int test17(void) {
+    // expiry of string keys against reference arrays, keeps order
+    enum { n = 1024 };
+    static uint64_t ref[n];   // 0 absent
+    static uint64_t due[n];   // deadline, 0 none
+    static uint64_t order[n]; // insertion stamp
+    uint64_t stamp = 0;
+    char key[16];
+    map(const char*, uint64_t, map_heap, map_keydup) m;
+    map_alloc(&m, 4);
+    test17_time = 1000 * 1000;
+    swear(map_expiry(&m, true, test17_clock));
+    for (int step = 0; step < 100 * 1000; step++) {
+        const int i = (int)(random64(&seed) % n);
+        snprintf(key, countof(key), "%d", i);
+        const bool live = ref[i] != 0 && (due[i] == 0 || due[i] > test17_time);
+        const uint64_t r = random64(&seed) % 100;
+        if (r < 40) {
+            const uint64_t val = random64(&seed) | 1;
+            swear(map_put(&m, key, val));
+            if (ref[i] == 0) { order[i] = ++stamp; }
+            if (!live) { due[i] = 0; }
+            ref[i] = val;
+        } else if (r < 70) {
+            const uint64_t deadline = test17_time - 50 +
+                                      random64(&seed) % (1uLL << (r % 32));
+            swear(map_expire_at(&m, key, deadline) == live);
+            if (live) { due[i] = deadline; }
+        } else if (r < 85) {
+            swear(map_delete(&m, key) == (ref[i] != 0));
+            ref[i] = 0;
+            due[i] = 0;
+        } else {
+            test17_time += random64(&seed) % 1000;
+            size_t expected = 0;
+            for (int j = 0; j < n; j++) {
+                if (ref[j] != 0 && due[j] != 0 && due[j] <= test17_time) {
+                    ref[j] = 0;
+                    due[j] = 0;
+                    expected++;
+                }
+            }
+            swear(map_expire(&m, test17_time) == expected);
+        }
+    }
+    size_t count = 0;
+    uint64_t last = 0;
+    struct map_iterator iterator = map_iterator(&m);
+    while (map_has_next(&iterator)) {
+        const int i = atoi(*map_next(&m, &iterator));
+        swear(ref[i] != 0 && order[i] > last);
+        last = order[i];
+        count++;
+    }
+    swear(count == m.n);
+    for (int i = 0; i < n; i++) {
+        snprintf(key, countof(key), "%d", i);
+        const uint64_t* r = map_get(&m, key);
+        const bool live = ref[i] != 0 && (due[i] == 0 || due[i] > test17_time);
+        swear(live ? r != null && *r == ref[i] : r == null);
+    }
+    map_free(&m);
+    // setting a deadline is not a use: LRU order and iterators are kept
+    map(uint64_t, uint64_t) l;
+    map_alloc(&l, 8);
+    swear(map_expiry(&l, true, null) && map_lru(&l, 3, null, null));
+    for (uint64_t k = 1; k <= 3; k++) { map_put(&l, k, k); }
+    iterator = map_iterator(&l);
+    while (map_has_next(&iterator)) {
+        swear(map_expire_at(&l, *map_next(&l, &iterator), 1000));
+    }
+    map_put(&l, 4, 4); // evicts least recently used 1
+    swear(map_get(&l, 1) == null && map_get(&l, 2) != null);
+    map_free(&l);
+    return 0;
+}
+
+static size_t test18_allocs;
+
+static void* test18_alloc(void* context, size_t bytes) {
+    (void)context;
+    test18_allocs++;
+    return malloc(bytes);
+}
+
+static void* test18_zalloc(void* context, size_t bytes) {
+    (void)context;
+    test18_allocs++;
+    return calloc(1, bytes);
+}
+
+static void test18_free(void* context, void* p, size_t bytes) {
+    (void)context; (void)bytes;
+    free(p);
+}
+
+static void test18_add(void* val, const void* with) {
+    *(uint64_t*)val += *(const uint64_t*)with;
+}
+
+static int test18(void) {
+    // single probe updates of duplicated string keys
+    enum { words = 1000 };
+    static uint64_t ref[words]; // 0 absent
+    struct map_allocator allocator = {
+        test18_alloc, test18_zalloc, test18_free, null
+    };
+    char key[16];
+    map(const char*, uint64_t, map_heap, map_keydup) m;
+    swear(map_alloc_with(&m, 4, &allocator));
+    swear(map_reserve(&m, words));
+    for (int step = 0; step < 100 * 1000; step++) {
+        const int i = (int)(random64(&seed) % words);
+        snprintf(key, countof(key), "w%d", i);
+        const uint64_t r = random64(&seed) % 3;
+        const size_t allocs = test18_allocs;
+        if (r == 0) {
+            swear(map_upsert(&m, key, 2, test18_add));
+            ref[i] += 2;
+        } else if (r == 1) {
+            bool inserted = false;
+            uint64_t* v = map_get_or_insert(&m, key, &inserted);
+            swear(v != null && inserted == (ref[i] == 0) && *v == ref[i]);
+            (*v)++;
+            ref[i]++;
+        } else {
+            const bool present = ref[i] != 0;
+            ref[i] = ref[i] * 2 + 1;
+            swear(map_put(&m, key, ref[i]));
+            swear(present == (test18_allocs == allocs)); // key not copied
+        }
+        swear(test18_allocs - allocs <= 1); // only new keys are copied
+    }
+    size_t count = 0;
+    for (int i = 0; i < words; i++) {
+        snprintf(key, countof(key), "w%d", i);
+        const uint64_t* v = map_get(&m, key);
+        swear(ref[i] != 0 ? *v == ref[i] : v == null);
+        count += ref[i] != 0;
+    }
+    swear(m.n == count);
+    map_free(&m);
+    // the slot returned after an LRU eviction is the inserted one
+    map(uint64_t, uint64_t, 16) f;
+    map_alloc(&f);
+    swear(map_lru(&f, 12, null, null));
+    for (uint64_t k = 0; k < 1000; k++) {
+        bool inserted = false;
+        uint64_t* v = map_get_or_insert(&f, k, &inserted);
+        swear(inserted && *v == 0);
+        *v = k * 3;
+        swear(*map_get(&f, k) == k * 3 && f.n == (k < 12 ? k + 1 : 12));
+    }
+    map_free(&f);
+    // word count benchmark: map_get + map_put against map_get_or_insert
+    enum { vocabulary = 64 * 1024 };
+    const size_t events = (tests_large ? 4 : 1) * 1000 * 1000;
+    static char text[vocabulary][8];
+    for (int i = 0; i < vocabulary; i++) {
+        snprintf(text[i], countof(text[i]), "w%d", i);
+    }
+    double us[2];
+    for (int mode = 0; mode < 2; mode++) {
+        map(const char*, uint64_t, map_heap, map_keydup) w;
+        map_alloc(&w, 4);
+        uint64_t s = 1; // same words for both modes
+        uint64_t t = nanoseconds();
+        for (size_t i = 0; i < events; i++) {
+            const char* word = text[random64(&s) % vocabulary];
+            if (mode == 0) {
+                const uint64_t* v = map_get(&w, word);
+                map_put(&w, word, v ? *v + 1 : 1);
+            } else {
+                (*map_get_or_insert(&w, word, null))++;
+            }
+        }
+        t = nanoseconds() - t;
+        us[mode] = (t * 1e-3) / (double)events;
+        map_free(&w);
+    }
+    printf("%d words get+put: %.3f get_or_insert: %.3f" "\xCE\xBC"
+           "s per word\n", vocabulary, us[0], us[1]);
+    return 0;
+}
+
+static void test19_concat(void* val, const void* with) {
+    // values are static strings: keep the longer one
+    const char** v = val;
+    const char* w = *(const char* const*)with;
+    if (strlen(w) > strlen(*v)) { *v = w; }
+}
+
+static int test19(void) {
+    // string keys: result follows insertion order of the iterated map
+    map(const char*, const char*) a, b, u, i, d;
+    map_alloc(&a, 4); map_alloc(&b, 4); map_alloc(&u, 4); map_alloc(&i, 4);
+    map_alloc(&d, 4);
+    map_put(&a, "alpha", "a"); map_put(&a, "beta", "b");
+    map_put(&a, "gamma", "g");
+    map_put(&b, "delta", "d"); map_put(&b, "gamma", "gamma");
+    map_put(&b, "beta", "B");
+    swear(map_union(&u, &a, &b, test19_concat) && u.n == 4);
+    swear(strcmp(*map_get(&u, "gamma"), "gamma") == 0);
+    swear(strcmp(*map_get(&u, "beta"), "b") == 0);
+    const char* order[] = { "alpha", "beta", "gamma", "delta" };
+    size_t j = 0;
+    struct map_iterator iterator = map_iterator(&u);
+    while (map_has_next(&iterator)) {
+        swear(strcmp(*map_next(&u, &iterator), order[j++]) == 0);
+    }
+    swear(map_intersect(&i, &a, &b, null) && i.n == 2);
+    swear(strcmp(*map_get(&i, "beta"), "b") == 0); // values of a
+    swear(map_difference(&d, &a, &b) && d.n == 1 && map_get(&d, "alpha"));
+    map_free(&a); map_free(&b); map_free(&u); map_free(&i); map_free(&d);
+    // LRU d evicts keys of a before their values are merged with b
+    map(uint64_t, uint64_t) x, y, z;
+    map_alloc(&x, 4); map_alloc(&y, 4); map_alloc(&z, 4);
+    swear(map_lru(&z, 2, null, null));
+    for (uint64_t k = 1; k <= 3; k++) { map_put(&x, k, k); map_put(&y, k, k); }
+    swear(map_union(&z, &x, &y, test18_add) && z.n == 2);
+    swear(*map_get(&z, 2) == 2 && *map_get(&z, 3) == 3); // 0 + b
+    map_free(&x); map_free(&y); map_free(&z);
+    // probing an LRU operand keeps its order and modification count
+    map(uint64_t, uint64_t) l, r;
+    map_alloc(&l, 8); map_alloc(&r, 4);
+    swear(map_lru(&l, 100, null, null));
+    for (uint64_t k = 1; k <= 5; k++) { map_put(&l, k, k); }
+    map_put(&r, 1, 1); map_put(&r, 2, 2);
+    const uint64_t mc = l.mc;
+    for (int op = 0; op < 3; op++) {
+        map(uint64_t, uint64_t) t;
+        map_alloc(&t, 4);
+        if (op == 0) { swear(map_union(&t, &l, &r, null) && t.n == 5); }
+        if (op == 1) { swear(map_intersect(&t, &l, &r, null) && t.n == 2); }
+        if (op == 2) { swear(map_difference(&t, &r, &l) && t.n == 0); }
+        map_free(&t);
+        swear(l.mc == mc);
+        uint64_t k = 1;
+        iterator = map_iterator(&l);
+        while (map_has_next(&iterator)) {
+            swear(*map_next(&l, &iterator) == k++);
+        }
+        swear(k == 6);
+    }
+    map_free(&l); map_free(&r);
+    return 0;
+}
+
+static int test20(void) {
+    // string keys colliding into one home slot form one cluster
+    static char keys[4][16];
+    map(const char*, int, 64) m;
+    map_alloc(&m);
+    for (int i = 0; m.n < 4; i++) {
+        char* key = keys[m.n];
+        snprintf(key, sizeof(keys[0]), "k%d", i);
+        if (map_hash_key(&m, key) % 64 == 63) { map_put(&m, key, i); }
+    }
+    struct map_stats s;
+    map_stats(&m, &s, 0);
+    swear(s.n == 4 && s.hit_mean == 2.5 && s.hit_max == 4);
+    swear(s.clusters == 1 && s.cluster_max == 4 && s.cluster[2] == 1);
+    swear(s.miss_max == 5 && s.miss_mean == (14.0 + 60.0) / 64);
+    map_delete(&m, keys[0]);
+    map_stats(&m, &s, 0);
+    swear(s.n == 3 && s.hit_mean == 2.0 && s.cluster_max == 3);
+    return 0;
+}
+
+// String corpora with controlled length distributions. Every key ends
+// with (or embeds) a fixed width base 36 id of its index, so keys are
+// distinct without deduplication.
+
+enum { test21_n = 128 * 1024, test21_id = 4 };
+
+typedef struct test21_corpus_s {
+    const char* name;
+    char*  text;   // all keys, zero terminated
+    char** keys;   // [test21_n]
+    size_t bytes;  // sum of key lengths
+} test21_corpus_t;
+
+static size_t test21_allocated;
+
+static void* test21_alloc(void* context, size_t bytes) {
+    (void)context;
+    test21_allocated += bytes;
+    return malloc(bytes);
+}
+
+static void* test21_zalloc(void* context, size_t bytes) {
+    (void)context;
+    test21_allocated += bytes;
+    return calloc(1, bytes);
+}
+
+static void test21_free(void* context, void* p, size_t bytes) {
+    (void)context;
+    test21_allocated -= bytes;
+    free(p);
+}
+
+static size_t test21_range(size_t from, size_t to) { // [from..to]
+    return from + (size_t)(random64(&seed) % (to - from + 1));
+}
+
+static char* test21_append(char* s, const char* end, const char* a) {
+    while (*a && s < end) { *s++ = *a++; }
+    return s;
+}
+
+static char* test21_random(char* s, const char* end, size_t n) {
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+    for (size_t i = 0; i < n && s < end; i++) {
+        *s++ = alphabet[random64(&seed) % (countof(alphabet) - 1)];
+    }
+    return s;
+}
+
+static char* test21_append_id(char* s, size_t i) {
+    static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    for (int d = test21_id - 1; d >= 0; d--) { s[d] = digits[i % 36]; i /= 36; }
+    return s + test21_id;
+}
+
+static const char* test21_words[] = {
+    "user", "orders", "items", "attributes", "shipping", "address",
+    "metadata", "tags", "price", "currency", "inventory", "warehouse",
+    "settings", "profile", "permissions", "events", "payload", "v2"
+};
+
+static char* test21_key(int corpus, size_t i, char* s, size_t capacity) {
+    // returns end of the key written to s
+    char* end = s + capacity - test21_id - 1;
+    if (corpus == 0) { // short tokens: 4..12 bytes
+        s = test21_random(s, end, test21_range(0, 8));
+    } else if (corpus == 1) { // URLs: 40..120 bytes
+        static const char* hosts[] = {
+            "https://example.com/", "https://api.example.org/v1/",
+            "http://cdn.static-assets.net/", "https://shop.example.co.uk/"
+        };
+        const size_t length = test21_range(40, 120) - test21_id;
+        const char* start = s;
+        s = test21_append(s, end, hosts[random64(&seed) % countof(hosts)]);
+        while ((size_t)(s - start) + 12 < length) {
+            s = test21_append(s, end,
+                test21_words[random64(&seed) % countof(test21_words)]);
+            s = test21_append(s, end, "/");
+        }
+        s = test21_append(s, end, "?id=");
+        const size_t pad = (size_t)(s - start) < length ?
+                           length - (size_t)(s - start) : 0;
+        s = test21_random(s, end, pad);
+    } else if (corpus == 2) { // JSON paths: 100..250 bytes
+        const size_t length = test21_range(100, 250) - test21_id;
+        const char* start = s;
+        s = test21_append(s, end, "$");
+        while ((size_t)(s - start) < length) {
+            s = test21_append(s, end, ".");
+            s = test21_append(s, end,
+                test21_words[random64(&seed) % countof(test21_words)]);
+            if (random64(&seed) % 3 == 0) {
+                char index[16];
+                snprintf(index, countof(index), "[%d]",
+                         (int)(random64(&seed) % 100));
+                s = test21_append(s, end, index);
+            }
+        }
+        s = test21_append(s, end, ".");
+    } else { // shared 56 byte prefix, ids differ only at the end
+        s = test21_append(s, end,
+            "tenant/0042/region/eu-west-1/bucket/archive/2024/object/");
+        s = test21_random(s, end, test21_range(0, 8));
+    }
+    s = test21_append_id(s, i);
+    *s = 0;
+    return s;
+}
+
+static void test21_generate(test21_corpus_t* c, int corpus) {
+    enum { longest = 300 };
+    static const char* names[] = { "tokens", "urls", "json", "prefixed" };
+    c->name = names[corpus];
+    c->text = malloc((size_t)test21_n * longest);
+    c->keys = malloc(test21_n * sizeof(c->keys[0]));
+    swear(c->text != null && c->keys != null);
+    c->bytes = 0;
+    char* s = c->text;
+    for (size_t i = 0; i < test21_n; i++) {
+        c->keys[i] = s;
+        char* e = test21_key(corpus, i, s, longest);
+        c->bytes += (size_t)(e - s);
+        s = e + 1;
+    }
+}
+
+#define test21_bench(c, tags, label) do {                                   \
+    static size_t index[test21_n];                                          \
+    for (size_t i = 0; i < test21_n; i++) { index[i] = i; }                 \
+    map(const char*, const char*, map_heap, tags) m;                        \
+    test21_allocated = 0;                                                   \
+    swear(map_alloc_with(&m, 16, &allocator));                              \
+    double us[4];                                                           \
+    shuffle(index, test21_n);                                               \
+    uint64_t t = nanoseconds();                                             \
+    for (size_t i = 0; i < test21_n; i++) {                                 \
+        map_put(&m, (c)->keys[index[i]], "1");                              \
+    }                                                                       \
+    us[0] = (nanoseconds() - t) * 1e-3 / test21_n;                          \
+    swear(m.n == test21_n);                                                 \
+    const double bytes = (double)test21_allocated / test21_n;               \
+    shuffle(index, test21_n);                                               \
+    t = nanoseconds();                                                      \
+    for (size_t i = 0; i < test21_n; i++) {                                 \
+        swear(map_get(&m, (c)->keys[index[i]]) != null);                    \
+    }                                                                       \
+    us[1] = (nanoseconds() - t) * 1e-3 / test21_n;                          \
+    size_t length = 0;                                                      \
+    t = nanoseconds();                                                      \
+    struct map_iterator iterator = map_iterator(&m);                        \
+    while (map_has_next(&iterator)) {                                       \
+        length += strlen(*map_next(&m, &iterator));                         \
+    }                                                                       \
+    us[2] = (nanoseconds() - t) * 1e-3 / test21_n;                          \
+    swear(length == (c)->bytes);                                            \
+    shuffle(index, test21_n);                                               \
+    t = nanoseconds();                                                      \
+    for (size_t i = 0; i < test21_n; i++) {                                 \
+        swear(map_delete(&m, (c)->keys[index[i]]));                         \
+    }                                                                       \
+    us[3] = (nanoseconds() - t) * 1e-3 / test21_n;                          \
+    map_free(&m);                                                           \
+    swear(test21_allocated == 0);                                           \
+    printf("%-8s %5.1fB %-10s put: %.3f get: %.3f iterate: %.3f "           \
+           "delete: %.3f" "\xCE\xBC" "s %.1f bytes/entry\n",                \
+           (c)->name, (double)(c)->bytes / test21_n, label,                 \
+           us[0], us[1], us[2], us[3], bytes);                              \
+} while (0)
+
+static int test21(void) {
+    // string keys as found in production instead of decimal numbers
+    struct map_allocator allocator = {
+        test21_alloc, test21_zalloc, test21_free, null
+    };
+    for (int corpus = 0; corpus < 4; corpus++) {
+        test21_corpus_t c;
+        test21_generate(&c, corpus);
+        test21_bench(&c, map_heap, "map_heap");
+        test21_bench(&c, map_strdup, "map_strdup");
+        free(c.text);
+        free(c.keys);
+    }
+    return 0;
+}
+
 int map_tests(void) {
     map_fatalist = true;
     return test0() || test1() || test2() || test3() || test4() ||
-           test5() || test6() || test7() || test8();
+           test5() || test6() || test7() || test8() || test9() || test10() ||
+           test11() || test12() || test13() ||
+           test14() || test15() || test16() || test17() || test18() ||
+           test19() || test20() || test21();
 }
 
 #define map_implementation
@@ -25,7 +25,70 @@
         const char* key = *map_next_entry(&m, &iterator, &val);
         printf("\"%s\": \"%s\"\n", key, val);
     }
+    uint64_t h = map_hash_key(&m, key); // hash once, reuse in many maps
+    map_get_hashed(&m, key, h);
+    map_put_hashed(&m, key, val, h);
+    map_delete_hashed(&m, key, h);
     map_free(&m);
+
+    Hash is independent of map capacity. Integer keys hash the same
+    as in kvm() (see kvm_hash_key()), const char* keys hash content.
+
+    map_get_or_insert(&m, key, &inserted); // see kvm_get_or_insert()
+    map_upsert(&m, key, init, merge);      // see kvm_upsert()
+
+    map_keydup keys are duplicated only when a new key is inserted.
+    Values of map_valdup maps cannot be updated in place.
+
+    map_erase_if(&m, pred, context); // see kvm_erase_if(), keeps order
+
+    As with kvm_erase_if() pred is called once per entry except on a full
+    fixed map where entries before the first match are passed twice.
+
+    map_union(&d, &a, &b, merge);     // see kvm_union()
+    map_intersect(&d, &a, &b, merge); // see kvm_intersect()
+    map_difference(&d, &a, &b);       // see kvm_difference()
+
+    Result entries are put into d in the insertion order of the iterated
+    map on one thread. Probing an LRU operand is not a use: its order and
+    iterators stay valid.
+
+    map_tombstones(&m, true); // O(1) map_delete(), see kvm_tombstones()
+    map_tombstones(&f, true, bitmap); // fixed: map_tombstones_words(capacity)
+    map_compact(&m);          // purge tombstones keeping insertion order
+
+    map_reserve(&m, n);             // see kvm_reserve()
+    map_shrink_to_fit(&m);          // see kvm_shrink_to_fit()
+    map_load_factors(&m, 75, 150, 18); // see kvm_load_factors()
+    map_huge_pages(&m, true, populate); // see kvm_huge_pages()
+
+    map_lru(&m, n, evict, context); // bounded LRU cache of n entries
+
+    In LRU mode map_get() and map_put() of an existing key move the entry
+    to the tail of the insertion order list. map_put() of a new key into
+    a map holding n entries evicts the least recently used entry at the
+    head after calling evict(context, key, val) if evict is not null.
+    Fixed maps need n < capacity, heap maps reserve room for n + 1 entries
+    and never grow. Because map_get() reorders entries it counts as a
+    modification for iterators. map_lru(&m, 0, null, null) turns LRU off.
+    Like kvm() the state of modes is allocated on first use and released
+    by map_free(), fixed maps included.
+
+    struct map_stats s;
+    map_stats(&m, &s, sample); // see kvm_stats(), 0 examines every slot
+
+    other_bytes of map_stats() are insertion order links and expiry wheel,
+    map_keydup/map_valdup string copies are not counted.
+
+    map_expiry(&m, true, clock);      // see kvm_expiry(), heap maps only
+    map_expire_at(&m, key, deadline); // absolute deadline, 0 none
+    map_expire(&m, now);              // removes entries due at now
+
+    struct map_allocator arena = { alloc, zalloc, free, context };
+    map_alloc_with(&m, 16, &arena); // see kvm_alloc_with()
+    map_global_allocator = &arena;  // used by subsequent map_alloc() calls
+
+    The allocator is also used for map_keydup/map_valdup string copies.
 */
 
 #include <stdint.h>
@@ -37,11 +100,23 @@
 
 bool map_fatalist; // any of map errors are fatal
 
+struct map_allocator {
+    void* (*alloc)(void* context, size_t bytes);
+    void* (*zalloc)(void* context, size_t bytes); // zero initialized
+    void  (*free)(void* context, void* p, size_t bytes);
+    void* context;
+};
+
+const struct map_allocator* map_global_allocator; // null: malloc()/free()
+
 struct _map_list {
     struct _map_list* prev;
     struct _map_list* next;
 };
 
+struct _map_wheel; // timing wheel of map_expiry()
+struct _map_ext;   // state of optional modes
+
 struct map_iterator {
     struct _map_list* next;
     void* m; /* map */
@@ -55,8 +130,9 @@ enum map_tag {
     map_strdup = 3  // strdup() for keys & values
 };
 
-#define map_struct(tk, tv, _n_, _tags_)                 \
-    struct {                                            \
+// fields shared by all map() structs:
+
+#define _map_fields                                     \
         uint64_t  tag;                                  \
         uint8_t*  pv;                                   \
         uint8_t*  pk;                                   \
@@ -65,9 +141,17 @@ enum map_tag {
         size_t n;  /* number of not empty entries */    \
         size_t a;  /* allocated capacity */             \
         int    (*cmp)(uint64_t, uint64_t);              \
-        size_t (*hash)(uint64_t, size_t n);             \
+        uint64_t (*hash)(uint64_t);                     \
         struct _map_list*  head;                        \
         uint64_t mc;  /* modification count */          \
+        size_t r;  /* reserved capacity */              \
+        size_t grows; /* times the map grew */          \
+        const struct map_allocator* allocator;          \
+        struct _map_ext* ext; /* optional modes or 0 */
+
+#define map_struct(tk, tv, _n_, _tags_)                 \
+    struct {                                            \
+        _map_fields                                     \
         union {                                         \
             uint64_t tags_aligned;                      \
             uint8_t  tags[(_tags_) + 1];                \
@@ -79,33 +163,136 @@ enum map_tag {
         struct _map_list list[(_n_ + (_n_ == 0))];      \
     }
 
+enum { map_stats_clusters = 24 };
+
+struct map_stats {
+    size_t capacity;     // slots
+    size_t n;            // live entries
+    size_t tombstones;
+    double load;         // n / capacity
+    size_t sampled;      // slots examined: capacity unless sampling
+    double hit_mean;     // slots probed by map_get() of present keys
+    size_t hit_max;
+    double miss_mean;    // slots probed by map_get() of absent keys
+    size_t miss_max;
+    size_t clusters;     // runs of not empty slots
+    size_t cluster_max;  // longest run
+    size_t cluster[map_stats_clusters]; // [i] runs of 2^i..2^(i+1)-1 slots
+    size_t key_bytes;
+    size_t val_bytes;
+    size_t bitmap_bytes; // occupancy and tombstones
+    size_t other_bytes;  // insertion order links and map_expiry() wheel
+    size_t grows;        // times the map grew
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 bool _map_init(void* mv, size_t tag, size_t kb, size_t vb, size_t n,
-               void* k, void* v, void* list, size_t c,
+               void* k, void* v, void* list, void* bitmap, size_t c,
                int (*cmp)(uint64_t, uint64_t),
-               size_t (*hash)(uint64_t, size_t));
+               uint64_t (*hash)(uint64_t),
+               const struct map_allocator* allocator);
 
-size_t _map_str_hash(uint64_t key, size_t c);
+uint64_t _map_str_hash(uint64_t key);
 
 int _map_str_cmp(uint64_t k0, uint64_t k1);
 
+uint64_t _map_hash_key(const void* mv, const size_t kb, const void* pkey);
+
 const void* _map_get(const void* mv, const size_t c,
                      const size_t kb, const size_t vb, const void* pkey);
 
+const void* _map_get_hashed(const void* mv, const size_t c,
+                            const size_t kb, const size_t vb,
+                            const void* pkey, uint64_t hash);
+
 bool _map_put(void* mv, const size_t capacity, const size_t kb, const size_t vb,
               const void* pkey, const void* pval);
 
+bool _map_put_hashed(void* mv, const size_t capacity,
+                     const size_t kb, const size_t vb,
+                     const void* pkey, const void* pval, uint64_t hash);
+
+void* _map_get_or_insert(void* mv, const size_t c,
+                         const size_t kb, const size_t vb,
+                         const void* pkey, bool* inserted);
+
+bool _map_upsert(void* mv, const size_t c,
+                 const size_t kb, const size_t vb,
+                 const void* pkey, const void* pval,
+                 void (*merge)(void* val, const void* with));
+
 bool _map_delete(void* mv, const size_t c, size_t kb, size_t vb, const void* pkey);
 
+bool _map_delete_hashed(void* mv, const size_t c, size_t kb, size_t vb,
+                        const void* pkey, uint64_t hash);
+
+// specialized at compile time by map_get(), map_put(), map_delete():
+
+const void* _map_get_int(const void* mv, const size_t c,
+                         const size_t kb, const size_t vb, const void* pkey);
+
+const void* _map_get_str(const void* mv, const size_t c,
+                         const size_t kb, const size_t vb, const void* pkey);
+
+bool _map_put_int(void* mv, const size_t capacity,
+                  const size_t kb, const size_t vb,
+                  const void* pkey, const void* pval);
+
+bool _map_put_str(void* mv, const size_t capacity,
+                  const size_t kb, const size_t vb,
+                  const void* pkey, const void* pval);
+
+bool _map_delete_int(void* mv, const size_t c, size_t kb, size_t vb,
+                     const void* pkey);
+
+bool _map_delete_str(void* mv, const size_t c, size_t kb, size_t vb,
+                     const void* pkey);
+
+size_t _map_erase_if(void* mv, size_t c, size_t kb, size_t vb,
+        bool (*pred)(void* context, const void* key, void* val),
+        void* context);
+
+bool _map_combine(void* dv, size_t cd, const void* av, size_t ca,
+                  const void* bv, size_t cb, size_t kb, size_t vb, int op,
+                  void (*merge)(void* val, const void* with),
+                  bool same_types);
+
+bool _map_tombstones(void* mv, size_t c, size_t kb, size_t vb,
+                     void* tombs, bool on);
+
+size_t _map_compact(void* mv, size_t c, size_t kb, size_t vb);
+
+bool _map_reserve(void* mv, size_t c, size_t kb, size_t vb, size_t n);
+
+bool _map_shrink_to_fit(void* mv, size_t kb, size_t vb);
+
+bool _map_load_factors(void* mv, size_t load, size_t growth, size_t low);
+
+bool _map_huge_pages(void* mv, size_t kb, size_t vb, bool on, bool populate);
+
+bool _map_lru(void* mv, size_t c, size_t kb, size_t vb, size_t n,
+        void (*evict)(void* context, const void* key, void* val),
+        void* context);
+
+bool _map_expiry(void* mv, bool on, uint64_t (*clock)(void));
+
+bool _map_expire_at(void* mv, const size_t c, size_t kb, size_t vb,
+                    const void* pkey, uint64_t deadline);
+
+size_t _map_expire(void* mv, size_t kb, size_t vb, uint64_t now);
+
 struct map_iterator map_iterator(void* mv);
 
 void* _map_next(struct map_iterator* iterator, size_t kb, size_t vb, void* pval);
 
 bool map_has_next(struct map_iterator* iterator);
 
+void _map_stats(const void* mv, size_t c, size_t kb, size_t vb,
+                struct map_stats* s, size_t sample);
+
 void _map_clear(void* mv, size_t c, size_t kb, size_t vb);
 
 void _map_free(void* mv, size_t c, size_t kb, size_t vb);
@@ -135,17 +322,22 @@ void _map_free(void* mv, size_t c, size_t kb, size_t vb);
 
 #define map_capacity(m) ((m)->a > 0 ? (m)->a : _map_fixed_c(m))
 
-#define map_init(m, n) _Generic(((m)->k[0]),                           \
+#define map_alloc_with(m, n, allocator) _Generic(((m)->k[0]),          \
      const char*:                                                      \
         _map_init(m, sizeof((m)->tags) - 1, _map_kb(m), _map_vb(m), n, \
-                  &(m)->k, &(m)->v, &(m)->list, _map_fixed_c(m),       \
-                  _map_str_cmp, _map_str_hash),                        \
+                  &(m)->k, &(m)->v, &(m)->list, (m)->bitmap,           \
+                  _map_fixed_c(m),                                     \
+                  _map_str_cmp, _map_str_hash, allocator),             \
      default:                                                          \
         _map_init(m, sizeof((m)->tags) - 1, _map_kb(m), _map_vb(m), n, \
-                  &(m)->k, &(m)->v, &(m)->list, _map_fixed_c(m),       \
-                  /*_map_str_cmp: */0, /*_map_str_hash: */ 0)          \
+                  &(m)->k, &(m)->v, &(m)->list, (m)->bitmap,           \
+                  _map_fixed_c(m),                                     \
+                  /*_map_str_cmp: */0, /*_map_str_hash: */ 0,          \
+                  allocator)                                           \
 )
 
+#define map_init(m, n) map_alloc_with(m, n, map_global_allocator)
+
 #define _map_init_1_arg(m)    map_init(m, 0)
 #define _map_init_2_arg(m, n) map_init(m, n)
 #define _map_get_3rd_arg(arg1, arg2, arg3, ...) arg3
@@ -156,17 +348,101 @@ void _map_free(void* mv, size_t c, size_t kb, size_t vb);
 #define map_clear(m) _map_clear(m, _map_fixed_c(m), _map_kb(m), _map_vb(m))
 #define map_free(m)  _map_free(m,  _map_fixed_c(m), _map_kb(m), _map_vb(m))
 
-#define map_put(m, key, val) _map_put(m, map_capacity(m), \
+// _map_dispatch(m, f) selects f_str() for const char* keys
+// and f_int() for all other key types at compile time:
+
+#define _map_dispatch(m, f) _Generic(((m)->k[0]), \
+    const char*: f ## _str,                       \
+    default:     f ## _int)
+
+#define map_put(m, key, val) _map_dispatch(m, _map_put)(m, map_capacity(m), \
     _map_kb(m), _map_vb(m), _map_ka(m, key), _map_va(m, val))
 
-#define map_get(m, key) (_map_tv(m)*)_map_get(m, map_capacity(m), \
-    _map_kb(m), _map_vb(m), _map_ka(m, key))
+#define map_get(m, key) (_map_tv(m)*)_map_dispatch(m, _map_get)(m,          \
+    map_capacity(m), _map_kb(m), _map_vb(m), _map_ka(m, key))
 
-#define map_delete(m, key) _map_delete(m, map_capacity(m), \
+#define map_delete(m, key) _map_dispatch(m, _map_delete)(m, map_capacity(m), \
     _map_kb(m), _map_vb(m), _map_ka(m, key))
 
+#define map_get_or_insert(m, key, inserted) (_map_tv(m)*)_map_get_or_insert(m, \
+    map_capacity(m), _map_kb(m), _map_vb(m), _map_ka(m, key), inserted)
+
+#define map_upsert(m, key, init, merge) _map_upsert(m, map_capacity(m), \
+    _map_kb(m), _map_vb(m), _map_ka(m, key), _map_va(m, init), merge)
+
+#define map_hash_key(m, key) _map_hash_key(m, _map_kb(m), _map_ka(m, key))
+
+#define map_put_hashed(m, key, val, hash) _map_put_hashed(m,          \
+    map_capacity(m), _map_kb(m), _map_vb(m), _map_ka(m, key),         \
+    _map_va(m, val), hash)
+
+#define map_get_hashed(m, key, hash) (_map_tv(m)*)_map_get_hashed(m,  \
+    map_capacity(m), _map_kb(m), _map_vb(m), _map_ka(m, key), hash)
+
+#define map_delete_hashed(m, key, hash) _map_delete_hashed(m,         \
+    map_capacity(m), _map_kb(m), _map_vb(m), _map_ka(m, key), hash)
+
+#define map_erase_if(m, pred, context) _map_erase_if(m, map_capacity(m), \
+    _map_kb(m), _map_vb(m), pred, context)
+
+enum { _map_union = 0, _map_intersect = 1, _map_difference = 2 };
+
+#define _map_combine_op(d, a, b, op, merge)                         \
+    _map_combine(d, map_capacity(d), a, map_capacity(a),            \
+                 b, map_capacity(b), _map_kb(d), _map_vb(d), op,    \
+                 merge, sizeof((a)->k[0]) == _map_kb(d) &&          \
+                 sizeof((b)->k[0]) == _map_kb(d) &&                 \
+                 sizeof((a)->v[0]) == _map_vb(d) &&                 \
+                 sizeof((b)->v[0]) == _map_vb(d))
+
+#define map_union(d, a, b, merge) \
+    _map_combine_op(d, a, b, _map_union, merge)
+
+#define map_intersect(d, a, b, merge) \
+    _map_combine_op(d, a, b, _map_intersect, merge)
+
+#define map_difference(d, a, b) \
+    _map_combine_op(d, a, b, _map_difference, 0)
+
+#define _map_tombstones_2_arg(m, on) _map_tombstones(m, map_capacity(m), \
+    _map_kb(m), _map_vb(m), 0, on)
+#define _map_tombstones_3_arg(m, on, bitmap) _map_tombstones(m, \
+    map_capacity(m), _map_kb(m), _map_vb(m), bitmap, on)
+#define _map_get_4th_arg(arg1, arg2, arg3, arg4, ...) arg4
+#define map_tombstones(...) _map_get_4th_arg(__VA_ARGS__, \
+    _map_tombstones_3_arg, _map_tombstones_2_arg, )(__VA_ARGS__)
+
+// uint64_t bitmap[map_tombstones_words(capacity)] of fixed maps
+#define map_tombstones_words(capacity) (((capacity) + 63) / 64)
+
+#define map_compact(m) _map_compact(m, map_capacity(m), _map_kb(m), _map_vb(m))
+
+#define map_reserve(m, n) _map_reserve(m, map_capacity(m), \
+    _map_kb(m), _map_vb(m), n)
+
+#define map_shrink_to_fit(m) _map_shrink_to_fit(m, _map_kb(m), _map_vb(m))
+
+#define map_load_factors(m, load, growth, low) \
+    _map_load_factors(m, load, growth, low)
+
+#define map_huge_pages(m, on, populate) \
+    _map_huge_pages(m, _map_kb(m), _map_vb(m), on, populate)
+
+#define map_lru(m, n, evict, context) _map_lru(m, map_capacity(m), \
+    _map_kb(m), _map_vb(m), n, evict, context)
+
+#define map_expiry(m, on, clock) _map_expiry(m, on, clock)
+
+#define map_expire_at(m, key, deadline) _map_expire_at(m, map_capacity(m), \
+    _map_kb(m), _map_vb(m), _map_ka(m, key), deadline)
+
+#define map_expire(m, now) _map_expire(m, _map_kb(m), _map_vb(m), now)
+
 #define map_print(m) _map_print(m, map_capacity(m), _map_kb(m), _map_vb(m))
 
+#define map_stats(m, s, sample) _map_stats(m, map_capacity(m), \
+    _map_kb(m), _map_vb(m), s, sample)
+
 #define map_next(m, iterator) \
         (_map_tk(m)*)_map_next(iterator, _map_kb(m), _map_vb(m), 0)
 
@@ -179,6 +455,15 @@ void _map_free(void* mv, size_t c, size_t kb, size_t vb);
 
 #define map_implemented
 
+#include <assert.h>
+#include <stdio.h> // fprintf() of fatal errors
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#elif defined(_WIN32)
+#include <Windows.h> // VirtualAlloc()
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -193,29 +478,142 @@ extern "C" {
 
 #define _map_oom "out of memory\n"
 
-typedef map(void*, void*) map_t;
+typedef struct { _map_fields } map_t; // no fixed map arrays
+
+// State of optional modes, allocated on first use like struct _kvm_ext.
+
+struct _map_ext {
+    uint64_t* tb;     // tombstones bitmap or null
+    size_t    t;      // number of tombstones
+    struct _map_wheel* wheel; // map_expiry()
+    size_t    lru;    // map_lru() entries limit or 0
+    void (*evict)(void* context, const void* key, void* val);
+    void*     context; // of evict()
+    uint16_t  load;   // max load percent
+    uint16_t  growth; // growth percent
+    uint16_t  low;    // shrink below percent
+    uint8_t   huge;   // map_huge_pages()
+};
+
+static const struct _map_ext _map_ext_none = {
+    .load = 75, .growth = 150, .low = 18
+};
+
+static inline const struct _map_ext* _map_x(const map_t* m) {
+    // read only view: defaults when no mode was ever enabled
+    return m->ext ? m->ext : &_map_ext_none;
+}
 
 // `kb` key bytes sizeof(tk) key type
 // `vb` val bytes sizeof(tv) val type
 
+enum { _map_huge = 1, _map_populate = 2 }; // _map_ext.huge bits
+
+#define _map_huge_page ((size_t)2 * 1024 * 1024)
+
+#define _map_bm_bytes(a) ((((a) + 63) / 64) * sizeof(uint64_t))
+
+#define _map_pn_bytes(a) ((a) * sizeof(struct _map_list))
+
+static inline bool _map_is_huge(const uint8_t huge, const size_t bytes) {
+    // the same decision is made on allocate and deallocate
+    return (huge & _map_huge) != 0 && bytes >= _map_huge_page;
+}
+
+static void* _map_allocate(const map_t* m, const uint8_t huge,
+                           const size_t bytes, const bool zero) {
+    // see _kvm_allocate()
+    const struct map_allocator* allocator = m->allocator;
+    if (allocator) {
+        return zero ? allocator->zalloc(allocator->context, bytes) :
+                      allocator->alloc(allocator->context, bytes);
+    } else if (!_map_is_huge(huge, bytes)) {
+        return zero ? calloc(1, bytes) : malloc(bytes);
+    }
+    const size_t size = (bytes + _map_huge_page - 1) & ~(_map_huge_page - 1);
+    uint8_t* p = 0;
+#if defined(__linux__)
+    uint8_t* r = mmap(0, size + _map_huge_page, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (r == MAP_FAILED) { return 0; }
+    p = (uint8_t*)(((uintptr_t)r + _map_huge_page - 1) &
+                   ~(uintptr_t)(_map_huge_page - 1));
+    if (p > r) { munmap(r, (size_t)(p - r)); }
+    const size_t tail = (size_t)(r + size + _map_huge_page - (p + size));
+    if (tail > 0) { munmap(p + size, tail); }
+    #if defined(MADV_HUGEPAGE)
+    (void)madvise(p, size, MADV_HUGEPAGE);
+    #endif
+#elif defined(_WIN32)
+    p = VirtualAlloc(0, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                     PAGE_READWRITE);
+    if (!p) {
+        p = VirtualAlloc(0, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    }
+    if (!p) { return 0; }
+#else
+    p = zero ? calloc(1, bytes) : malloc(bytes);
+    if (!p) { return 0; }
+#endif
+    if (huge & _map_populate) {
+        for (size_t i = 0; i < bytes; i += 4096) { ((volatile uint8_t*)p)[i] = 0; }
+    }
+    return p;
+}
+
+static void _map_deallocate(const map_t* m, const uint8_t huge,
+                            void* p, const size_t bytes) {
+    if (!p) {
+        // nothing to free
+    } else if (m->allocator) {
+        m->allocator->free(m->allocator->context, p, bytes);
+    } else if (!_map_is_huge(huge, bytes)) {
+        free(p);
+    } else {
+#if defined(__linux__)
+        munmap(p, (bytes + _map_huge_page - 1) & ~(_map_huge_page - 1));
+#elif defined(_WIN32)
+        VirtualFree(p, 0, MEM_RELEASE);
+#else
+        free(p);
+#endif
+    }
+}
+
+static struct _map_ext* _map_ext_of(map_t* m) {
+    // state of optional modes for writing, null when out of memory
+    if (!m->ext) {
+        m->ext = _map_allocate(m, 0, sizeof(struct _map_ext), false);
+        if (m->ext) { *m->ext = _map_ext_none; }
+    }
+    return m->ext;
+}
+
 static bool _map_alloc(map_t* m, size_t kb, size_t vb, size_t n, size_t c,
                        int (*cmp)(uint64_t, uint64_t),
-                       size_t (*hash)(uint64_t, size_t),
-                       size_t tag) {
+                       uint64_t (*hash)(uint64_t),
+                       size_t tag, const struct map_allocator* allocator) {
     if (c == 1 && n >= 4) {
-        m->pk  = malloc(n * kb);
-        m->pv  = malloc(n * vb);
-        m->bm  = calloc((n + 63) / 64, sizeof(uint64_t)); // zero init
-        m->pn  = malloc(n * sizeof(m->pn[0]));
+        m->allocator = allocator;
+        m->pk  = _map_allocate(m, 0, n * kb, false);
+        m->pv  = _map_allocate(m, 0, n * vb, false);
+        m->bm  = _map_allocate(m, 0, _map_bm_bytes(n), true);
+        m->pn  = _map_allocate(m, 0, _map_pn_bytes(n), false);
         if (!m->pk || !m->pv || !m->bm || !m->pn) {
-            free(m->pk); free(m->pv); free(m->bm); free(m->pn);
+            _map_deallocate(m, 0, m->pk, n * kb);
+            _map_deallocate(m, 0, m->pv, n * vb);
+            _map_deallocate(m, 0, m->bm, _map_bm_bytes(n));
+            _map_deallocate(m, 0, m->pn, _map_pn_bytes(n));
             _map_fatal_return_zero(_map_oom);
         }
         m->tag  = tag;
         m->a    = n;
+        m->r    = n;
         m->n    = 0;
         m->head = 0;
         m->mc   = 0;
+        m->ext  = 0;
+        m->grows = 0;
         m->cmp  = cmp;
         m->hash = hash;
         return true;
@@ -225,25 +623,30 @@ static bool _map_alloc(map_t* m, size_t kb, size_t vb, size_t n, size_t c,
 }
 
 bool _map_init(void* mv, size_t tag, size_t kb, size_t vb, size_t n,
-               void* k, void* v, void* list, size_t c,
+               void* k, void* v, void* list, void* bitmap, size_t c,
                int (*cmp)(uint64_t, uint64_t),
-               size_t (*hash)(uint64_t, size_t)) {
+               uint64_t (*hash)(uint64_t),
+               const struct map_allocator* allocator) {
     map_t* m = mv;
     if (c == 1) {
-        return _map_alloc(m, kb, vb, n, c, cmp, hash, tag);
+        return _map_alloc(m, kb, vb, n, c, cmp, hash, tag, allocator);
     } else if (n != 0) {
         _map_fatal_return_zero("invalid argument n: %zd\n", n);
     } else {
-        memset(m->bitmap, 0, sizeof(m->bitmap));
+        memset(bitmap, 0, _map_bm_bytes(c));
         m->tag  = tag;
         m->a    = 0;
+        m->r    = 0;
         m->n    = 0;
         m->pk   = k;
         m->pv   = v;
         m->pn   = list;
-        m->bm   = m->bitmap;
+        m->bm   = bitmap;
+        m->allocator = allocator; // for map_keydup/map_valdup copies
         m->head = 0;
         m->mc   = 0;
+        m->ext  = 0;
+        m->grows = 0;
         m->cmp  = cmp;
         m->hash = hash;
         return true;
@@ -281,18 +684,29 @@ bool map_has_next(struct map_iterator* iterator) {
     return m->mc == iterator->mc && iterator->next != 0;
 }
 
-#define _map_undup_key(m, i, kb) do {           \
-    if (m->tag & map_keydup) {                  \
-        void** pki = (void**)(m->pk + i * kb);  \
-        if (pki) { free(*pki); *pki = 0; }      \
-    }                                           \
+static char* _map_strdup(const map_t* m, const char* s) {
+    const size_t bytes = strlen(s) + 1;
+    char* d = _map_allocate(m, 0, bytes, false);
+    if (d) { memcpy(d, s, bytes); }
+    return d;
+}
+
+static void _map_strfree(const map_t* m, void* s) {
+    if (s) { _map_deallocate(m, 0, s, strlen((const char*)s) + 1); }
+}
+
+#define _map_undup_key(m, i, kb) do {                     \
+    if (m->tag & map_keydup) {                            \
+        void** pki = (void**)(m->pk + i * kb);            \
+        if (pki) { _map_strfree(m, *pki); *pki = 0; }     \
+    }                                                     \
 } while (0)
 
-#define _map_undup_val(m, i, vb) do {           \
-    if (m->tag & map_valdup) {                  \
-        void** pvi = (void**)(m->pv + i * vb);  \
-        if (pvi) { free(*pvi); *pvi = 0; }      \
-    }                                           \
+#define _map_undup_val(m, i, vb) do {                     \
+    if (m->tag & map_valdup) {                            \
+        void** pvi = (void**)(m->pv + i * vb);            \
+        if (pvi) { _map_strfree(m, *pvi); *pvi = 0; }     \
+    }                                                     \
 } while (0)
 
 #define _map_undup(m, i, kb, vb) do {           \
@@ -300,11 +714,110 @@ bool map_has_next(struct map_iterator* iterator) {
     _map_undup_val(m, i, vb);                   \
 } while (0)
 
-static void _map_set_pointers(map_t* m, void* pk, void* pv, void* bm, void* pn) {
-    free(m->pk); m->pk = pk;
-    free(m->pv); m->pv = pv;
-    free(m->bm); m->bm = bm;
-    free(m->pn); m->pn = pn;
+// Timing wheel of expiry deadlines, see kvm.h for the description.
+
+enum { _map_wheel_levels = 11, // 11 * 6 bits cover 64-bit deadlines
+       _map_wheel_overdue = _map_wheel_levels * 64, // after the buckets
+       _map_wheel_sentinels = _map_wheel_overdue + 1 };
+
+struct _map_timer {
+    uint64_t deadline; // 0 not linked
+    uint32_t prev;
+    uint32_t next;
+};
+
+struct _map_wheel {
+    uint64_t now; // deadlines before now have expired
+    uint64_t (*clock)(void); // null: map_get() does not check deadlines
+    uint64_t bits[_map_wheel_levels]; // not empty buckets, may be stale
+    struct _map_timer t[]; // [a] slots followed by bucket sentinels
+};
+
+static inline size_t _map_wheel_bytes(const size_t a) {
+    return sizeof(struct _map_wheel) +
+           (a + _map_wheel_sentinels) * sizeof(struct _map_timer);
+}
+
+static inline size_t _map_ctz64(uint64_t w) {
+    #if defined(_MSC_VER)
+        unsigned long i; _BitScanForward64(&i, w); return i;
+    #else
+        return (size_t)__builtin_ctzll(w);
+    #endif
+}
+
+static inline size_t _map_clz64(uint64_t w) {
+    #if defined(_MSC_VER)
+        unsigned long i; _BitScanReverse64(&i, w); return 63 - i;
+    #else
+        return (size_t)__builtin_clzll(w);
+    #endif
+}
+
+static void _map_wheel_reset(struct _map_wheel* w, const size_t a) {
+    for (size_t i = 0; i < a; i++) { w->t[i].deadline = 0; }
+    for (size_t b = 0; b < _map_wheel_sentinels; b++) {
+        const uint32_t s = (uint32_t)(a + b);
+        w->t[s].deadline = 0;
+        w->t[s].prev = w->t[s].next = s;
+    }
+    memset(w->bits, 0, sizeof(w->bits));
+}
+
+static void _map_timer_link(struct _map_wheel* w, const size_t a,
+                            const size_t i, const uint64_t deadline) {
+    uint32_t s = (uint32_t)(a + _map_wheel_overdue);
+    if (deadline >= w->now) {
+        const uint64_t x = deadline ^ w->now;
+        const size_t level = x == 0 ? 0 : (63 - _map_clz64(x)) / 6;
+        const size_t slot = (size_t)(deadline >> (level * 6)) & 63;
+        s = (uint32_t)(a + level * 64 + slot);
+        w->bits[level] |= 1uLL << slot;
+    }
+    struct _map_timer* t = w->t;
+    t[i].deadline = deadline;
+    t[i].next = s;
+    t[i].prev = t[s].prev;
+    t[t[s].prev].next = (uint32_t)i;
+    t[s].prev = (uint32_t)i;
+}
+
+static inline void _map_timer_unlink(map_t* m, const size_t i) {
+    struct _map_wheel* w = _map_x(m)->wheel;
+    if (w && w->t[i].deadline != 0) {
+        struct _map_timer* t = w->t;
+        t[t[i].prev].next = t[i].next;
+        t[t[i].next].prev = t[i].prev;
+        t[i].deadline = 0;
+    }
+}
+
+static inline void _map_timer_move(map_t* m, const size_t i, const size_t x) {
+    // entry moved from slot x to slot i, its timer keeps the bucket
+    struct _map_wheel* w = _map_x(m)->wheel;
+    if (w && w->t[x].deadline != 0) {
+        struct _map_timer* t = w->t;
+        t[i] = t[x];
+        t[t[i].prev].next = (uint32_t)i;
+        t[t[i].next].prev = (uint32_t)i;
+        t[x].deadline = 0;
+    }
+}
+
+static inline bool _map_expired(const map_t* m, const size_t i) {
+    const struct _map_wheel* w = _map_x(m)->wheel;
+    return w && w->clock && w->t[i].deadline != 0 &&
+           w->t[i].deadline <= w->clock();
+}
+
+static void _map_set_pointers(map_t* m, size_t kb, size_t vb,
+                              void* pk, void* pv, void* bm, void* pn) {
+    // frees arrays of current capacity m->a
+    const uint8_t huge = _map_x(m)->huge;
+    _map_deallocate(m, huge, m->pk, m->a * kb); m->pk = pk;
+    _map_deallocate(m, huge, m->pv, m->a * vb); m->pv = pv;
+    _map_deallocate(m, huge, m->bm, _map_bm_bytes(m->a)); m->bm = bm;
+    _map_deallocate(m, huge, m->pn, _map_pn_bytes(m->a)); m->pn = pn;
 }
 
 void _map_clear(void* mv, size_t c, size_t kb, size_t vb) {
@@ -318,28 +831,50 @@ void _map_clear(void* mv, size_t c, size_t kb, size_t vb) {
         }
     }
     m->n = 0;
+    m->head = 0;
+    m->mc++;
     const size_t capacity = m->a > 0 ? m->a : c;
     memset(m->bm, 0, ((capacity + 63) / 64) * sizeof(m->bm[0]));
+    struct _map_ext* x = m->ext;
+    if (!x) { return; }
+    if (x->tb) {
+        memset(x->tb, 0, ((capacity + 63) / 64) * sizeof(x->tb[0]));
+        x->t = 0;
+    }
+    if (x->wheel) { _map_wheel_reset(x->wheel, capacity); }
 }
 
 void _map_free(void* mv, size_t c, size_t kb, size_t vb) {
     _map_clear(mv, c, kb, vb);
     map_t* m = mv;
-    if (c == 1 && m->a != 0) { _map_set_pointers(m, 0, 0, 0, 0); m->a = 0; }
+    struct _map_ext* x = m->ext;
+    if (c == 1 && m->a != 0) {
+        if (x) {
+            _map_deallocate(m, x->huge, x->tb, _map_bm_bytes(m->a));
+            _map_deallocate(m, x->huge, x->wheel, _map_wheel_bytes(m->a));
+        }
+        _map_set_pointers(m, kb, vb, 0, 0, 0, 0);
+        m->a = 0;
+    }
+    // fixed maps: the tombstones bitmap is caller storage
+    _map_deallocate(m, 0, x, sizeof(*x));
+    m->ext = 0;
 }
 
-static inline size_t _map_hash(uint64_t key, size_t c) {
+static inline uint64_t _map_hash(uint64_t key) {
     key ^= key >> 33;
     key *= 0XFF51AFD7ED558CCDuLL;
     key ^= key >> 33;
     key *= 0XC4CEB9FE1A85EC53uLL;
     key ^= key >> 33;
-    return (size_t)(key % c);
+    return key;
 }
 
-#define map_hash(m, k, c) ((m)->hash ? (m)->hash(k, c) : _map_hash(k, c))
+#define map_hash64(m, k) ((m)->hash ? (m)->hash(k) : _map_hash(k))
+
+#define map_hash(m, k, c) ((size_t)(map_hash64(m, k) % (c)))
 
-size_t _map_str_hash(uint64_t key, size_t c) {
+uint64_t _map_str_hash(uint64_t key) {
     const char* s =(const char*)(uintptr_t)key;
     uint64_t h = 0xcbf29ce484222325uLL; // FNV-1a 64-bit offset basis
     if (s) { // map_str(const char*, const char*) allow null keys and values
@@ -348,7 +883,7 @@ size_t _map_str_hash(uint64_t key, size_t c) {
             h *= 0x100000001b3uLL; // FNV-1a 64-bit prime
         }
     }
-    return (size_t)(h % c);
+    return h;
 }
 
 int _map_str_cmp(uint64_t k0, uint64_t k1) {
@@ -394,27 +929,92 @@ static inline void _map_move(uint8_t* d, const size_t i,
     _map_set_at(d, i, s + j * b, b);
 }
 
-#define _map_set_entry(k, v, i, pkey, pval, kb, vb) do { \
-    _map_set_at(k, i, pkey, kb);                         \
-    _map_set_at(v, i, pval, vb);                         \
-} while (0)
-
 #define _map_move_entry(dk, dv, i, sk, sv, j, kb, vb) do { \
     _map_move(dk, i, sk, j, kb);                           \
     _map_move(dv, i, sv, j, vb);                           \
 } while (0)
 
-const void* _map_get(const void* mv, const size_t c,
-                     const size_t kb, const size_t vb, const void* pkey) {
+uint64_t _map_hash_key(const void* mv, const size_t kb, const void* pkey) {
     const map_t* m = mv;
+    return map_hash64(m, _map_key(pkey, kb));
+}
+
+// Key kinds are compile time constants passed to always inlined
+// _map_find(), _map_insert(), _map_remove() so the compiler emits
+// specialized probing loops without indirect calls per probe.
+// m->cmp and m->hash function pointers are only called for
+// _map_kind_any (custom comparators).
+
+enum { _map_kind_int = 0, _map_kind_str = 1, _map_kind_any = 2 };
+
+#if defined(_MSC_VER)
+#define _map_inline __forceinline
+#else
+#define _map_inline inline __attribute__((always_inline))
+#endif
+
+static inline int _map_kind(const map_t* m) {
+    if (!m->cmp && !m->hash) {
+        return _map_kind_int;
+    } else if (m->cmp == _map_str_cmp && m->hash == _map_str_hash) {
+        return _map_kind_str;
+    } else {
+        return _map_kind_any;
+    }
+}
+
+static _map_inline uint64_t _map_hash_of(const map_t* m, const int kind,
+                                         const uint64_t key) {
+    switch (kind) {
+        case _map_kind_int: return _map_hash(key);
+        case _map_kind_str: return _map_str_hash(key);
+        default:            return map_hash64(m, key);
+    }
+}
+
+static _map_inline bool _map_equal(const map_t* m, const int kind,
+                                   const uint64_t k0, const uint64_t k1) {
+    switch (kind) {
+        case _map_kind_int: return k0 == k1;
+        case _map_kind_str: return k0 == k1 || (k0 != 0 && k1 != 0 &&
+                                   strcmp((const char*)(uintptr_t)k0,
+                                          (const char*)(uintptr_t)k1) == 0);
+        default:            return m->cmp ? m->cmp(k0, k1) == 0 : k0 == k1;
+    }
+}
+
+static _map_inline size_t _map_find_past_tombs(const map_t* m,
+        const size_t c, const size_t kb, const uint64_t key,
+        const size_t h, const int kind) {
+    // tombstones do not terminate probing, returns c if key is not found
+    size_t i = h;
+    for (;;) {
+        if (!_map_is_empty(m, i)) {
+            const uint64_t ki = _map_key_at(m->pk, kb, i);
+            if (_map_equal(m, kind, ki, key)) { return i; }
+        } else if (_map_bm_is_empty(m->ext->tb, i)) {
+            return c;
+        }
+        i = (i + 1) % c;
+        if (i == h) { return c; }
+    }
+}
+
+static _map_inline const void* _map_find(const map_t* m, const size_t c,
+        const size_t kb, const size_t vb, const uint64_t key,
+        const uint64_t hash, const int kind) {
     const uint8_t* k = (const uint8_t*)m->pk;
     const uint8_t* v = (const uint8_t*)m->pv;
-    const uint64_t key = _map_key(pkey, kb);
-    const size_t h = map_hash(m, key, c);
+    assert(hash == map_hash64(m, key));
+    const size_t h = (size_t)(hash % c);
     size_t i = h; // start
+    if (_map_x(m)->tb) {
+        i = _map_find_past_tombs(m, c, kb, key, h, kind);
+        return i < c ? v + i * vb : 0;
+    }
     while (!_map_is_empty(m, i)) {
         const uint64_t ki = _map_key_at(k, kb, i);
-        if (m->cmp ? m->cmp(ki, key) == 0 : ki == key) {
+        if (_map_equal(m, kind, ki, key)) {
             return v + i * vb;
         } else {
             i = (i + 1) % c;
@@ -424,6 +1024,91 @@ const void* _map_get(const void* mv, const size_t c,
     return 0;
 }
 
+static void _map_link(struct _map_list** head,
+                      struct _map_list pn[], size_t i);
+
+static void _map_unlink(struct _map_list** head,
+                        struct _map_list pn[], size_t i);
+
+static void _map_touch(map_t* m, const size_t i) {
+    // moves list node of slot i to the tail (most recently used)
+    struct _map_list* node = m->pn + i;
+    if (node == m->head) {
+        m->head = node->next; // circular list: old head becomes the tail
+    } else if (node != m->head->prev) {
+        _map_unlink(&m->head, m->pn, i);
+        _map_link(&m->head, m->pn, i);
+    }
+    m->mc++; // order of iteration has changed
+}
+
+static inline const void* _map_used(const map_t* m, const size_t vb,
+                                    const void* r) {
+    const struct _map_ext* x = m->ext;
+    if (r && x && (x->lru != 0 || x->wheel)) {
+        const size_t i = (size_t)((const uint8_t*)r - m->pv) / vb;
+        if (_map_expired(m, i)) { return 0; }
+        if (x->lru != 0) { _map_touch((map_t*)m, i); }
+    }
+    return r;
+}
+
+const void* _map_get_hashed(const void* mv, const size_t c,
+                            const size_t kb, const size_t vb,
+                            const void* pkey, uint64_t hash) {
+    const map_t* m = mv;
+    const uint64_t key = _map_key(pkey, kb);
+    const void* r;
+    switch (_map_kind(m)) {
+        case _map_kind_int:
+            r = _map_find(m, c, kb, vb, key, hash, _map_kind_int); break;
+        case _map_kind_str:
+            r = _map_find(m, c, kb, vb, key, hash, _map_kind_str); break;
+        default:
+            r = _map_find(m, c, kb, vb, key, hash, _map_kind_any); break;
+    }
+    return _map_used(m, vb, r);
+}
+
+const void* _map_get(const void* mv, const size_t c,
+                     const size_t kb, const size_t vb, const void* pkey) {
+    return _map_get_hashed(mv, c, kb, vb, pkey, _map_hash_key(mv, kb, pkey));
+}
+
+const void* _map_get_int(const void* mv, const size_t c,
+                         const size_t kb, const size_t vb, const void* pkey) {
+    const map_t* m = mv;
+    if (m->cmp || m->hash) { return _map_get(mv, c, kb, vb, pkey); }
+    const uint64_t key = _map_key(pkey, kb);
+    return _map_used(m, vb,
+        _map_find(m, c, kb, vb, key, _map_hash(key), _map_kind_int));
+}
+
+const void* _map_get_str(const void* mv, const size_t c,
+                         const size_t kb, const size_t vb, const void* pkey) {
+    const map_t* m = mv;
+    if (_map_kind(m) != _map_kind_str) { return _map_get(mv, c, kb, vb, pkey); }
+    const uint64_t key = _map_key(pkey, kb);
+    return _map_used(m, vb,
+        _map_find(m, c, kb, vb, key, _map_str_hash(key), _map_kind_str));
+}
+
+static const void* _map_peek(const map_t* m, const size_t c,
+        const size_t kb, const size_t vb, const void* pkey, uint64_t hash) {
+    // not a use of the entry: LRU order and m->mc are not touched
+    const uint64_t key = _map_key(pkey, kb);
+    const uint8_t* r;
+    switch (_map_kind(m)) {
+        case _map_kind_int:
+            r = _map_find(m, c, kb, vb, key, hash, _map_kind_int); break;
+        case _map_kind_str:
+            r = _map_find(m, c, kb, vb, key, hash, _map_kind_str); break;
+        default:
+            r = _map_find(m, c, kb, vb, key, hash, _map_kind_any); break;
+    }
+    return r && !_map_expired(m, (size_t)(r - m->pv) / vb) ? r : 0;
+}
+
 static void _map_link(struct _map_list** head,
                       struct _map_list pn[], size_t i) {
     if (!(*head)) {
@@ -449,110 +1134,567 @@ static void _map_unlink(struct _map_list** head,
     pn[i].prev->next = pn[i].next;
 }
 
-static bool _map_grow(map_t* m, const size_t kb, const size_t vb) {
-    if (m->a >= (size_t)(UINTPTR_MAX / 2)) {
-        _map_fatal_return_zero("overflow: %zd\n", m->a);
+static void _map_relocate(struct _map_list** head,
+                          struct _map_list pn[], size_t i, size_t x) {
+    // moves list node of slot x to slot i keeping its position in the list
+    if (pn[x].next == pn + x) {
+        pn[i].next = pn[i].prev = pn + i;
+    } else {
+        pn[i] = pn[x];
+        pn[i].prev->next = pn + i;
+        pn[i].next->prev = pn + i;
     }
-    uint8_t*  k = (uint8_t*)m->pk;
-    uint8_t*  v = (uint8_t*)m->pv;
-    size_t    a  = m->a * 3 / 2;
-    uint8_t*  pk = malloc(a * kb);
-    uint8_t*  pv = malloc(a * vb);
-    uint64_t* bm = calloc((a + 63) / 64, sizeof(uint64_t)); // zero init
-    struct _map_list* pn = malloc(a * sizeof(m->pn[0]));
-    if (!pk || !pv || !bm || !pn) {
-        free(pk); free(pv); free(bm); free(pn);
+    if (*head == pn + x) { *head = pn + i; }
+}
+
+static _map_inline size_t _map_sweep(map_t* m, const size_t c,
+        const size_t kb, const size_t vb, const int kind,
+        bool (*pred)(void* context, const void* key, void* val),
+        void* context) {
+    // Removes all tombstones and entries matching pred (if not null)
+    // in place in a single sweep (see _kvm_sweep()).
+    // Moved entries keep their position in the insertion order list.
+    uint64_t* tb = _map_x(m)->tb;
+    size_t s = 0;
+    while (s < c && !(_map_is_empty(m, s) && (!tb || _map_bm_is_empty(tb, s)))) {
+        s++;
+    }
+    assert(s < c); // at least one vacant slot always exists
+    uint8_t* k = (uint8_t*)m->pk;
+    uint8_t* v = (uint8_t*)m->pv;
+    size_t erased = 0;
+    bool dirty = false; // current cluster has vacated slots
+    for (size_t j = 1; j < c; j++) {
+        const size_t x = (s + j) % c;
+        if (tb && !_map_bm_is_empty(tb, x)) {
+            _map_bm_excl(tb, x);
+            dirty = true;
+        } else if (_map_is_empty(m, x)) {
+            dirty = false; // end of cluster
+        } else if (pred && pred(context, k + x * kb, v + x * vb)) {
+            _map_bm_excl(m->bm, x);
+            _map_timer_unlink(m, x);
+            _map_undup(m, x, kb, vb);
+            _map_unlink(&m->head, m->pn, x);
+            erased++;
+            dirty = true;
+        } else if (dirty) {
+            const uint64_t kx = _map_key_at(k, kb, x);
+            size_t y = (size_t)(_map_hash_of(m, kind, kx) % c);
+            while (y != x && !_map_is_empty(m, y)) { y = (y + 1) % c; }
+            if (y != x) {
+                _map_move_entry(k, v, y, k, v, x, kb, vb);
+                _map_relocate(&m->head, m->pn, y, x);
+                _map_timer_move(m, y, x);
+                _map_bm_incl(m->bm, y);
+                _map_bm_excl(m->bm, x);
+            }
+        }
+    }
+    if (tb) { m->ext->t = 0; }
+    m->n -= erased;
+    m->mc++; // entries may have moved
+    return erased;
+}
+
+static size_t _map_sweep_kind(map_t* m, const size_t c,
+        const size_t kb, const size_t vb,
+        bool (*pred)(void* context, const void* key, void* val),
+        void* context) {
+    switch (_map_kind(m)) {
+        case _map_kind_int:
+            return _map_sweep(m, c, kb, vb, _map_kind_int, pred, context);
+        case _map_kind_str:
+            return _map_sweep(m, c, kb, vb, _map_kind_str, pred, context);
+        default:
+            return _map_sweep(m, c, kb, vb, _map_kind_any, pred, context);
+    }
+}
+
+static void _map_purge(map_t* m, const size_t c,
+                       const size_t kb, const size_t vb) {
+    _map_sweep_kind(m, c, kb, vb, 0, 0);
+}
+
+static _map_inline void _map_rehash(map_t* m, const size_t kb, const size_t vb,
+        uint8_t* pk, uint8_t* pv, uint64_t* bm, struct _map_list* pn,
+        struct _map_wheel* nw, const size_t a, const int kind) {
+    uint8_t* k = (uint8_t*)m->pk;
+    uint8_t* v = (uint8_t*)m->pv;
+    struct _map_list* head = 0; // new head
+    struct _map_list* node = m->head;
+    // rehash all entries into new arrays:
+    for (size_t j = 0; j < m->n; j++) {
+        size_t i = node - m->pn;
+        uint64_t key = _map_key_at(k, kb, i);
+        size_t h = (size_t)(_map_hash_of(m, kind, key) % a);
+        while (!_map_bm_is_empty(bm, h)) {
+            h = (h + 1) % a;  // new kv map cannot be full
+        }
+        _map_move_entry(pk, pv, h, k, v, i, kb, vb);
+        _map_bm_incl(bm, h);
+        _map_link(&head, pn, h);
+        if (nw && m->ext->wheel->t[i].deadline != 0) {
+            _map_timer_link(nw, a, h, m->ext->wheel->t[i].deadline);
+        }
+        node = node->next;
+    }
+    m->head = head;
+}
+
+static bool _map_resize(map_t* m, const size_t kb, const size_t vb,
+                        const size_t a) {
+    assert(m->a != 0 && a > m->n);
+    const struct _map_ext* x = _map_x(m);
+    const uint8_t huge = x->huge;
+    const size_t bb = _map_bm_bytes(a);
+    uint8_t*  pk = _map_allocate(m, huge, a * kb, false);
+    uint8_t*  pv = _map_allocate(m, huge, a * vb, false);
+    uint64_t* bm = _map_allocate(m, huge, bb, true);
+    struct _map_list* pn = _map_allocate(m, huge, _map_pn_bytes(a), false);
+    uint64_t* tb = x->tb ? _map_allocate(m, huge, bb, true) : 0;
+    struct _map_wheel* w = x->wheel;
+    const bool overflow = w && a >= UINT32_MAX - _map_wheel_sentinels;
+    struct _map_wheel* nw = w && !overflow ?
+        _map_allocate(m, huge, _map_wheel_bytes(a), false) : 0;
+    if (!pk || !pv || !bm || !pn || (x->tb && !tb) || (w && !nw)) {
+        _map_deallocate(m, huge, pk, a * kb);
+        _map_deallocate(m, huge, pv, a * vb);
+        _map_deallocate(m, huge, bm, bb);
+        _map_deallocate(m, huge, pn, _map_pn_bytes(a));
+        _map_deallocate(m, huge, tb, bb);
+        _map_deallocate(m, huge, nw, _map_wheel_bytes(a));
+        if (overflow) {
+            _map_fatal_return_zero("expiry capacity overflow: %zd\n", a);
+        }
         _map_fatal_return_zero(_map_oom);
     } else {
-        struct _map_list* head = 0; // new head
-        struct _map_list* node = m->head;
-        // rehash all entries into new arrays:
-        do {
-            size_t i = node - m->pn;
-            uint64_t key = _map_key_at(k, kb, i);
-            size_t h = map_hash(m, key, a);
-            while (!_map_bm_is_empty(bm, h)) {
-                h = (h + 1) % a;  // new kv map cannot be full
-            }
-            _map_move_entry(pk, pv, h, k, v, i, kb, vb);
-            _map_bm_incl(bm, h);
-            _map_link(&head, pn, h);
-            node = node->next;
-        } while (node != m->head);
-        m->head = head;
-        _map_set_pointers(m, pk, pv, bm, pn);
+        if (w) {
+            nw->now = w->now;
+            nw->clock = w->clock;
+            _map_wheel_reset(nw, a);
+        }
+        switch (_map_kind(m)) {
+            case _map_kind_int:
+                _map_rehash(m, kb, vb, pk, pv, bm, pn, nw, a, _map_kind_int);
+                break;
+            case _map_kind_str:
+                _map_rehash(m, kb, vb, pk, pv, bm, pn, nw, a, _map_kind_str);
+                break;
+            default:
+                _map_rehash(m, kb, vb, pk, pv, bm, pn, nw, a, _map_kind_any);
+                break;
+        }
+        // either array exists only when m->ext does
+        if (w) {
+            _map_deallocate(m, huge, w, _map_wheel_bytes(m->a));
+            m->ext->wheel = nw;
+        }
+        if (tb) {
+            _map_deallocate(m, huge, x->tb, _map_bm_bytes(m->a));
+            m->ext->tb = tb;
+            m->ext->t = 0;
+        }
+        _map_set_pointers(m, kb, vb, pk, pv, bm, pn);
         m->a = a;
         return true;
     }
 }
 
-bool _map_put(void* mv, const size_t capacity, const size_t kb, const size_t vb,
-              const void* pkey, const void* pval) {
-    map_t* m = mv;
+static bool _map_grow(map_t* m, const size_t kb, const size_t vb) {
+    const size_t growth = _map_x(m)->growth;
+    if (m->a >= (size_t)(UINTPTR_MAX / growth)) {
+        _map_fatal_return_zero("overflow: %zd\n", m->a);
+    }
+    const size_t a = m->a * growth / 100;
+    if (!_map_resize(m, kb, vb, a > m->a ? a : m->a + 1)) { return false; }
+    m->grows++;
+    return true;
+}
+
+static size_t _map_fit(const map_t* m, const size_t n) {
+    // minimum capacity to hold n entries below max load
+    const size_t load = _map_x(m)->load;
+    const size_t a = (n * 100 + load - 1) / load + 1;
+    return a < 4 ? 4 : a;
+}
+
+static void _map_shrink(map_t* m, const size_t kb, const size_t vb) {
+    // leave room to grow so alternating put/delete does not thrash:
+    size_t a = _map_fit(m, m->n) * _map_x(m)->growth / 100;
+    if (a < m->r) { a = m->r; }
+    if (a < m->a) { _map_resize(m, kb, vb, a); }
+}
+
+static _map_inline bool _map_erase(map_t* m, const size_t c,
+        const size_t kb, const size_t vb, const uint64_t key,
+        const uint64_t hash, const int kind);
+
+static _map_inline void _map_evict(map_t* m, const size_t c,
+        const size_t kb, const size_t vb, const int kind) {
+    // removes the least recently used entry at the head of the list
+    const size_t i = (size_t)(m->head - m->pn);
+    const uint8_t* pkey = m->pk + i * kb;
+    const struct _map_ext* x = m->ext; // lru mode
+    if (x->evict) { x->evict(x->context, pkey, m->pv + i * vb); }
+    const uint64_t key = _map_key(pkey, kb);
+    _map_erase(m, c, kb, vb, key, _map_hash_of(m, kind, key), kind);
+}
+
+static _map_inline void* _map_slot(map_t* m, const size_t capacity,
+        const size_t kb, const size_t vb, const void* pkey, const void* pval,
+        const uint64_t hash, const int kind, bool* inserted) {
+    // Single probe: returns the value slot of existing or inserted key,
+    // null on failure. Existing keys are not rewritten or duplicated,
+    // their values are replaced by pval if not null. New values are
+    // pval or zeros.
     size_t c = capacity;
-    if (m->a != 0) {
-        const size_t c34 = c * 3 / 4;
-        if (m->n >= c34) {
-            if (!_map_grow(m, kb, vb)) { return false; } // fatal already called
-            c = m->a;
+    const struct _map_ext* x = _map_x(m);
+    const size_t limit = m->a != 0 ? c * x->load / 100 : c - 1;
+    if (x->t > 0) {
+        if (x->t >= c / 4 || m->n + x->t >= limit) {
+            _map_sweep(m, c, kb, vb, kind, 0, 0);
         }
     }
-    uint64_t key;
-    void* key_dup = 0;
-    if (m->tag & map_keydup) {
-        if (*(void**)pkey) {
-            key_dup = strdup(*(const char**)pkey);
-            if (!key_dup) { _map_fatal_return_zero(_map_oom); }
+    if (m->a != 0) {
+        if (m->n + x->t >= limit) {
+            if (!_map_grow(m, kb, vb)) { return 0; } // fatal already called
+            c = m->a;
         }
-        pkey = &key_dup;
-        key = (uintptr_t)key_dup;
-    } else {
-        key  = _map_key(pkey, kb);
     }
+    const uint64_t key = _map_key(pkey, kb);
     void* val_dup = 0;
-    if (m->tag & map_valdup) {
+    if (pval && (m->tag & map_valdup)) {
         if (*(void**)pval) {
-            val_dup = strdup(*(const char**)pval);
-            if (!val_dup) { free(key_dup); _map_fatal_return_zero(_map_oom); }
+            val_dup = _map_strdup(m, *(const char**)pval);
+            if (!val_dup) { _map_fatal_return_zero(_map_oom); }
         }
         pval = &val_dup;
     }
+    assert(hash == map_hash64(m, key));
     uint8_t* k = (uint8_t*)m->pk;
     uint8_t* v = (uint8_t*)m->pv;
-    const size_t h = map_hash(m, key, c);
+    const size_t h = (size_t)(hash % c);
     size_t i = h;
-    while (!_map_is_empty(m, i)) {
-        const uint64_t ki = _map_key_at(k, kb, i);
-        if (m->cmp ? m->cmp(ki, key) == 0 : ki == key) {
-            _map_undup_key(m, i, kb);
-            _map_set_entry(k, v, i, pkey, pval, kb, vb);
-            // m->mc is not incremented because key set is not changed
-            return true;
-        } else {
-            i = (i + 1) % c;
-            if (i == h) { _map_fatal_return_zero("map is full\n"); }
+    size_t tomb = c; // first tombstone on the probe path
+    for (;;) {
+        if (!_map_is_empty(m, i)) {
+            const uint64_t ki = _map_key_at(k, kb, i);
+            if (_map_equal(m, kind, ki, key)) {
+                // an expired entry is reinserted without deadline
+                const bool expired = _map_expired(m, i);
+                if (expired) { _map_timer_unlink(m, i); }
+                if (pval) {
+                    _map_undup_val(m, i, vb);
+                    _map_set_at(v, i, pval, vb);
+                } else if (expired) {
+                    memset(v + i * vb, 0, vb);
+                }
+                // m->mc is not incremented because key set is not changed
+                if (x->lru != 0) { _map_touch(m, i); }
+                *inserted = expired;
+                return v + i * vb;
+            }
+        } else if (!x->tb || _map_bm_is_empty(x->tb, i)) {
+            break;
+        } else if (tomb == c) {
+            tomb = i;
         }
+        i = (i + 1) % c;
+        if (i == h) {
+            if (tomb == c) {
+                _map_strfree(m, val_dup);
+                _map_fatal_return_zero("map is full\n");
+            }
+            break;
+        }
+    }
+    if (tomb == c && x->tb && m->a == 0 && m->n + x->t + 1 >= c) {
+        // fixed map keeps one vacant slot for _map_sweep()
+        _map_strfree(m, val_dup);
+        _map_fatal_return_zero("map is full\n");
+    }
+    void* key_dup = 0;
+    if (m->tag & map_keydup) {
+        if (*(void**)pkey) {
+            key_dup = _map_strdup(m, *(const char**)pkey);
+            if (!key_dup) {
+                _map_strfree(m, val_dup);
+                _map_fatal_return_zero(_map_oom);
+            }
+        }
+        pkey = &key_dup;
+    }
+    if (tomb < c) {
+        i = tomb;
+        _map_bm_excl(x->tb, i);
+        m->ext->t--;
+    }
+    _map_set_at(k, i, pkey, kb);
+    if (pval) {
+        _map_set_at(v, i, pval, vb);
+    } else {
+        memset(v + i * vb, 0, vb);
     }
-    _map_set_entry(k, v, i, pkey, pval, kb, vb);
     _map_link(&m->head, m->pn, i);
     _map_bm_incl(m->bm, i);
     m->n++;
     m->mc++;
-    return true;
+    *inserted = true;
+    if (x->lru != 0 && m->n > x->lru) {
+        _map_evict(m, c, kb, vb, kind);
+        // backward shift may have moved the new entry:
+        return (void*)_map_find(m, c, kb, vb, key, hash, kind);
+    }
+    return v + i * vb;
 }
 
-bool _map_delete(void* mv, const size_t c, size_t kb, size_t vb,
-                 const void* pkey) {
+static _map_inline bool _map_insert(map_t* m, const size_t capacity,
+        const size_t kb, const size_t vb, const void* pkey, const void* pval,
+        const uint64_t hash, const int kind) {
+    bool inserted = false;
+    return _map_slot(m, capacity, kb, vb, pkey, pval, hash, kind,
+                     &inserted) != 0;
+}
+
+bool _map_put_hashed(void* mv, const size_t capacity,
+                     const size_t kb, const size_t vb,
+                     const void* pkey, const void* pval, uint64_t hash) {
     map_t* m = mv;
+    switch (_map_kind(m)) {
+        case _map_kind_int: return _map_insert(m, capacity, kb, vb,
+                                    pkey, pval, hash, _map_kind_int);
+        case _map_kind_str: return _map_insert(m, capacity, kb, vb,
+                                    pkey, pval, hash, _map_kind_str);
+        default:            return _map_insert(m, capacity, kb, vb,
+                                    pkey, pval, hash, _map_kind_any);
+    }
+}
+
+bool _map_put(void* mv, const size_t capacity, const size_t kb, const size_t vb,
+              const void* pkey, const void* pval) {
+    return _map_put_hashed(mv, capacity, kb, vb, pkey, pval,
+                           _map_hash_key(mv, kb, pkey));
+}
+
+bool _map_put_int(void* mv, const size_t capacity,
+                  const size_t kb, const size_t vb,
+                  const void* pkey, const void* pval) {
+    map_t* m = mv;
+    if (m->cmp || m->hash) { return _map_put(mv, capacity, kb, vb, pkey, pval); }
+    const uint64_t hash = _map_hash(_map_key(pkey, kb));
+    return _map_insert(m, capacity, kb, vb, pkey, pval, hash, _map_kind_int);
+}
+
+bool _map_put_str(void* mv, const size_t capacity,
+                  const size_t kb, const size_t vb,
+                  const void* pkey, const void* pval) {
+    map_t* m = mv;
+    if (_map_kind(m) != _map_kind_str) {
+        return _map_put(mv, capacity, kb, vb, pkey, pval);
+    }
+    const uint64_t hash = _map_str_hash(_map_key(pkey, kb));
+    return _map_insert(m, capacity, kb, vb, pkey, pval, hash, _map_kind_str);
+}
+
+static void* _map_update(map_t* m, const size_t c,
+        const size_t kb, const size_t vb, const void* pkey, bool* inserted) {
+    if (m->tag & map_valdup) {
+        _map_fatal_return_zero("map_valdup values cannot be updated in place\n");
+    }
+    const uint64_t hash = _map_hash_key(m, kb, pkey);
+    switch (_map_kind(m)) {
+        case _map_kind_int: return _map_slot(m, c, kb, vb, pkey, 0, hash,
+                                             _map_kind_int, inserted);
+        case _map_kind_str: return _map_slot(m, c, kb, vb, pkey, 0, hash,
+                                             _map_kind_str, inserted);
+        default:            return _map_slot(m, c, kb, vb, pkey, 0, hash,
+                                             _map_kind_any, inserted);
+    }
+}
+
+void* _map_get_or_insert(void* mv, const size_t c,
+                         const size_t kb, const size_t vb,
+                         const void* pkey, bool* inserted) {
+    bool ignored = false;
+    return _map_update(mv, c, kb, vb, pkey, inserted ? inserted : &ignored);
+}
+
+bool _map_upsert(void* mv, const size_t c,
+                 const size_t kb, const size_t vb,
+                 const void* pkey, const void* pval,
+                 void (*merge)(void* val, const void* with)) {
+    bool inserted = false;
+    void* p = _map_update(mv, c, kb, vb, pkey, &inserted);
+    if (p && inserted) {
+        _map_set_at(p, 0, pval, vb);
+    } else if (p) {
+        merge(p, pval);
+    }
+    return p != 0;
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define _map_prefetch(p) __builtin_prefetch(p)
+#else
+#define _map_prefetch(p) ((void)(p))
+#endif
+
+enum { _map_probe_batch = 16 }; // home slots prefetched ahead
+
+static bool _map_combine_put(map_t* d, const size_t cd, const size_t kb,
+        const size_t vb, const void* pkey, const void* pval,
+        const void* with, void (*merge)(void* val, const void* with),
+        uint64_t hash) {
+    // puts key and val into d, with != null: merge or replace with it
+    const size_t c = d->a > 0 ? d->a : cd;
+    if (!with) {
+        return _map_put_hashed(d, c, kb, vb, pkey, pval, hash);
+    } else if (!merge) {
+        return _map_put_hashed(d, c, kb, vb, pkey, with, hash);
+    }
+    // new values are zero filled by _map_slot(), pval may be null when
+    // the key is in both maps and was evicted from an LRU map d
+    bool inserted = false;
+    void* p = _map_update(d, c, kb, vb, pkey, &inserted);
+    if (p && pval) { _map_set_at(p, 0, pval, vb); }
+    if (p) { merge(p, with); }
+    return p != 0;
+}
+
+static bool _map_combine_merge(map_t* d, const size_t cd, const size_t kb,
+        const size_t vb, const void* pkey, const void* with,
+        void (*merge)(void* val, const void* with), uint64_t hash) {
+    // new keys get with, existing keys merge or are replaced with it
+    const size_t c = d->a > 0 ? d->a : cd;
+    if (!merge) { return _map_put_hashed(d, c, kb, vb, pkey, with, hash); }
+    bool inserted = false;
+    void* p = _map_update(d, c, kb, vb, pkey, &inserted);
+    if (p && inserted) {
+        _map_set_at(p, 0, with, vb);
+    } else if (p) {
+        merge(p, with);
+    }
+    return p != 0;
+}
+
+bool _map_combine(void* dv, size_t cd, const void* av, size_t ca,
+                  const void* bv, size_t cb, size_t kb, size_t vb, int op,
+                  void (*merge)(void* val, const void* with),
+                  bool same_types) {
+    // see _kvm_combine(): iterates s in insertion order and probes o
+    map_t* d = dv;
+    const map_t* a = av;
+    const map_t* b = bv;
+    if (!same_types) {
+        _map_fatal_return_zero("map key or value type mismatch\n");
+    }
+    if (d == a || d == b) {
+        _map_fatal_return_zero("destination map is an operand\n");
+    }
+    const bool swap = op == _map_union ||
+                      (op == _map_intersect && b->n < a->n);
+    const map_t* s = swap ? b : a;
+    const map_t* o = swap ? a : b;
+    const size_t co = swap ? ca : cb;
+    const size_t result = op == _map_union ? a->n + b->n : s->n;
+    const bool fresh = d->n == 0 && _map_x(d)->lru == 0; // see _kvm_combine()
+    if (d->a > 0 && !_map_reserve(d, cd, kb, vb, d->n + result)) {
+        return false;
+    }
+    if (op == _map_union && a->head) {
+        const struct _map_list* node = a->head;
+        do {
+            const size_t i = (size_t)(node - a->pn);
+            const uint8_t* key = a->pk + i * kb;
+            if (!_map_expired(a, i) &&
+                !_map_combine_put(d, cd, kb, vb, key, a->pv + i * vb, 0, 0,
+                                  _map_hash_key(a, kb, key))) {
+                return false;
+            }
+            node = node->next;
+        } while (node != a->head);
+    }
+    if (op == _map_union && fresh) {
+        const struct _map_list* node = b->head;
+        while (node) {
+            const size_t i = (size_t)(node - b->pn);
+            const uint8_t* key = b->pk + i * kb;
+            if (!_map_expired(b, i) &&
+                !_map_combine_merge(d, cd, kb, vb, key, b->pv + i * vb,
+                                    merge, _map_hash_key(b, kb, key))) {
+                return false;
+            }
+            node = node->next != b->head ? node->next : 0;
+        }
+        return true;
+    }
+    const struct _map_list* node = s->head;
+    while (node) {
+        size_t   slot[_map_probe_batch];
+        uint64_t hash[_map_probe_batch];
+        size_t k = 0;
+        while (node && k < _map_probe_batch) {
+            slot[k] = (size_t)(node - s->pn);
+            hash[k] = _map_hash_key(s, kb, s->pk + slot[k] * kb);
+            if (o->n > 0) { _map_prefetch(o->pk + (hash[k] % co) * kb); }
+            k++;
+            node = node->next != s->head ? node->next : 0;
+        }
+        for (size_t j = 0; j < k; j++) {
+            const size_t i = slot[j];
+            const uint8_t* key = s->pk + i * kb;
+            const uint8_t* val = s->pv + i * vb;
+            if (_map_expired(s, i)) { continue; }
+            const uint8_t* found = o->n > 0 ?
+                _map_peek(o, co, kb, vb, key, hash[j]) : 0;
+            bool ok = true;
+            if (op == _map_union) {
+                ok = _map_combine_put(d, cd, kb, vb, key, found ? 0 : val,
+                                      found ? val : 0, merge, hash[j]);
+            } else if (op == _map_difference) {
+                if (!found) {
+                    ok = _map_combine_put(d, cd, kb, vb, key, val, 0, 0,
+                                          hash[j]);
+                }
+            } else if (found) { // intersection: values of a merge b
+                const uint8_t* val_a = swap ? found : val;
+                const uint8_t* val_b = swap ? val : found;
+                ok = _map_combine_put(d, cd, kb, vb, key, val_a,
+                                      merge ? val_b : 0, merge, hash[j]);
+            }
+            if (!ok) { return false; }
+        }
+    }
+    return true;
+}
+
+static _map_inline bool _map_erase(map_t* m, const size_t c,
+        const size_t kb, const size_t vb, const uint64_t key,
+        const uint64_t hash, const int kind) {
     uint8_t* k = (uint8_t*)m->pk;
     uint8_t* v = (uint8_t*)m->pv;
-    const uint64_t key = _map_key(pkey, kb);
-    size_t h = m->hash ? m->hash(key, c) : _map_hash(key, c);
+    assert(hash == map_hash64(m, key));
+    size_t h = (size_t)(hash % c);
+    if (_map_x(m)->tb) {
+        const size_t i = _map_find_past_tombs(m, c, kb, key, h, kind);
+        if (i < c) {
+            _map_bm_excl(m->bm, i);
+            _map_timer_unlink(m, i);
+            _map_undup(m, i, kb, vb);
+            _map_unlink(&m->head, m->pn, i);
+            _map_bm_incl(m->ext->tb, i);
+            m->ext->t++;
+            m->n--;
+            m->mc++;
+        }
+        return i < c;
+    }
     bool found = false;
     size_t i = h; // start
     while (!found && !_map_is_empty(m, i)) {
         const uint64_t ki = _map_key_at(k, kb, i);
-        found = m->cmp ? m->cmp(ki, key) == 0 : ki == key;
+        found = _map_equal(m, kind, ki, key);
         if (!found) {
             i = (i + 1) % c;
             if (i == h) { break; }
@@ -561,6 +1703,7 @@ bool _map_delete(void* mv, const size_t c, size_t kb, size_t vb,
     if (found) {
 //      m->bm[i / 64] &= ~(1uLL << (i % 64));
         _map_bm_excl(m->bm, i);
+        _map_timer_unlink(m, i);
         _map_undup(m, i, kb, vb);
         _map_unlink(&m->head, m->pn, i);
         size_t x = i;
@@ -569,15 +1712,15 @@ bool _map_delete(void* mv, const size_t c, size_t kb, size_t vb,
             if (_map_is_empty(m, x)) { break; }
             assert(x != i); // because empty slot exists
             const uint64_t kx = _map_key_at(k, kb, x);
-            h = m->hash ? m->hash(kx, c) : _map_hash(kx, c);
+            h = (size_t)(_map_hash_of(m, kind, kx) % c);
             const bool can_move = i <= x ? x < h || h <= i :
                                            x < h && h <= i;
             if (can_move) {
                 _map_move_entry(k, v, i, k, v, x, kb, vb);
                 _map_bm_incl(m->bm, i);
                 _map_bm_excl(m->bm, x);
-                _map_unlink(&m->head, m->pn, x);
-                _map_link(&m->head, m->pn, i);
+                _map_relocate(&m->head, m->pn, i, x);
+                _map_timer_move(m, i, x);
                 i = x;
             }
         }
@@ -587,23 +1730,456 @@ bool _map_delete(void* mv, const size_t c, size_t kb, size_t vb,
     return found;
 }
 
+static _map_inline bool _map_remove(map_t* m, const size_t c,
+        const size_t kb, const size_t vb, const uint64_t key,
+        const uint64_t hash, const int kind) {
+    const bool found = _map_erase(m, c, kb, vb, key, hash, kind);
+    if (found && _map_x(m)->low != 0 && m->a > m->r &&
+        m->n * 100 < (size_t)_map_x(m)->low * m->a) {
+        _map_shrink(m, kb, vb);
+    }
+    return found;
+}
+
+bool _map_delete_hashed(void* mv, const size_t c, size_t kb, size_t vb,
+                        const void* pkey, uint64_t hash) {
+    map_t* m = mv;
+    const uint64_t key = _map_key(pkey, kb);
+    switch (_map_kind(m)) {
+        case _map_kind_int:
+            return _map_remove(m, c, kb, vb, key, hash, _map_kind_int);
+        case _map_kind_str:
+            return _map_remove(m, c, kb, vb, key, hash, _map_kind_str);
+        default:
+            return _map_remove(m, c, kb, vb, key, hash, _map_kind_any);
+    }
+}
+
+bool _map_delete(void* mv, const size_t c, size_t kb, size_t vb,
+                 const void* pkey) {
+    return _map_delete_hashed(mv, c, kb, vb, pkey, _map_hash_key(mv, kb, pkey));
+}
+
+bool _map_delete_int(void* mv, const size_t c, size_t kb, size_t vb,
+                     const void* pkey) {
+    map_t* m = mv;
+    if (m->cmp || m->hash) { return _map_delete(mv, c, kb, vb, pkey); }
+    const uint64_t key = _map_key(pkey, kb);
+    return _map_remove(m, c, kb, vb, key, _map_hash(key), _map_kind_int);
+}
+
+bool _map_delete_str(void* mv, const size_t c, size_t kb, size_t vb,
+                     const void* pkey) {
+    map_t* m = mv;
+    if (_map_kind(m) != _map_kind_str) { return _map_delete(mv, c, kb, vb, pkey); }
+    const uint64_t key = _map_key(pkey, kb);
+    return _map_remove(m, c, kb, vb, key, _map_str_hash(key), _map_kind_str);
+}
+
+size_t _map_erase_if(void* mv, size_t c, size_t kb, size_t vb,
+        bool (*pred)(void* context, const void* key, void* val),
+        void* context) {
+    map_t* m = mv;
+    size_t erased = 0;
+    if (m->n + _map_x(m)->t == c) {
+        // full fixed map: the sweep needs a vacant slot to start from
+        size_t i = 0;
+        while (i < c && !pred(context, m->pk + i * kb, m->pv + i * vb)) { i++; }
+        if (i == c) { return 0; }
+        const void* pkey = m->pk + i * kb;
+        _map_delete_hashed(m, c, kb, vb, pkey, _map_hash_key(m, kb, pkey));
+        erased++;
+    }
+    erased += _map_sweep_kind(m, c, kb, vb, pred, context);
+    if (erased > 0 && _map_x(m)->low != 0 && m->a > m->r &&
+        m->n * 100 < (size_t)_map_x(m)->low * m->a) {
+        _map_shrink(m, kb, vb);
+    }
+    return erased;
+}
+
+bool _map_tombstones(void* mv, size_t c, size_t kb, size_t vb,
+                     void* tombs, bool on) {
+    map_t* m = mv;
+    if (on && !_map_x(m)->tb) {
+        if (m->a == 0 && m->n + 1 >= c) {
+            _map_fatal_return_zero("map is full\n");
+        }
+        if (m->a == 0 && !tombs) {
+            _map_fatal_return_zero("no tombstones bitmap\n");
+        }
+        struct _map_ext* x = _map_ext_of(m);
+        if (!x) { _map_fatal_return_zero(_map_oom); }
+        if (m->a != 0) {
+            x->tb = _map_allocate(m, x->huge, _map_bm_bytes(c), true);
+            if (!x->tb) { _map_fatal_return_zero(_map_oom); }
+        } else {
+            x->tb = tombs;
+            memset(x->tb, 0, ((c + 63) / 64) * sizeof(uint64_t));
+        }
+        x->t = 0;
+    } else if (!on && _map_x(m)->tb) {
+        if (m->ext->t > 0) { _map_purge(m, c, kb, vb); }
+        if (m->a != 0) {
+            _map_deallocate(m, m->ext->huge, m->ext->tb, _map_bm_bytes(c));
+        }
+        m->ext->tb = 0;
+    }
+    return true;
+}
+
+size_t _map_compact(void* mv, size_t c, size_t kb, size_t vb) {
+    map_t* m = mv;
+    const size_t t = _map_x(m)->t;
+    if (t > 0) { _map_purge(m, c, kb, vb); }
+    return t;
+}
+
+bool _map_reserve(void* mv, size_t c, size_t kb, size_t vb, size_t n) {
+    map_t* m = mv;
+    if (m->a == 0) {
+        const size_t fits = _map_x(m)->tb ? c - 1 : c; // see map_tombstones()
+        if (n > fits) { _map_fatal_return_zero("fixed map capacity: %zd\n", c); }
+        return true;
+    } else {
+        const size_t a = _map_fit(m, n);
+        if (a > m->r) { m->r = a; }
+        return a <= m->a || _map_resize(m, kb, vb, a);
+    }
+}
+
+bool _map_shrink_to_fit(void* mv, size_t kb, size_t vb) {
+    map_t* m = mv;
+    if (m->a == 0) { return true; } // fixed map
+    const size_t a = _map_fit(m, m->n);
+    m->r = a;
+    return a >= m->a || _map_resize(m, kb, vb, a);
+}
+
+bool _map_load_factors(void* mv, size_t load, size_t growth, size_t low) {
+    map_t* m = mv;
+    // after growing or shrinking the load must stay above low-water mark:
+    if (load < 10 || load > 95 || growth < 110 || growth > 1000 ||
+        low * growth >= load * 100) {
+        _map_fatal_return_zero("invalid load factors: %zd %zd %zd\n",
+                               load, growth, low);
+    }
+    struct _map_ext* x = _map_ext_of(m);
+    if (!x) { _map_fatal_return_zero(_map_oom); }
+    x->load   = (uint16_t)load;
+    x->growth = (uint16_t)growth;
+    x->low    = (uint16_t)low;
+    return true;
+}
+
+bool _map_lru(void* mv, size_t c, size_t kb, size_t vb, size_t n,
+        void (*evict)(void* context, const void* key, void* val),
+        void* context) {
+    map_t* m = mv;
+    if (m->a == 0) {
+        // one slot for the entry inserted right before eviction:
+        const size_t fits = _map_x(m)->tb ? c - 1 : c; // see map_tombstones()
+        if (n >= fits) {
+            _map_fatal_return_zero("fixed map capacity: %zd\n", c);
+        }
+    } else if (n != 0 && !_map_reserve(m, c, kb, vb, n + 1)) {
+        return false; // fatal already called
+    }
+    c = m->a > 0 ? m->a : c;
+    if (n == 0 && !m->ext) { return true; } // lru was never on
+    struct _map_ext* x = _map_ext_of(m);
+    if (!x) { _map_fatal_return_zero(_map_oom); }
+    x->lru = n;
+    x->evict = n != 0 ? evict : 0;
+    x->context = n != 0 ? context : 0;
+    while (n != 0 && m->n > n) {
+        switch (_map_kind(m)) {
+            case _map_kind_int: _map_evict(m, c, kb, vb, _map_kind_int); break;
+            case _map_kind_str: _map_evict(m, c, kb, vb, _map_kind_str); break;
+            default:            _map_evict(m, c, kb, vb, _map_kind_any); break;
+        }
+    }
+    return true;
+}
+
+bool _map_huge_pages(void* mv, size_t kb, size_t vb, bool on, bool populate) {
+    map_t* m = mv;
+    if (m->a == 0) { return true; } // fixed maps live in caller memory
+    const uint8_t huge = on ? (uint8_t)(_map_huge |
+                              (populate ? _map_populate : 0)) : 0;
+    struct _map_ext* x = _map_ext_of(m);
+    if (!x) { _map_fatal_return_zero(_map_oom); }
+    if (!m->allocator && ((huge ^ x->huge) & _map_huge) != 0) {
+        // move arrays to the other kind of memory, slots stay in place:
+        const size_t a  = m->a;
+        const size_t bb = _map_bm_bytes(a);
+        uint8_t*  pk = _map_allocate(m, huge, a * kb, false);
+        uint8_t*  pv = _map_allocate(m, huge, a * vb, false);
+        uint64_t* bm = _map_allocate(m, huge, bb, false);
+        struct _map_list* pn = _map_allocate(m, huge, _map_pn_bytes(a), false);
+        uint64_t* tb = x->tb ? _map_allocate(m, huge, bb, false) : 0;
+        const size_t wb = _map_wheel_bytes(a);
+        struct _map_wheel* w = x->wheel ? _map_allocate(m, huge, wb, false) : 0;
+        if (!pk || !pv || !bm || !pn || (x->tb && !tb) || (x->wheel && !w)) {
+            _map_deallocate(m, huge, pk, a * kb);
+            _map_deallocate(m, huge, pv, a * vb);
+            _map_deallocate(m, huge, bm, bb);
+            _map_deallocate(m, huge, pn, _map_pn_bytes(a));
+            _map_deallocate(m, huge, tb, bb);
+            _map_deallocate(m, huge, w, wb);
+            _map_fatal_return_zero(_map_oom);
+        }
+        if (x->wheel) {
+            memcpy(w, x->wheel, wb);
+            _map_deallocate(m, x->huge, x->wheel, wb);
+            x->wheel = w;
+        }
+        memcpy(pk, m->pk, a * kb);
+        memcpy(pv, m->pv, a * vb);
+        memcpy(bm, m->bm, bb);
+        for (size_t i = 0; i < a; i++) { // list links point into m->pn
+            if (!_map_is_empty(m, i)) {
+                pn[i].prev = pn + (m->pn[i].prev - m->pn);
+                pn[i].next = pn + (m->pn[i].next - m->pn);
+            }
+        }
+        if (m->head) { m->head = pn + (m->head - m->pn); }
+        if (x->tb) {
+            memcpy(tb, x->tb, bb);
+            _map_deallocate(m, x->huge, x->tb, bb);
+            x->tb = tb;
+        }
+        _map_set_pointers(m, kb, vb, pk, pv, bm, pn);
+    }
+    x->huge = huge;
+    return true;
+}
+
+bool _map_expiry(void* mv, bool on, uint64_t (*clock)(void)) {
+    map_t* m = mv;
+    if (m->a == 0) {
+        _map_fatal_return_zero("expiry requires heap map\n");
+    } else if (on && !_map_x(m)->wheel) {
+        if (m->a >= UINT32_MAX - _map_wheel_sentinels) {
+            _map_fatal_return_zero("expiry capacity overflow: %zd\n", m->a);
+        }
+        struct _map_ext* x = _map_ext_of(m);
+        if (!x) { _map_fatal_return_zero(_map_oom); }
+        x->wheel = _map_allocate(m, x->huge, _map_wheel_bytes(m->a), false);
+        if (!x->wheel) { _map_fatal_return_zero(_map_oom); }
+        x->wheel->now = clock ? clock() : 0;
+        _map_wheel_reset(x->wheel, m->a);
+    } else if (!on && _map_x(m)->wheel) {
+        _map_deallocate(m, m->ext->huge, m->ext->wheel,
+                        _map_wheel_bytes(m->a));
+        m->ext->wheel = 0;
+    }
+    if (_map_x(m)->wheel) { m->ext->wheel->clock = clock; }
+    return true;
+}
+
+bool _map_expire_at(void* mv, const size_t c, size_t kb, size_t vb,
+                    const void* pkey, uint64_t deadline) {
+    map_t* m = mv;
+    struct _map_wheel* w = _map_x(m)->wheel;
+    if (!w) { _map_fatal_return_zero("expiry is off\n"); }
+    const uint8_t* r = _map_peek(m, c, kb, vb, pkey,
+                                 _map_hash_key(m, kb, pkey));
+    if (r) {
+        const size_t i = (size_t)(r - m->pv) / vb;
+        _map_timer_unlink(m, i);
+        if (deadline != 0) { _map_timer_link(w, c, i, deadline); }
+    }
+    return r != 0;
+}
+
+static size_t _map_wheel_drain(map_t* m, const size_t kb, const size_t vb,
+                               const size_t sentinel, const bool expire) {
+    // see _kvm_wheel_drain()
+    struct _map_wheel* w = _map_x(m)->wheel;
+    struct _map_timer* t = w->t;
+    const int kind = _map_kind(m);
+    size_t expired = 0;
+    while (t[sentinel].next != sentinel) {
+        const size_t i = t[sentinel].next;
+        const uint64_t deadline = t[i].deadline;
+        _map_timer_unlink(m, i);
+        if (expire) {
+            const uint64_t key = _map_key_at(m->pk, kb, i);
+            switch (kind) {
+                case _map_kind_int:
+                    _map_erase(m, m->a, kb, vb, key, _map_hash(key),
+                               _map_kind_int);
+                    break;
+                case _map_kind_str:
+                    _map_erase(m, m->a, kb, vb, key, _map_str_hash(key),
+                               _map_kind_str);
+                    break;
+                default:
+                    _map_erase(m, m->a, kb, vb, key, map_hash64(m, key),
+                               _map_kind_any);
+                    break;
+            }
+            expired++;
+        } else {
+            _map_timer_link(w, m->a, i, deadline); // to a lower level
+        }
+    }
+    return expired;
+}
+
+size_t _map_expire(void* mv, size_t kb, size_t vb, uint64_t now) {
+    // see _kvm_expire()
+    map_t* m = mv;
+    struct _map_wheel* w = _map_x(m)->wheel;
+    if (!w) { return 0; }
+    size_t expired = _map_wheel_drain(m, kb, vb,
+                                      m->a + _map_wheel_overdue, true);
+    for (;;) {
+        size_t level = _map_wheel_levels;
+        size_t slot  = 0;
+        uint64_t start = UINT64_MAX;
+        for (size_t l = 0; l < _map_wheel_levels; l++) {
+            const size_t shift = l * 6;
+            const size_t current = (size_t)(w->now >> shift) & 63;
+            const uint64_t mask = w->bits[l] & (~0uLL << current);
+            if (mask != 0) {
+                const size_t s = _map_ctz64(mask);
+                const uint64_t upper = shift + 6 < 64 ?
+                    w->now >> (shift + 6) << (shift + 6) : 0;
+                const uint64_t b = upper | ((uint64_t)s << shift);
+                if (b <= start) { level = l; slot = s; start = b; }
+            }
+        }
+        if (level == _map_wheel_levels || start > now) { break; }
+        w->bits[level] &= ~(1uLL << slot);
+        if (start > w->now) { w->now = start; }
+        expired += _map_wheel_drain(m, kb, vb, m->a + level * 64 + slot,
+                                    level == 0);
+        if (level == 0) {
+            if (start == UINT64_MAX) { break; }
+            w->now = start + 1;
+        }
+    }
+    if (now >= w->now && now < UINT64_MAX) { w->now = now + 1; }
+    if (expired > 0 && _map_x(m)->low != 0 && m->a > m->r &&
+        m->n * 100 < (size_t)_map_x(m)->low * m->a) {
+        _map_shrink(m, kb, vb);
+    }
+    return expired;
+}
+
+// map_stats() is kvm_stats() over map slots (see comments in kvm.h)
+
+enum { _map_stats_window = 1024 };
+
+struct _map_stats_sums {
+    double hits;    // sum of probe lengths of present keys
+    double misses;  // sum of miss probe lengths of scanned home slots
+    size_t entries; // present keys scanned
+};
+
+static inline bool _map_stats_empty(const map_t* m, const size_t i) {
+    const uint64_t* tb = _map_x(m)->tb;
+    return _map_is_empty(m, i) && (!tb || _map_bm_is_empty(tb, i));
+}
+
+static void _map_stats_cluster(struct map_stats* s,
+                               struct _map_stats_sums* sums, size_t run) {
+    size_t bucket = 63 - _map_clz64(run);
+    if (bucket >= map_stats_clusters) { bucket = map_stats_clusters - 1; }
+    s->cluster[bucket]++;
+    s->clusters++;
+    if (run > s->cluster_max) { s->cluster_max = run; }
+    if (run + 1 > s->miss_max) { s->miss_max = run + 1; }
+    sums->misses += (double)(run + 1) * (double)(run + 2) / 2 - 1;
+}
+
+static size_t _map_stats_scan(const map_t* m, const size_t c, const size_t kb,
+        struct map_stats* s, struct _map_stats_sums* sums,
+        const size_t start, const size_t slots, const size_t limit) {
+    size_t count = 0;
+    size_t run = 0;
+    while (count < limit && (count < slots || run > 0)) {
+        const size_t i = (start + count) % c;
+        if (!_map_is_empty(m, i)) {
+            const size_t h = map_hash(m, _map_key_at(m->pk, kb, i), c);
+            const size_t probes = (i + c - h) % c + 1;
+            sums->hits += (double)probes;
+            sums->entries++;
+            if (probes > s->hit_max) { s->hit_max = probes; }
+        }
+        if (!_map_stats_empty(m, i)) {
+            run++;
+        } else {
+            if (run > 0) { _map_stats_cluster(s, sums, run); run = 0; }
+            sums->misses += 1;
+            if (s->miss_max == 0) { s->miss_max = 1; }
+        }
+        count++;
+    }
+    if (run > 0) { _map_stats_cluster(s, sums, run); }
+    return count;
+}
+
+void _map_stats(const void* mv, size_t c, size_t kb, size_t vb,
+                struct map_stats* s, size_t sample) {
+    const map_t* m = mv;
+    memset(s, 0, sizeof(*s));
+    s->capacity = c;
+    s->n = m->n;
+    const struct _map_ext* x = _map_x(m);
+    s->tombstones = x->t;
+    s->load = (double)m->n / (double)c;
+    s->grows = m->grows;
+    s->key_bytes = c * kb;
+    s->val_bytes = c * vb;
+    s->bitmap_bytes = _map_bm_bytes(c) * (x->tb ? 2 : 1);
+    s->other_bytes = _map_pn_bytes(c) +
+                     (x->wheel ? _map_wheel_bytes(c) : 0);
+    size_t start = 0;
+    while (start < c && !_map_stats_empty(m, start)) { start++; }
+    if (start == c) { start = 0; } // no empty slots
+    struct _map_stats_sums sums = {0};
+    if (sample == 0 || sample >= c) {
+        s->sampled = _map_stats_scan(m, c, kb, s, &sums, start, c, c);
+    } else {
+        const size_t windows = (sample + _map_stats_window - 1) /
+                               _map_stats_window;
+        const size_t stride = c / windows;
+        size_t end = 0; // offset past the last scanned slot
+        for (size_t w = 0; w < windows; w++) {
+            size_t o = w * stride > end ? w * stride : end;
+            while (o < c && !_map_stats_empty(m, (start + o) % c)) { o++; }
+            if (o >= c) { break; }
+            const size_t count = _map_stats_scan(m, c, kb, s, &sums,
+                (start + o) % c, _map_stats_window, c - o);
+            s->sampled += count;
+            end = o + count;
+        }
+    }
+    s->hit_mean  = sums.entries > 0 ? sums.hits / (double)sums.entries : 0;
+    s->miss_mean = s->sampled > 0 ? sums.misses / (double)s->sampled : 0;
+}
+
 static void _map_print(void* mv, size_t c, size_t kb, size_t vb) {
     map_t* m = mv;
     if (m->head) {
         printf("head: %zd capacity: %zd entries: %zd\n",
                m->head - m->pn, c, m->n);
     } else {
-        printf("head: null capacity: zd entries: %zd\n", c, m->n);
+        printf("head: null capacity: %zd entries: %zd\n", c, m->n);
     }
     for (size_t i = 0; i < c; i++) {
         if (!_map_is_empty(m, i)) {
             const uint64_t key = _map_key_at(m->pk, kb, i);
             const size_t prev = m->pn[i].prev - m->pn;
             const size_t next = m->pn[i].next - m->pn;
-            printf("[%3zd] k=%016llX .prev=%3zd .next=%3zd ", i, key, prev, next);
+            printf("[%3zd] k=%016llX .prev=%3zd .next=%3zd ", i,
+                   (unsigned long long)key, prev, next);
             for (size_t k = 0; k < vb; k++) { printf("%02X", m->pv[i * vb + k]); }
-            const uint64_t h = _map_hash(key, c);
-            printf(" hash=%lld\n", h);
+            const size_t h = map_hash(m, key, c);
+            printf(" hash=%zd\n", h);
         }
     }
 }
@@ -0,0 +1,193 @@
+﻿#define UNSTD_NO_RT_IMPLEMENTATION
+#include "rt/ustd.h"
+#include "omap.h"
+#include "kvm.h" // point operations for comparison
+
+static uint64_t seed = 1;
+
+static int test0(void) {
+    omap(int, double) m;
+    omap_init(&m);
+    omap_put(&m, 42, 3.1415);
+    omap_put(&m, -7, 2.71);
+    omap_put(&m, 5, 1.41);
+    double* p = omap_get(&m, 42);
+    printf("m[42]: %f\n", *p);
+    const int order[] = { -7, 5, 42 };
+    size_t j = 0;
+    struct omap_iterator iterator = omap_iterator(&m);
+    while (omap_has_next(&iterator)) {
+        double val = 0;
+        const int key = *omap_next_entry(&m, &iterator, &val);
+        printf("%d: %f\n", key, val);
+        swear(key == order[j++]);
+    }
+    swear(j == countof(order));
+    iterator = omap_lower_bound(&m, 0);
+    swear(*omap_next(&m, &iterator) == 5);
+    swear(omap_delete(&m, 42) && !omap_delete(&m, 42) && !omap_get(&m, 42));
+    omap_free(&m);
+    swear(m.n == 0 && omap_get(&m, 5) == null);
+    return 0;
+}
+
+static int test1_verify(void* mv, const bool* ref, int n, int base) {
+    omap(int16_t, int32_t)* m = mv;
+    // random ranges against reference membership
+    for (int q = 0; q < 16; q++) {
+        int from = (int)(random64(&seed) % (uint64_t)n) + base;
+        int to = from + (int)(random64(&seed) % 64);
+        if (to > base + n) { to = base + n; }
+        int k = from;
+        struct omap_iterator iterator = omap_range(m, from, to);
+        while (omap_has_next(&iterator)) {
+            int32_t val = 0;
+            const int key = *omap_next_entry(m, &iterator, &val);
+            while (!ref[k - base]) { k++; }
+            swear(key == k && val == key * 3);
+            k++;
+        }
+        while (k < to) { swear(!ref[k - base]); k++; }
+    }
+    size_t count = 0;
+    for (int k = base; k < base + n; k++) {
+        const int32_t* v = omap_get(m, k);
+        swear(ref[k - base] ? v != null && *v == k * 3 : v == null);
+        count += ref[k - base];
+    }
+    swear(m->n == count);
+    return 0;
+}
+
+static int test1(void) {
+    // signed keys against reference through splits, merges and borrows
+    enum { n = 4000, base = -2000 };
+    static bool ref[n];
+    omap(int16_t, int32_t) m;
+    omap_init(&m);
+    for (int step = 0; step < 400 * 1000; step++) {
+        const int key = (int)(random64(&seed) % n) + base;
+        // phases: fill, drain to collapse the tree, fill again
+        const uint64_t r = random64(&seed) % 8;
+        const bool put = (step / 50000) % 2 == 0 ? r != 0 : r == 0;
+        if (put) {
+            swear(omap_put(&m, key, key * 3));
+            ref[key - base] = true;
+        } else {
+            swear(omap_delete(&m, key) == ref[key - base]);
+            ref[key - base] = false;
+        }
+        if (step % 2000 == 0) { test1_verify(&m, ref, n, base); }
+    }
+    test1_verify(&m, ref, n, base);
+    omap_free(&m);
+    // unsigned keys above 2^63 order after smaller keys:
+    omap(uint64_t, uint8_t) u;
+    omap_init(&u);
+    const uint64_t keys[] = { 1, 1uLL << 63, UINT64_MAX, 0, 1uLL << 62 };
+    for (size_t i = 0; i < countof(keys); i++) {
+        swear(omap_put(&u, keys[i], (uint8_t)i));
+    }
+    const uint64_t order[] = { 0, 1, 1uLL << 62, 1uLL << 63, UINT64_MAX };
+    size_t j = 0;
+    struct omap_iterator iterator = omap_iterator(&u);
+    while (omap_has_next(&iterator)) {
+        swear(*omap_next(&u, &iterator) == order[j++]);
+    }
+    swear(j == countof(order));
+    iterator = omap_lower_bound(&u, UINT64_MAX);
+    swear(*omap_next(&u, &iterator) == UINT64_MAX && !omap_has_next(&iterator));
+    omap_free(&u);
+    return 0;
+}
+
+static void shuffle(size_t index[], size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        swap(index[i], index[(size_t)(rand64(&seed) * n)]);
+    }
+}
+
+static int test2_compare(const void* a, const void* b) {
+    const uint64_t x = *(const uint64_t*)a;
+    const uint64_t y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static int test2(void) {
+    // point operations against kvm, range scans against scan and sort
+    enum { n = 1024 * 1024, queries = 100, span = 1000 };
+    static size_t index[n];
+    static uint64_t k[n];
+    static uint64_t found[n];
+    omap(uint64_t, uint64_t) o;
+    kvm(uint64_t, uint64_t) h;
+    omap_init(&o);
+    kvm_alloc(&h, 16);
+    for (size_t i = 0; i < n; i++) {
+        index[i] = i;
+        k[i] = i * 10; // timestamps
+    }
+    shuffle(index, n);
+    double us[2][3];
+    uint64_t t = nanoseconds();
+    for (size_t i = 0; i < n; i++) { omap_put(&o, k[index[i]], i); }
+    us[0][0] = (nanoseconds() - t) * 1e-3 / n;
+    t = nanoseconds();
+    for (size_t i = 0; i < n; i++) { kvm_put(&h, k[index[i]], i); }
+    us[1][0] = (nanoseconds() - t) * 1e-3 / n;
+    shuffle(index, n);
+    t = nanoseconds();
+    for (size_t i = 0; i < n; i++) { swear(omap_get(&o, k[index[i]])); }
+    us[0][1] = (nanoseconds() - t) * 1e-3 / n;
+    t = nanoseconds();
+    for (size_t i = 0; i < n; i++) { swear(kvm_get(&h, k[index[i]])); }
+    us[1][1] = (nanoseconds() - t) * 1e-3 / n;
+    // [from, from + span * 10) ranges of span entries:
+    uint64_t sum[2] = {0};
+    t = nanoseconds();
+    for (size_t q = 0; q < queries; q++) {
+        const uint64_t from = k[index[q]];
+        struct omap_iterator iterator = omap_range(&o, from, from + span * 10);
+        while (omap_has_next(&iterator)) { sum[0] += *omap_next(&o, &iterator); }
+    }
+    const double range_omap = (nanoseconds() - t) * 1e-3 / queries;
+    t = nanoseconds();
+    for (size_t q = 0; q < queries; q++) {
+        const uint64_t from = k[index[q]];
+        size_t count = 0;
+        struct kvm_iterator iterator = kvm_iterator(&h);
+        while (kvm_has_next(&iterator)) {
+            const uint64_t key = *kvm_next(&h, &iterator);
+            if (from <= key && key < from + span * 10) { found[count++] = key; }
+        }
+        qsort(found, count, sizeof(found[0]), test2_compare);
+        for (size_t i = 0; i < count; i++) { sum[1] += found[i]; }
+    }
+    const double range_kvm = (nanoseconds() - t) * 1e-3 / queries;
+    swear(sum[0] == sum[1]);
+    shuffle(index, n);
+    t = nanoseconds();
+    for (size_t i = 0; i < n; i++) { swear(omap_delete(&o, k[index[i]])); }
+    us[0][2] = (nanoseconds() - t) * 1e-3 / n;
+    t = nanoseconds();
+    for (size_t i = 0; i < n; i++) { swear(kvm_delete(&h, k[index[i]])); }
+    us[1][2] = (nanoseconds() - t) * 1e-3 / n;
+    swear(o.n == 0 && o.root == null);
+    omap_free(&o);
+    kvm_free(&h);
+    printf("%d keys put/get/delete omap: %.3f %.3f %.3f kvm: %.3f %.3f %.3f"
+           "\xCE\xBC" "s\n", n, us[0][0], us[0][1], us[0][2],
+           us[1][0], us[1][1], us[1][2]);
+    printf("range of %d keys omap_range: %.3f" "\xCE\xBC" "s "
+           "kvm scan and sort: %.3f" "\xCE\xBC" "s\n",
+           span, range_omap, range_kvm);
+    return 0;
+}
+
+int omap_tests(void) {
+    omap_fatalist = true;
+    return test0() || test1() || test2();
+}
+
+#define omap_implementation
+#include "omap.h" // implement omap
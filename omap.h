@@ -0,0 +1,615 @@
+#ifndef omap_h_included
+#define omap_h_included
+/*
+    # Usage:
+
+    omap() is an ordered map of integer keys (signed or unsigned, 1, 2, 4
+    or 8 bytes) to values of any type. It is a B+-tree: inner nodes and
+    leaves hold up to 32 keys, leaves are linked in key order, so range
+    queries visit only the leaves that overlap the range.
+
+    omap_fatalist = true; // errors will raise SIGABRT before returning false
+
+    omap(int64_t, double) m;
+    omap_init(&m);
+    omap_put(&m, 42, 3.1415);
+    double* v = omap_get(&m, 42); // null if absent
+    omap_delete(&m, 42);
+    printf("map has %zd entries\n", m.n);
+
+    // all keys in [from, to) in ascending order:
+    struct omap_iterator iterator = omap_range(&m, from, to);
+    while (omap_has_next(&iterator)) {
+        double val = 0;
+        int64_t key = *omap_next_entry(&m, &iterator, &val);
+    }
+
+    omap_lower_bound(&m, key) iterates from the first key >= key to the
+    end, omap_iterator(&m) iterates all entries. omap_next(&m, &iterator)
+    returns the key only. Returned key pointers point into the iterator,
+    value pointers of omap_get() are valid until the next put or delete.
+    Modifying the map during iteration is fatal.
+
+    omap_free(&m); // omap_clear(&m) is the same, the map stays usable
+
+    Keys are kept as int64_t with unsigned keys biased by 2^63 and unused
+    key slots padded with INT64_MAX. Search in a node is a fixed width
+    branchless count of keys below the searched key instead of a binary
+    search with unpredictable branches. Compilers turn it into 64-bit
+    SIMD compares on AArch64 and on x86-64 with SSE4.2 or AVX2 enabled
+    (e.g. -march=x86-64-v3). Nodes stay at least a quarter full after
+    deletes.
+*/
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool omap_fatalist; // any of omap errors are fatal
+
+struct omap_iterator {
+    void*    leaf; /* current leaf or null at the end */
+    size_t   i;    /* index of next key in the leaf */
+    int64_t  to;   /* end of range (exclusive) if bounded */
+    bool     bounded;
+    uint64_t key;  /* last returned key in the type of map keys */
+    void*    m;    /* map */
+    uint64_t mc;   /* modification count */
+};
+
+#define omap_struct(tk, tv)                                     \
+    struct {                                                    \
+        void*    root;   /* leaf or inner node, null if empty */ \
+        size_t   height; /* inner node levels above leaves */   \
+        size_t   n;      /* number of entries */                \
+        uint64_t mc;     /* modification count */               \
+        tk* k; /* key type only, never allocated */             \
+        tv* v; /* val type only, never allocated */             \
+    }
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool _omap_init(void* mv, size_t kb);
+
+bool _omap_put(void* mv, const size_t kb, const size_t vb, const int sign,
+               const void* pkey, const void* pval);
+
+const void* _omap_get(const void* mv, const size_t kb, const size_t vb,
+                      const int sign, const void* pkey);
+
+bool _omap_delete(void* mv, const size_t kb, const size_t vb, const int sign,
+                  const void* pkey);
+
+struct omap_iterator _omap_range(void* mv, const size_t kb, const int sign,
+                                 const void* from, const void* to);
+
+bool omap_has_next(struct omap_iterator* iterator);
+
+void* _omap_next(struct omap_iterator* iterator, const size_t kb,
+                 const size_t vb, const int sign, void* pval);
+
+void _omap_clear(void* mv);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#define omap(tk, tv) omap_struct(tk, tv)
+
+#define _omap_tk(m) typeof((m)->k[0]) // type of key
+#define _omap_tv(m) typeof((m)->v[0]) // type of val
+
+#define _omap_ka(m, key) (&(_omap_tk(m)){(key)}) // key address
+#define _omap_va(m, val) (&(_omap_tv(m)){(val)}) // val address
+
+#define _omap_kb(m) sizeof((m)->k[0]) // number of bytes in key
+#define _omap_vb(m) sizeof((m)->v[0]) // number of bytes in val
+
+// compile time key signedness: 1 signed integers, 0 unsigned and pointers
+#define _omap_sign(m) _Generic(((m)->k[0]),                     \
+    signed char: 1, short: 1, int: 1, long: 1, long long: 1,    \
+    char: (char)-1 < 0, default: 0)
+
+#define omap_init(m) _omap_init(m, _omap_kb(m))
+
+#define omap_clear(m) _omap_clear(m)
+#define omap_free(m)  _omap_clear(m)
+
+#define omap_put(m, key, val) _omap_put(m, _omap_kb(m), _omap_vb(m), \
+    _omap_sign(m), _omap_ka(m, key), _omap_va(m, val))
+
+#define omap_get(m, key) (_omap_tv(m)*)_omap_get(m, _omap_kb(m),     \
+    _omap_vb(m), _omap_sign(m), _omap_ka(m, key))
+
+#define omap_delete(m, key) _omap_delete(m, _omap_kb(m), _omap_vb(m), \
+    _omap_sign(m), _omap_ka(m, key))
+
+#define omap_iterator(m) _omap_range(m, _omap_kb(m), _omap_sign(m), 0, 0)
+
+#define omap_lower_bound(m, key) _omap_range(m, _omap_kb(m),         \
+    _omap_sign(m), _omap_ka(m, key), 0)
+
+#define omap_range(m, from, to) _omap_range(m, _omap_kb(m),          \
+    _omap_sign(m), _omap_ka(m, from), _omap_ka(m, to))
+
+#define omap_next(m, iterator) \
+        (_omap_tk(m)*)_omap_next(iterator, _omap_kb(m), _omap_vb(m), \
+                                 _omap_sign(m), 0)
+
+#define omap_next_entry(m, iterator, pv) \
+        (_omap_tk(m)*)_omap_next(iterator, _omap_kb(m), _omap_vb(m), \
+                                 _omap_sign(m), pv)
+
+#endif // omap_h_included
+
+#if defined(omap_implementation) && !defined(omap_implemented)
+
+#define omap_implemented
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define _omap_fatal_return_zero(...) do { \
+    if (omap_fatalist) {                  \
+        fprintf(stderr, "" __VA_ARGS__);  \
+        raise(SIGABRT);                   \
+    }                                     \
+    return 0; /* false of (void*)0 */     \
+} while (0)
+
+typedef omap(void*, void*) omap_t;
+
+enum {
+    _omap_width  = 32, // keys per node: 256 bytes, 4 cache lines
+    _omap_min    = _omap_width / 4, // fewer keys are merged or borrowed
+    _omap_levels = 40  // 32 * 8^39 entries do not fit into memory
+};
+
+// Leaves and inner nodes start with the same padded keys array.
+
+struct _omap_leaf {
+    int64_t  keys[_omap_width]; // unused keys are INT64_MAX
+    size_t   n;                 // number of keys
+    struct _omap_leaf* next;    // next leaf in key order or null
+    uint8_t  vals[];            // _omap_width * vb bytes
+};
+
+struct _omap_inner {
+    int64_t  keys[_omap_width]; // keys[i] <= all keys of child[i + 1]
+    size_t   n;                 // number of keys, n + 1 children
+    void*    child[_omap_width + 1];
+};
+
+static inline int64_t _omap_key(const void* pkey, const size_t kb,
+                                const int sign) {
+    // order preserving map of integer keys to int64_t
+    const uint64_t bias = 1uLL << 63;
+    if (kb == 1) {
+        return sign ? *(int8_t*)pkey : (int64_t)(*(uint8_t*)pkey ^ bias);
+    } else if (kb == 2) {
+        return sign ? *(int16_t*)pkey : (int64_t)(*(uint16_t*)pkey ^ bias);
+    } else if (kb == 4) {
+        return sign ? *(int32_t*)pkey : (int64_t)(*(uint32_t*)pkey ^ bias);
+    } else {
+        return sign ? *(int64_t*)pkey : (int64_t)(*(uint64_t*)pkey ^ bias);
+    }
+}
+
+static inline void _omap_key_out(void* pkey, const size_t kb, const int sign,
+                                 const int64_t key) {
+    const uint64_t u = sign ? (uint64_t)key : (uint64_t)key ^ (1uLL << 63);
+    if (kb == 1) { *(uint8_t*)pkey  = (uint8_t)u;  return; }
+    if (kb == 2) { *(uint16_t*)pkey = (uint16_t)u; return; }
+    if (kb == 4) { *(uint32_t*)pkey = (uint32_t)u; return; }
+    *(uint64_t*)pkey = u;
+}
+
+static inline size_t _omap_rank(const int64_t* keys, const int64_t key) {
+    // number of keys less than key: index of the first key >= key.
+    // Fixed width loop over padded keys vectorizes into SIMD compares.
+    size_t r = 0;
+    for (size_t i = 0; i < _omap_width; i++) { r += keys[i] < key; }
+    return r;
+}
+
+static inline size_t _omap_child(const struct _omap_inner* p,
+                                 const int64_t key) {
+    // index of the child whose key range holds the key
+    size_t r = 0;
+    for (size_t i = 0; i < _omap_width; i++) { r += p->keys[i] <= key; }
+    return r < p->n ? r : p->n; // padding counts for key == INT64_MAX
+}
+
+static inline void _omap_pad(int64_t* keys, const size_t n) {
+    for (size_t i = n; i < _omap_width; i++) { keys[i] = INT64_MAX; }
+}
+
+static inline uint8_t* _omap_val(const struct _omap_leaf* l,
+                                 const size_t vb, const size_t i) {
+    return (uint8_t*)l->vals + i * vb;
+}
+
+static void* _omap_new(const bool leaf, const size_t vb) {
+    const size_t bytes = leaf ?
+        sizeof(struct _omap_leaf) + _omap_width * vb :
+        sizeof(struct _omap_inner);
+    int64_t* keys = malloc(bytes);
+    if (keys) {
+        _omap_pad(keys, 0);
+        if (leaf) {
+            ((struct _omap_leaf*)keys)->n = 0;
+            ((struct _omap_leaf*)keys)->next = 0;
+        } else {
+            ((struct _omap_inner*)keys)->n = 0;
+        }
+    }
+    return keys;
+}
+
+static void _omap_free_node(void* node, const size_t height) {
+    if (height > 0) {
+        struct _omap_inner* p = node;
+        for (size_t i = 0; i <= p->n; i++) {
+            _omap_free_node(p->child[i], height - 1);
+        }
+    }
+    free(node);
+}
+
+bool _omap_init(void* mv, size_t kb) {
+    omap_t* m = mv;
+    if (kb != 1 && kb != 2 && kb != 4 && kb != 8) {
+        _omap_fatal_return_zero("invalid key size: %zd\n", kb);
+    }
+    m->root = 0;
+    m->height = 0;
+    m->n  = 0;
+    m->mc = 0;
+    return true;
+}
+
+void _omap_clear(void* mv) {
+    omap_t* m = mv;
+    if (m->root) { _omap_free_node(m->root, m->height); }
+    m->root = 0;
+    m->height = 0;
+    m->n = 0;
+    m->mc++;
+}
+
+static struct _omap_leaf* _omap_leaf_of(const omap_t* m, const int64_t key) {
+    void* node = m->root;
+    for (size_t h = m->height; h > 0; h--) {
+        const struct _omap_inner* p = node;
+        node = p->child[_omap_child(p, key)];
+    }
+    return node;
+}
+
+const void* _omap_get(const void* mv, const size_t kb, const size_t vb,
+                      const int sign, const void* pkey) {
+    const omap_t* m = mv;
+    if (!m->root) { return 0; }
+    const int64_t key = _omap_key(pkey, kb, sign);
+    const struct _omap_leaf* l = _omap_leaf_of(m, key);
+    const size_t i = _omap_rank(l->keys, key);
+    return i < l->n && l->keys[i] == key ? _omap_val(l, vb, i) : 0;
+}
+
+static void _omap_leaf_insert(struct _omap_leaf* l, const size_t vb,
+        const size_t i, const int64_t key, const void* pval) {
+    memmove(l->keys + i + 1, l->keys + i, (l->n - i) * sizeof(l->keys[0]));
+    memmove(_omap_val(l, vb, i + 1), _omap_val(l, vb, i), (l->n - i) * vb);
+    l->keys[i] = key;
+    memcpy(_omap_val(l, vb, i), pval, vb);
+    l->n++;
+}
+
+static void _omap_inner_insert(struct _omap_inner* p, const size_t i,
+                               const int64_t key, void* right) {
+    // separator key at i and its right child at i + 1
+    memmove(p->keys + i + 1, p->keys + i, (p->n - i) * sizeof(p->keys[0]));
+    memmove(p->child + i + 2, p->child + i + 1,
+            (p->n - i) * sizeof(p->child[0]));
+    p->keys[i] = key;
+    p->child[i + 1] = right;
+    p->n++;
+}
+
+bool _omap_put(void* mv, const size_t kb, const size_t vb, const int sign,
+               const void* pkey, const void* pval) {
+    omap_t* m = mv;
+    const int64_t key = _omap_key(pkey, kb, sign);
+    if (!m->root) {
+        m->root = _omap_new(true, vb);
+        if (!m->root) { _omap_fatal_return_zero("out of memory\n"); }
+    }
+    // descend recording the path:
+    struct _omap_inner* path[_omap_levels];
+    size_t at[_omap_levels];
+    void* node = m->root;
+    for (size_t d = 0; d < m->height; d++) {
+        path[d] = node;
+        at[d] = _omap_child(path[d], key);
+        node = path[d]->child[at[d]];
+    }
+    struct _omap_leaf* l = node;
+    size_t i = _omap_rank(l->keys, key);
+    if (i < l->n && l->keys[i] == key) {
+        memcpy(_omap_val(l, vb, i), pval, vb);
+        return true;
+    }
+    // Splits propagate up through full nodes only. All new nodes are
+    // allocated before the tree changes so running out of memory
+    // leaves the map intact.
+    void* spare[_omap_levels + 1];
+    size_t splits = 0;
+    if (l->n == _omap_width) {
+        spare[splits++] = _omap_new(true, vb);
+        size_t d = m->height;
+        while (d > 0 && path[d - 1]->n == _omap_width) {
+            spare[splits++] = _omap_new(false, vb);
+            d--;
+        }
+        if (d == 0) { spare[splits++] = _omap_new(false, vb); } // new root
+        for (size_t s = 0; s < splits; s++) {
+            if (!spare[s]) {
+                for (size_t j = 0; j < splits; j++) { free(spare[j]); }
+                _omap_fatal_return_zero("out of memory\n");
+            }
+        }
+    }
+    m->n++;
+    m->mc++;
+    if (splits == 0) {
+        _omap_leaf_insert(l, vb, i, key, pval);
+        return true;
+    }
+    size_t s = 0;
+    struct _omap_leaf* r = spare[s++];
+    const size_t half = _omap_width / 2;
+    r->n = _omap_width - half;
+    memcpy(r->keys, l->keys + half, r->n * sizeof(l->keys[0]));
+    memcpy(r->vals, _omap_val(l, vb, half), r->n * vb);
+    l->n = half;
+    _omap_pad(l->keys, l->n);
+    r->next = l->next;
+    l->next = r;
+    if (i > half) {
+        _omap_leaf_insert(r, vb, i - half, key, pval);
+    } else {
+        _omap_leaf_insert(l, vb, i, key, pval);
+    }
+    int64_t up = r->keys[0];
+    void* right = r;
+    size_t d = m->height;
+    while (right && d > 0) {
+        d--;
+        struct _omap_inner* p = path[d];
+        if (p->n < _omap_width) {
+            _omap_inner_insert(p, at[d], up, right);
+            right = 0;
+        } else {
+            // split W + 1 keys: half stay, the middle goes up, rest move
+            int64_t keys[_omap_width + 1];
+            void* child[_omap_width + 2];
+            memcpy(keys, p->keys, _omap_width * sizeof(keys[0]));
+            memcpy(child, p->child, (_omap_width + 1) * sizeof(child[0]));
+            memmove(keys + at[d] + 1, keys + at[d],
+                    (_omap_width - at[d]) * sizeof(keys[0]));
+            memmove(child + at[d] + 2, child + at[d] + 1,
+                    (_omap_width - at[d]) * sizeof(child[0]));
+            keys[at[d]] = up;
+            child[at[d] + 1] = right;
+            struct _omap_inner* q = spare[s++];
+            const size_t h = (_omap_width + 1) / 2;
+            p->n = h;
+            memcpy(p->keys, keys, h * sizeof(keys[0]));
+            memcpy(p->child, child, (h + 1) * sizeof(child[0]));
+            _omap_pad(p->keys, p->n);
+            q->n = _omap_width - h;
+            memcpy(q->keys, keys + h + 1, q->n * sizeof(keys[0]));
+            memcpy(q->child, child + h + 1, (q->n + 1) * sizeof(child[0]));
+            up = keys[h];
+            right = q;
+        }
+    }
+    if (right) { // root split
+        struct _omap_inner* root = spare[s++];
+        root->n = 1;
+        root->keys[0] = up;
+        root->child[0] = m->root;
+        root->child[1] = right;
+        m->root = root;
+        m->height++;
+    }
+    assert(s == splits);
+    return true;
+}
+
+static void _omap_fix_leaf(struct _omap_inner* p, const size_t i,
+                           const size_t vb) {
+    // child i is below minimum: merge with or borrow from a sibling
+    const size_t j = i > 0 ? i - 1 : i;
+    struct _omap_leaf* l = p->child[j];
+    struct _omap_leaf* r = p->child[j + 1];
+    if (l->n + r->n <= _omap_width) {
+        memcpy(l->keys + l->n, r->keys, r->n * sizeof(r->keys[0]));
+        memcpy(_omap_val(l, vb, l->n), r->vals, r->n * vb);
+        l->n += r->n;
+        l->next = r->next;
+        free(r);
+        memmove(p->keys + j, p->keys + j + 1,
+                (p->n - j - 1) * sizeof(p->keys[0]));
+        memmove(p->child + j + 1, p->child + j + 2,
+                (p->n - j - 1) * sizeof(p->child[0]));
+        p->n--;
+        _omap_pad(p->keys, p->n);
+    } else if (l->n < r->n) { // borrow first of right
+        l->keys[l->n] = r->keys[0];
+        memcpy(_omap_val(l, vb, l->n), r->vals, vb);
+        l->n++;
+        r->n--;
+        memmove(r->keys, r->keys + 1, r->n * sizeof(r->keys[0]));
+        memmove(r->vals, _omap_val(r, vb, 1), r->n * vb);
+        _omap_pad(r->keys, r->n);
+        p->keys[j] = r->keys[0];
+    } else { // borrow last of left
+        memmove(r->keys + 1, r->keys, r->n * sizeof(r->keys[0]));
+        memmove(_omap_val(r, vb, 1), r->vals, r->n * vb);
+        l->n--;
+        r->keys[0] = l->keys[l->n];
+        memcpy(r->vals, _omap_val(l, vb, l->n), vb);
+        r->n++;
+        _omap_pad(l->keys, l->n);
+        p->keys[j] = r->keys[0];
+    }
+}
+
+static void _omap_fix_inner(struct _omap_inner* p, const size_t i) {
+    // separator keys rotate through the parent
+    const size_t j = i > 0 ? i - 1 : i;
+    struct _omap_inner* l = p->child[j];
+    struct _omap_inner* r = p->child[j + 1];
+    if (l->n + 1 + r->n <= _omap_width) {
+        l->keys[l->n] = p->keys[j];
+        memcpy(l->keys + l->n + 1, r->keys, r->n * sizeof(r->keys[0]));
+        memcpy(l->child + l->n + 1, r->child,
+               (r->n + 1) * sizeof(r->child[0]));
+        l->n += 1 + r->n;
+        free(r);
+        memmove(p->keys + j, p->keys + j + 1,
+                (p->n - j - 1) * sizeof(p->keys[0]));
+        memmove(p->child + j + 1, p->child + j + 2,
+                (p->n - j - 1) * sizeof(p->child[0]));
+        p->n--;
+        _omap_pad(p->keys, p->n);
+    } else if (l->n < r->n) {
+        l->keys[l->n] = p->keys[j];
+        l->child[l->n + 1] = r->child[0];
+        l->n++;
+        p->keys[j] = r->keys[0];
+        r->n--;
+        memmove(r->keys, r->keys + 1, r->n * sizeof(r->keys[0]));
+        memmove(r->child, r->child + 1, (r->n + 1) * sizeof(r->child[0]));
+        _omap_pad(r->keys, r->n);
+    } else {
+        memmove(r->keys + 1, r->keys, r->n * sizeof(r->keys[0]));
+        memmove(r->child + 1, r->child, (r->n + 1) * sizeof(r->child[0]));
+        r->keys[0] = p->keys[j];
+        r->child[0] = l->child[l->n];
+        r->n++;
+        l->n--;
+        p->keys[j] = l->keys[l->n];
+        _omap_pad(l->keys, l->n);
+    }
+}
+
+bool _omap_delete(void* mv, const size_t kb, const size_t vb, const int sign,
+                  const void* pkey) {
+    omap_t* m = mv;
+    if (!m->root) { return false; }
+    const int64_t key = _omap_key(pkey, kb, sign);
+    struct _omap_inner* path[_omap_levels];
+    size_t at[_omap_levels];
+    void* node = m->root;
+    for (size_t d = 0; d < m->height; d++) {
+        path[d] = node;
+        at[d] = _omap_child(path[d], key);
+        node = path[d]->child[at[d]];
+    }
+    struct _omap_leaf* l = node;
+    const size_t i = _omap_rank(l->keys, key);
+    if (i >= l->n || l->keys[i] != key) { return false; }
+    l->n--;
+    memmove(l->keys + i, l->keys + i + 1, (l->n - i) * sizeof(l->keys[0]));
+    memmove(_omap_val(l, vb, i), _omap_val(l, vb, i + 1), (l->n - i) * vb);
+    l->keys[l->n] = INT64_MAX;
+    m->n--;
+    m->mc++;
+    // separators stay valid bounds, only underfull nodes are fixed:
+    size_t n = l->n;
+    size_t d = m->height;
+    while (d > 0 && n < _omap_min) {
+        d--;
+        if (d == m->height - 1) {
+            _omap_fix_leaf(path[d], at[d], vb);
+        } else {
+            _omap_fix_inner(path[d], at[d]);
+        }
+        n = path[d]->n;
+    }
+    if (m->height > 0) {
+        struct _omap_inner* root = m->root;
+        if (root->n == 0) {
+            m->root = root->child[0];
+            m->height--;
+            free(root);
+        }
+    } else if (l->n == 0) {
+        free(l);
+        m->root = 0;
+    }
+    return true;
+}
+
+struct omap_iterator _omap_range(void* mv, const size_t kb, const int sign,
+                                 const void* from, const void* to) {
+    omap_t* m = mv;
+    struct omap_iterator iterator = {
+        .leaf = 0, .i = 0, .to = 0, .bounded = to != 0, .key = 0,
+        .m = mv, .mc = m->mc
+    };
+    if (to) { iterator.to = _omap_key(to, kb, sign); }
+    if (m->root) {
+        const int64_t key = from ? _omap_key(from, kb, sign) : INT64_MIN;
+        struct _omap_leaf* l = _omap_leaf_of(m, key);
+        size_t i = _omap_rank(l->keys, key);
+        if (i == l->n) { l = l->next; i = 0; } // all keys of l are less
+        iterator.leaf = l;
+        iterator.i = i;
+    }
+    return iterator;
+}
+
+bool omap_has_next(struct omap_iterator* iterator) {
+    omap_t* m = iterator->m;
+    if (m->mc != iterator->mc) {
+        _omap_fatal_return_zero("map modified during iteration\n");
+    }
+    const struct _omap_leaf* l = iterator->leaf;
+    return l && (!iterator->bounded || l->keys[iterator->i] < iterator->to);
+}
+
+void* _omap_next(struct omap_iterator* iterator, const size_t kb,
+                 const size_t vb, const int sign, void* pval) {
+    omap_t* m = iterator->m;
+    if (m->mc != iterator->mc) {
+        _omap_fatal_return_zero("map modified during iteration\n");
+    } else if (omap_has_next(iterator)) {
+        const struct _omap_leaf* l = iterator->leaf;
+        const size_t i = iterator->i;
+        _omap_key_out(&iterator->key, kb, sign, l->keys[i]);
+        if (pval) { memcpy(pval, _omap_val(l, vb, i), vb); }
+        if (i + 1 < l->n) {
+            iterator->i = i + 1;
+        } else {
+            iterator->leaf = l->next;
+            iterator->i = 0;
+        }
+        return &iterator->key;
+    } else {
+        return 0;
+    }
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // omap_implementation